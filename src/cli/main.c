@@ -37,9 +37,11 @@
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
 #include "common/points.h"
+#include "common/worker_pool.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
 
+#include <float.h>
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
@@ -55,10 +57,113 @@ static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [--width <max width>,--height <max "
                   "height>,--bpp <bpp>,--hq <0|1|true|false>,--upscale <0|1|true|false>,--style <style name>,"
-                  "--style-overwrite,--verbose] [--core <darktable options>]\n",
+                  "--style-overwrite,--jobs <number of parallel exports>,--memory <memory limit in MB>,"
+                  "--verbose] [--core <darktable options>]\n",
           progname);
 }
 
+typedef struct dt_cli_job_t
+{
+  int imgid;
+  int num;
+  double seconds;
+  int failed;
+} dt_cli_job_t;
+
+// state shared by the workers of the --jobs batch mode
+typedef struct dt_cli_batch_t
+{
+  dt_cli_job_t *jobs;
+  int total;
+
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata; // the template, every worker gets its own copy
+  gboolean high_quality, upscale;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} dt_cli_batch_t;
+
+// format params get written to during export (width, height), so every worker uses a private copy
+static void *_batch_worker_init(void *data)
+{
+  dt_cli_batch_t *b = (dt_cli_batch_t *)data;
+  dt_imageio_module_data_t *fdata = b->format->get_params(b->format);
+  if(fdata) memcpy(fdata, b->fdata, b->format->params_size(b->format));
+  return fdata;
+}
+
+static void _batch_worker_cleanup(void *data, void *worker)
+{
+  dt_cli_batch_t *b = (dt_cli_batch_t *)data;
+  b->format->free_params(b->format, (dt_imageio_module_data_t *)worker);
+}
+
+static void _batch_export_one(void *data, void *worker, const int k)
+{
+  dt_cli_batch_t *b = (dt_cli_batch_t *)data;
+  dt_cli_job_t *job = b->jobs + k;
+  const double start = dt_get_wtime();
+  job->failed = b->storage->store(b->storage, b->sdata, job->imgid, b->format, (dt_imageio_module_data_t *)worker,
+                                  job->num, b->total, b->high_quality, b->upscale, b->icc_type, b->icc_filename,
+                                  b->icc_intent);
+  job->seconds = dt_get_wtime() - start;
+}
+
+static void _batch_print_stats(const dt_cli_batch_t *b, const double seconds)
+{
+  double sum = 0.0, min = DBL_MAX, max = 0.0;
+  int failed = 0;
+  for(int k = 0; k < b->total; k++)
+  {
+    const dt_cli_job_t *job = b->jobs + k;
+    printf("[%d/%d] image %d: %.3f s%s\n", job->num, b->total, job->imgid, job->seconds,
+           job->failed ? " (failed)" : "");
+    sum += job->seconds;
+    min = MIN(min, job->seconds);
+    max = MAX(max, job->seconds);
+    if(job->failed) failed++;
+  }
+  printf("exported %d of %d images in %.3f s: %.3f images/s, per image %.3f s mean, %.3f s min, %.3f s max\n",
+         b->total - failed, b->total, seconds, b->total / MAX(seconds, 1e-6), sum / b->total, min, max);
+}
+
+// export all images with several pipes in flight. the storage is called in parallel, which the disk
+// storage already supports (it synchronizes the file name generation on plugin_threadsafe).
+static void _batch_export(dt_cli_batch_t *b, GList *id_list, const int num_jobs, const int memory_limit)
+{
+  b->total = g_list_length(id_list);
+  b->jobs = (dt_cli_job_t *)calloc(b->total, sizeof(dt_cli_job_t));
+  dt_worker_pool_t pool;
+  dt_worker_pool_init(&pool, b->total, num_jobs, memory_limit);
+
+  int num = 1;
+  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  {
+    dt_cli_job_t *job = b->jobs + num - 1;
+    job->imgid = GPOINTER_TO_INT(iter->data);
+    job->num = num;
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, job->imgid, 'r');
+    dt_worker_pool_set_image_size(&pool, num - 1, img->width, img->height);
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
+
+  // parse the style once and hand the same items to every pipe
+  dt_imageio_export_style_cache_init();
+
+  const double start = dt_get_wtime();
+  dt_worker_pool_run(&pool, "cli_export", _batch_worker_init, _batch_export_one, _batch_worker_cleanup, b);
+  const double end = dt_get_wtime();
+
+  _batch_print_stats(b, end - start);
+
+  dt_imageio_export_style_cache_cleanup();
+  dt_worker_pool_cleanup(&pool);
+  free(b->jobs);
+}
+
 int main(int argc, char *arg[])
 {
   bindtextdomain(GETTEXT_PACKAGE, DARKTABLE_LOCALEDIR);
@@ -73,7 +178,7 @@ int main(int argc, char *arg[])
   char *output_filename = NULL;
   char *style = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0, style_overwrite = 0;
+  int width = 0, height = 0, bpp = 0, style_overwrite = 0, num_jobs = 1, memory_limit = -1;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE;
 
   int k;
@@ -150,6 +255,16 @@ int main(int argc, char *arg[])
       {
         style_overwrite = 1;
       }
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        num_jobs = MAX(atoi(arg[k]), 1);
+      }
+      else if(!strcmp(arg[k], "--memory") && argc > k + 1)
+      {
+        k++;
+        memory_limit = MAX(atoi(arg[k]), 0);
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -392,12 +507,37 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
-  int num = 1;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  // pdf collects all pages in its params, it can't be written from several pipes
+  if(num_jobs > 1 && !strcmp(format->plugin_name, "pdf"))
+  {
+    fprintf(stderr, "%s\n", _("the pdf format can't be exported in parallel, ignoring --jobs"));
+    num_jobs = 1;
+  }
+  num_jobs = MIN(num_jobs, total);
+
+  if(num_jobs > 1)
   {
-    int id = GPOINTER_TO_INT(iter->data);
-    storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, icc_type, icc_filename,
-                   icc_intent);
+    dt_cli_batch_t batch = { 0 };
+    batch.storage = storage;
+    batch.sdata = sdata;
+    batch.format = format;
+    batch.fdata = fdata;
+    batch.high_quality = high_quality;
+    batch.upscale = upscale;
+    batch.icc_type = icc_type;
+    batch.icc_filename = icc_filename;
+    batch.icc_intent = icc_intent;
+    _batch_export(&batch, id_list, num_jobs, memory_limit);
+  }
+  else
+  {
+    int num = 1;
+    for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+    {
+      int id = GPOINTER_TO_INT(iter->data);
+      storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, icc_type, icc_filename,
+                     icc_intent);
+    }
   }
 
   // cleanup time
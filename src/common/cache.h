@@ -38,16 +38,27 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+typedef struct dt_cache_shard_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock; // protects the hashtable and lru list of this shard only.
 
-  size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
-  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
+  size_t cost;           // sum of the cost of all entries in this shard.
+  size_t cost_quota;     // this shard's part of the cache quota.
 
   GHashTable *hashtable; // stores (key, entry) pairs
   GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+}
+dt_cache_shard_t;
+
+typedef struct dt_cache_t
+{
+  // keys are distributed over the shards, every shard has its own lock and lru list. with only one shard
+  // this is the good old big fat lock, which is fine if only a couple hand full of threads are expected.
+  dt_cache_shard_t *shards;
+  uint32_t num_shards; // power of two
+
+  size_t entry_size; // cache line allocation
+  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -59,6 +70,9 @@ dt_cache_t;
 
 // entry size is only used if alloc callback is 0
 void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// same, but spreads the keys over num_shards (rounded up to a power of two) independently locked shards,
+// each with its own part of the quota. use this for caches hammered by many threads at once.
+void dt_cache_init_sharded(dt_cache_t *cache, size_t entry_size, size_t cost_quota, uint32_t num_shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
@@ -74,6 +88,14 @@ static inline void dt_cache_set_cleanup_callback(dt_cache_t *cache, dt_cache_cle
   cache->cleanup_data = cleanup_data;
 }
 
+// sum of the cost of all entries, for statistics. not locked.
+static inline size_t dt_cache_get_cost(const dt_cache_t *cache)
+{
+  size_t cost = 0;
+  for(uint32_t k = 0; k < cache->num_shards; k++) cost += cache->shards[k].cost;
+  return cost;
+}
+
 // returns a slot in the cache for this key (newly allocated if need be), locked according to mode (r, w)
 #define dt_cache_get(A, B, C)  dt_cache_get_with_caller(A, B, C, __FILE__, __LINE__)
 dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key, char mode, const char *file, int line);
@@ -87,10 +109,10 @@ void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, co
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the lru lists, until the fill ratio of the hashtable
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
-// is locked)
+// will never block on entries and never fail, but sometimes not free memory (in
+// case all is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
 // iterate over all currently contained data blocks.
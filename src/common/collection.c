@@ -63,12 +63,16 @@ static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpo
 
 /* determine image offset of specified imgid for the given collection */
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid);
+/* drop the materialized result of the query, it is rebuilt on the next lookup */
+static void _collection_index_invalidate(const dt_collection_t *collection);
 /* update aspect ratio for the selected images */
 static void _collection_update_aspect_ratio(const dt_collection_t *collection);
 
 const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc0(sizeof(dt_collection_t));
+  g_mutex_init(&collection->index_lock);
+  collection->version = 1;
 
   /* initialize collection context*/
   if(clone) /* if clone is provided let's copy it into this context */
@@ -112,6 +116,9 @@ void dt_collection_free(const dt_collection_t *collection)
   g_free(collection->query);
   g_free(collection->query_no_group);
   g_strfreev(collection->where_ext);
+  if(collection->index) g_array_free(collection->index, TRUE);
+  if(collection->index_positions) g_hash_table_destroy(collection->index_positions);
+  g_mutex_clear(&((dt_collection_t *)collection)->index_lock);
   g_free((dt_collection_t *)collection);
 }
 
@@ -263,6 +270,7 @@ int dt_collection_update(const dt_collection_t *collection)
       = dt_util_dstrcat(query_no_group, "%s%s%s %s%s", selq_pre, wq_no_group, selq_post ? selq_post : "", sq ? sq : "",
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
   result = _dt_collection_store(collection, query, query_no_group);
+  _collection_index_invalidate(collection);
 
   /* free memory used */
   g_free(sq);
@@ -645,6 +653,64 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   return count;
 }
 
+// counts changes to any image, they can move images in or out of any collection or change their order
+static gint _images_version = 0;
+
+static void _collection_index_invalidate(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  g_mutex_lock(&c->index_lock);
+  c->version++;
+  g_mutex_unlock(&c->index_lock);
+}
+
+/* runs the query once and keeps all image ids in order, unless that was done for the current version already.
+ * the index lock has to be held. */
+static gboolean _collection_index_update(dt_collection_t *collection, const gchar *query)
+{
+  const uint32_t images_version = g_atomic_int_get(&_images_version);
+  if(collection->index && collection->index_version == collection->version
+     && collection->index_images_version == images_version)
+    return TRUE;
+  if(!query) return FALSE;
+
+  const double start = dt_get_wtime();
+  if(!collection->index)
+  {
+    collection->index = g_array_new(FALSE, FALSE, sizeof(int32_t));
+    collection->index_positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+  g_array_set_size(collection->index, 0);
+  g_hash_table_remove_all(collection->index_positions);
+
+  sqlite3_stmt *stmt = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+  }
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    // the query is DISTINCT, every id shows up once
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    g_array_append_val(collection->index, id);
+    g_hash_table_insert(collection->index_positions, GINT_TO_POINTER(id), GINT_TO_POINTER(collection->index->len));
+  }
+  sqlite3_finalize(stmt);
+  collection->index_version = collection->version;
+  collection->index_images_version = images_version;
+
+  dt_print(DT_DEBUG_PERF, "[collection] indexed %u images in %.3f secs\n", collection->index->len,
+           dt_get_wtime() - start);
+  return TRUE;
+}
+
+void dt_collection_image_changed(void)
+{
+  g_atomic_int_inc(&_images_version);
+}
+
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
   return collection->count;
@@ -670,38 +736,36 @@ GList *dt_collection_get(const dt_collection_t *collection, int limit, gboolean
 {
   GList *list = NULL;
   const gchar *query = dt_collection_get_query(collection);
-  if(query)
+  if(query && !selected)
+  {
+    dt_collection_t *c = (dt_collection_t *)collection;
+    g_mutex_lock(&c->index_lock);
+    if(_collection_index_update(c, query))
+    {
+      const int count = (limit < 0) ? c->index->len : MIN(limit, c->index->len);
+      for(int k = count - 1; k >= 0; k--)
+        list = g_list_prepend(list, GINT_TO_POINTER(g_array_index(c->index, int32_t, k)));
+    }
+    g_mutex_unlock(&c->index_lock);
+  }
+  else if(query)
   {
     sqlite3_stmt *stmt = NULL;
     gchar *q;
 
-    if(selected)
-      q = g_strdup_printf("SELECT id FROM main.selected_images AS s JOIN (%s) AS a WHERE a.id = s.imgid LIMIT -1, ?3", query);
-    else
-      q = g_strdup_printf("%s", query);
+    q = g_strdup_printf("SELECT id FROM main.selected_images AS s JOIN (%s) AS a WHERE a.id = s.imgid LIMIT -1, ?3", query);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), q, -1, &stmt, NULL);
 
-    if(selected)
-    {
-      if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-      {
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, -1);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-      }
-
-      // the limit is done on the main select and not on the JOIN
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, limit);
-    }
-    else
+    if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
     {
-      if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-      {
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, -1);
-        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, limit);
-      }
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, -1);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
     }
 
+    // the limit is done on the main select and not on the JOIN
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, limit);
+
     while(sqlite3_step(stmt) == SQLITE_ROW)
     {
       const int imgid = sqlite3_column_int(stmt, 0);
@@ -722,24 +786,16 @@ GList *dt_collection_get_all(const dt_collection_t *collection, int limit)
 
 int dt_collection_get_nth(const dt_collection_t *collection, int nth)
 {
-  if(nth < 0 || nth >= dt_collection_get_count(collection))
-    return -1;
+  if(nth < 0) return -1;
   const gchar *query = dt_collection_get_query(collection);
-  sqlite3_stmt *stmt = NULL;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, nth);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
+  dt_collection_t *c = (dt_collection_t *)collection;
 
   int result = -1;
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    result  = sqlite3_column_int(stmt, 0);
-  }
-
-  sqlite3_finalize(stmt);
+  g_mutex_lock(&c->index_lock);
+  if(_collection_index_update(c, query) && nth < c->index->len) result = g_array_index(c->index, int32_t, nth);
+  g_mutex_unlock(&c->index_lock);
 
   return result;
-
 }
 
 GList *dt_collection_get_selected(const dt_collection_t *collection, int limit)
@@ -1546,37 +1602,15 @@ static int dt_collection_image_offset_with_collection(const dt_collection_t *col
 {
   if(imgid == -1) return 0;
   const gchar *qin = dt_collection_get_query(collection);
+  dt_collection_t *c = (dt_collection_t *)collection;
   int offset = 0;
-  sqlite3_stmt *stmt;
 
-  if(qin)
-  {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
+  g_mutex_lock(&c->index_lock);
+  // images not in the collection are at offset 0
+  if(_collection_index_update(c, qin))
+    offset = MAX(GPOINTER_TO_INT(g_hash_table_lookup(c->index_positions, GINT_TO_POINTER(imgid))) - 1, 0);
+  g_mutex_unlock(&c->index_lock);
 
-    // was the limit portion of the query tacked on?
-    if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-    {
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-    }
-
-    gboolean found = FALSE;
-
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
-      if(imgid == id)
-      {
-        found = TRUE;
-        break;
-      }
-      offset++;
-    }
-
-    if(!found) offset = 0;
-
-    sqlite3_finalize(stmt);
-  }
   return offset;
 }
 
@@ -1588,6 +1622,9 @@ int dt_collection_image_offset(int imgid)
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
+  // tags or film rolls of some images changed, that concerns the other collections as well
+  dt_collection_image_changed();
+  _collection_index_invalidate(collection);
   int old_count = collection->count;
   collection->count = _dt_collection_compute_count(collection, FALSE);
   collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
@@ -1601,6 +1638,7 @@ static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_da
 static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
+  _collection_index_invalidate(collection);
   int old_count = collection->count;
   collection->count = _dt_collection_compute_count(collection, FALSE);
   collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
@@ -1765,6 +1803,9 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     sqlite3_finalize(update_stmt);
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
   }
+
+  // the custom sort order changed
+  _collection_index_invalidate(darktable.collection);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -140,6 +140,15 @@ typedef struct dt_collection_t
   unsigned int count, count_no_group;
   dt_collection_params_t params;
   dt_collection_params_t store;
+
+  /** materialized result of the query: image ids in collection order and id -> position + 1. it is built on the
+   * first lookup after the version changed, the version goes up whenever the result of the query might have.
+   * changes to the images themselves are counted for all collections, see dt_collection_image_changed(). */
+  GMutex index_lock;
+  GArray *index;
+  GHashTable *index_positions;
+  uint32_t version, index_version;
+  uint32_t index_images_version;
 } dt_collection_t;
 
 
@@ -221,6 +230,10 @@ void dt_collection_hint_message(const dt_collection_t *collection);
 /** returns the image offset in the collection */
 int dt_collection_image_offset(int imgid);
 
+/** tells all collections that something about one or more images changed in the database (flags, history,
+ * metadata, tags, ...), so their index is rebuilt on the next lookup. */
+void dt_collection_image_changed(void);
+
 /* serialize and deserialize into a string. */
 void dt_collection_deserialize(char *buf);
 int dt_collection_serialize(char *buf, int bufsize);
@@ -119,6 +119,7 @@ void dt_colorlabels_remove_labels_selection()
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "DELETE FROM main.color_labels WHERE imgid IN (SELECT imgid FROM main.selected_images)",
                         NULL, NULL, NULL);
+  dt_collection_image_changed();
 }
 
 void dt_colorlabels_remove_labels(const int imgid)
@@ -129,6 +130,7 @@ void dt_colorlabels_remove_labels(const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed();
 }
 
 void dt_colorlabels_set_label(const int imgid, const int color)
@@ -140,6 +142,7 @@ void dt_colorlabels_set_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed();
 }
 
 void dt_colorlabels_remove_label(const int imgid, const int color)
@@ -151,6 +154,7 @@ void dt_colorlabels_remove_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed();
 }
 
 void dt_colorlabels_toggle_label_selection(const int color)
@@ -197,6 +201,7 @@ void dt_colorlabels_toggle_label_selection(const int color)
   dt_undo_record(darktable.undo, NULL, DT_UNDO_COLORLABELS, (dt_undo_data_t *)undo, &_pop_undo, _colorlabels_undo_data_free);
   dt_undo_end_group(darktable.undo);
 
+  dt_collection_image_changed();
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -238,6 +243,7 @@ void dt_colorlabels_toggle_label(const int imgid, const int color)
   dt_undo_record(darktable.undo, NULL, DT_UNDO_COLORLABELS, (dt_undo_data_t *)undo, &_pop_undo, _colorlabels_undo_data_free);
   dt_undo_end_group(darktable.undo);
 
+  dt_collection_image_changed();
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include "common/darktable.h"
+
 #ifdef __SSE2__
 #include "common/sse.h"
 #include "common/math.h"
@@ -160,6 +162,40 @@ static inline __m128 dt_prophotoRGB_to_XYZ_sse2(__m128 rgb)
 }
 #endif
 
+#if defined(__SSE2__) && defined(DT_HAVE_TARGET_AVX2)
+#include <immintrin.h>
+
+/** lab_f_m_sse2() for two pixels, one in each 128 bit lane. */
+DT_TARGET_AVX2 static inline __m256 lab_f_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(216.0f / 24389.0f);
+  const __m256 kappa = _mm256_set1_ps(24389.0f / 27.0f);
+
+  // calculate as if x > epsilon : result = cbrtf(x)
+  const __m256 a = _mm256_castsi256_ps(_mm256_add_epi32(
+      _mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), _mm256_set1_ps(3.0f))),
+      _mm256_set1_epi32(709921077)));
+  const __m256 a3 = a * a * a;
+  const __m256 res_big = a * (a3 + x + x) / (a3 + a3 + x);
+
+  // calculate as if x <= epsilon : result = (kappa*x+16)/116
+  const __m256 res_small = _mm256_fmadd_ps(kappa, x, _mm256_set1_ps(16.0f)) / _mm256_set1_ps(116.0f);
+
+  return _mm256_blendv_ps(res_small, res_big, _mm256_cmp_ps(x, epsilon, _CMP_GT_OQ));
+}
+
+/** dt_XYZ_to_Lab_sse2() for two pixels. uses D50 white point. */
+DT_TARGET_AVX2 static inline __m256 dt_XYZ_to_Lab_avx2(const __m256 XYZ)
+{
+  const __m256 d50 = _mm256_setr_ps(0.9642f, 1.0f, 0.8249f, 1.0f, 0.9642f, 1.0f, 0.8249f, 1.0f);
+  const __m256 coef = _mm256_setr_ps(116.0f, 500.0f, 200.0f, 0.0f, 116.0f, 500.0f, 200.0f, 0.0f);
+  const __m256 f = lab_f_m_avx2(XYZ / d50);
+  // shuffles work per lane, so this is the same as for one pixel
+  return coef
+         * (_mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)) - _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3)));
+}
+#endif
+
 static inline float cbrt_5f(float f)
 {
   uint32_t *p = (uint32_t *)&f;
@@ -0,0 +1,325 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/colorspaces_lut3d.h"
+#include "common/darktable.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// grid sizes tried in this order, the first one that matches lcms2 well enough is kept
+static const int _lut3d_sizes[] = { 33, 65 };
+// number of probe colors the tables are checked with
+#define DT_COLORSPACES_LUT3D_PROBES 4096
+// tables which are not used by any pipe are dropped once there are more than that
+#define DT_COLORSPACES_LUT3D_CACHE_SIZE 16
+
+static GMutex _cache_lock;
+static GHashTable *_cache = NULL; // key -> dt_colorspaces_lut3d_t, a table of NULL marks a failed transform
+
+// grid position in [0, 1] of an input value
+static inline float _lut3d_to_grid(const dt_colorspaces_lut3d_input_t input, const int c, const float v)
+{
+  if(input == DT_COLORSPACES_LUT3D_INPUT_RGB) return sqrtf(v);
+  return c == 0 ? v * (1.0f / 100.0f) : (v + 128.0f) * (1.0f / 256.0f);
+}
+
+static inline float _lut3d_from_grid(const dt_colorspaces_lut3d_input_t input, const int c, const float t)
+{
+  if(input == DT_COLORSPACES_LUT3D_INPUT_RGB) return t * t;
+  return c == 0 ? t * 100.0f : t * 256.0f - 128.0f;
+}
+
+static inline int _lut3d_in_domain(const dt_colorspaces_lut3d_input_t input, const float *const in)
+{
+  // written so that nan fails as well
+  if(input == DT_COLORSPACES_LUT3D_INPUT_RGB)
+    return in[0] >= 0.0f && in[0] <= 1.0f && in[1] >= 0.0f && in[1] <= 1.0f && in[2] >= 0.0f && in[2] <= 1.0f;
+  return in[0] >= 0.0f && in[0] <= 100.0f && in[1] >= -128.0f && in[1] <= 128.0f && in[2] >= -128.0f
+         && in[2] <= 128.0f;
+}
+
+// tetrahedral interpolation, in has to be inside of the domain
+static inline void _lut3d_lookup(const dt_colorspaces_lut3d_t *const lut, const float *const in, float *const out)
+{
+  const int n = lut->size;
+  const int s[3] = { 4 * n * n, 4 * n, 4 };
+
+  int offset = 0;
+  float f[3];
+  for(int c = 0; c < 3; c++)
+  {
+    const float x = _lut3d_to_grid(lut->input, c, in[c]) * (n - 1);
+    const int i = MIN((int)x, n - 2);
+    f[c] = x - i;
+    offset += i * s[c];
+  }
+
+  // walk from the base node along the axes in order of decreasing fraction, that picks the tetrahedron
+  int a = 0, b = 1, d = 2;
+  if(f[a] < f[b]) { const int t = a; a = b; b = t; }
+  if(f[b] < f[d]) { const int t = b; b = d; d = t; }
+  if(f[a] < f[b]) { const int t = a; a = b; b = t; }
+
+  const float *const c0 = lut->table + offset;
+  const float *const c1 = c0 + s[a];
+  const float *const c2 = c1 + s[b];
+  const float *const c3 = c2 + s[d];
+  const float w0 = 1.0f - f[a], w1 = f[a] - f[b], w2 = f[b] - f[d], w3 = f[d];
+
+  float res[4];
+  for(int c = 0; c < 4; c++) res[c] = w0 * c0[c] + w1 * c1[c] + w2 * c2[c] + w3 * c3[c];
+  for(int c = 0; c < 3; c++) out[c] = res[c];
+}
+
+void dt_colorspaces_lut3d_transform(const dt_colorspaces_lut3d_t *lut, cmsHTRANSFORM xform, const float *in,
+                                    float *out, const size_t npixels)
+{
+  if(!lut || !lut->table)
+  {
+    cmsDoTransform(xform, in, out, npixels);
+    return;
+  }
+
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const px = in + 4 * k;
+    if(_lut3d_in_domain(lut->input, px))
+      _lut3d_lookup(lut, px, out + 4 * k);
+    else
+      cmsDoTransform(xform, px, out + 4 * k, 1);
+  }
+}
+
+static float *_lut3d_sample(cmsHTRANSFORM xform, const dt_colorspaces_lut3d_input_t input, const int n)
+{
+  float *table = dt_alloc_align(64, sizeof(float) * 4 * n * n * n);
+  if(!table) return NULL;
+
+  // one plane of the grid per lcms2 call
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(table, xform) schedule(static)
+#endif
+  for(int i = 0; i < n; i++)
+  {
+    float *plane = table + (size_t)4 * n * n * i;
+    for(int j = 0; j < n; j++)
+      for(int k = 0; k < n; k++)
+      {
+        float *node = plane + 4 * (n * j + k);
+        node[0] = _lut3d_from_grid(input, 0, i / (float)(n - 1));
+        node[1] = _lut3d_from_grid(input, 1, j / (float)(n - 1));
+        node[2] = _lut3d_from_grid(input, 2, k / (float)(n - 1));
+        node[3] = 0.0f;
+      }
+    cmsDoTransform(xform, plane, plane, n * n);
+  }
+  return table;
+}
+
+// compares the table with lcms2 on random colors, spread evenly over the grid
+static void _lut3d_check(dt_colorspaces_lut3d_t *lut, cmsHTRANSFORM xform, const float *probes, cmsHTRANSFORM to_lab)
+{
+  const size_t bytes = sizeof(float) * 4 * DT_COLORSPACES_LUT3D_PROBES;
+  float *ref = dt_alloc_align(64, bytes);
+  float *res = dt_alloc_align(64, bytes);
+
+  cmsDoTransform(xform, probes, ref, DT_COLORSPACES_LUT3D_PROBES);
+  for(int k = 0; k < DT_COLORSPACES_LUT3D_PROBES; k++) _lut3d_lookup(lut, probes + 4 * k, res + 4 * k);
+
+  // rgb results are compared in Lab
+  if(to_lab)
+  {
+    cmsDoTransform(to_lab, ref, ref, DT_COLORSPACES_LUT3D_PROBES);
+    cmsDoTransform(to_lab, res, res, DT_COLORSPACES_LUT3D_PROBES);
+  }
+
+  double sum = 0.0;
+  lut->max_de = 0.0f;
+  for(int k = 0; k < DT_COLORSPACES_LUT3D_PROBES; k++)
+  {
+    const float dL = ref[4 * k] - res[4 * k], da = ref[4 * k + 1] - res[4 * k + 1],
+                db = ref[4 * k + 2] - res[4 * k + 2];
+    const float de = sqrtf(dL * dL + da * da + db * db);
+    lut->max_de = isnan(de) ? INFINITY : MAX(lut->max_de, de);
+    sum += de;
+  }
+  lut->mean_de = sum / DT_COLORSPACES_LUT3D_PROBES;
+
+  dt_free_align(ref);
+  dt_free_align(res);
+}
+
+dt_colorspaces_lut3d_t *dt_colorspaces_lut3d_new(cmsHTRANSFORM xform, const dt_colorspaces_lut3d_input_t input,
+                                                 cmsHPROFILE output)
+{
+  if(!xform) return NULL;
+
+  const double start = dt_get_wtime();
+
+  cmsHTRANSFORM to_lab = NULL;
+  if(output)
+  {
+    cmsHPROFILE Lab = cmsCreateLab4Profile(NULL);
+    to_lab = cmsCreateTransform(output, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsCloseProfile(Lab);
+    if(!to_lab) return NULL;
+  }
+
+  // the probes are fixed, so the same transform always gets the same verdict
+  float *probes = dt_alloc_align(64, sizeof(float) * 4 * DT_COLORSPACES_LUT3D_PROBES);
+  uint32_t state = 0x12345678u;
+  for(int k = 0; k < DT_COLORSPACES_LUT3D_PROBES; k++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      state = state * 1664525u + 1013904223u;
+      probes[4 * k + c] = _lut3d_from_grid(input, c, (state >> 8) * (1.0f / 16777216.0f));
+    }
+    probes[4 * k + 3] = 0.0f;
+  }
+
+  dt_colorspaces_lut3d_t *lut = (dt_colorspaces_lut3d_t *)calloc(1, sizeof(dt_colorspaces_lut3d_t));
+  lut->input = input;
+  for(int s = 0; s < (int)(sizeof(_lut3d_sizes) / sizeof(_lut3d_sizes[0])); s++)
+  {
+    dt_free_align(lut->table);
+    lut->size = _lut3d_sizes[s];
+    lut->table = _lut3d_sample(xform, input, lut->size);
+    if(!lut->table) break;
+    _lut3d_check(lut, xform, probes, to_lab);
+    if(lut->max_de <= DT_COLORSPACES_LUT3D_MAX_DE) break;
+  }
+
+  dt_print(DT_DEBUG_PERF, "[lut3d] %d^3 table in %.3f s, delta E against lcms2: mean %.3f, max %.3f%s\n",
+           lut->size, dt_get_wtime() - start, lut->mean_de, lut->max_de,
+           lut->max_de <= DT_COLORSPACES_LUT3D_MAX_DE ? "" : ", using lcms2");
+
+  dt_free_align(probes);
+  if(to_lab) cmsDeleteTransform(to_lab);
+
+  if(!lut->table || !(lut->max_de <= DT_COLORSPACES_LUT3D_MAX_DE))
+  {
+    dt_colorspaces_lut3d_free(lut);
+    return NULL;
+  }
+  return lut;
+}
+
+void dt_colorspaces_lut3d_free(dt_colorspaces_lut3d_t *lut)
+{
+  if(!lut) return;
+  dt_free_align(lut->table);
+  free(lut);
+}
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  // bernstein hash (djb2), as for the pixelpipe cache
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static uint64_t _hash_profile(uint64_t hash, cmsHPROFILE profile)
+{
+  cmsUInt32Number size = 0;
+  if(!profile || !cmsSaveProfileToMem(profile, NULL, &size) || size == 0)
+    return _hash_bytes(hash, &size, sizeof(size));
+
+  char *data = malloc(size);
+  if(cmsSaveProfileToMem(profile, data, &size)) hash = _hash_bytes(hash, data, size);
+  free(data);
+  return hash;
+}
+
+uint64_t dt_colorspaces_lut3d_key(cmsHPROFILE input, cmsHPROFILE output, cmsHPROFILE proof, const int intent,
+                                  const uint32_t flags, const uint32_t input_format, const uint32_t output_format)
+{
+  uint64_t hash = 5381;
+  hash = _hash_profile(hash, input);
+  hash = _hash_profile(hash, output);
+  hash = _hash_profile(hash, proof);
+  hash = _hash_bytes(hash, &intent, sizeof(intent));
+  hash = _hash_bytes(hash, &flags, sizeof(flags));
+  hash = _hash_bytes(hash, &input_format, sizeof(input_format));
+  hash = _hash_bytes(hash, &output_format, sizeof(output_format));
+  return hash;
+}
+
+static void _cache_entry_free(gpointer data)
+{
+  dt_colorspaces_lut3d_free((dt_colorspaces_lut3d_t *)data);
+}
+
+static gboolean _cache_entry_unused(gpointer key, gpointer value, gpointer user_data)
+{
+  return ((dt_colorspaces_lut3d_t *)value)->refs == 0;
+}
+
+dt_colorspaces_lut3d_t *dt_colorspaces_lut3d_get(const uint64_t key, cmsHTRANSFORM xform,
+                                                 const dt_colorspaces_lut3d_input_t input, cmsHPROFILE output)
+{
+  if(!xform) return NULL;
+
+  // the table is built with the lock held, so pipes asking for the same transform wait for the first one
+  g_mutex_lock(&_cache_lock);
+  if(!_cache) _cache = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _cache_entry_free);
+
+  dt_colorspaces_lut3d_t *lut = g_hash_table_lookup(_cache, &key);
+  if(!lut)
+  {
+    if(g_hash_table_size(_cache) >= DT_COLORSPACES_LUT3D_CACHE_SIZE)
+      g_hash_table_foreach_remove(_cache, _cache_entry_unused, NULL);
+
+    lut = dt_colorspaces_lut3d_new(xform, input, output);
+    if(!lut)
+    {
+      // remember that this transform has to go through lcms2
+      lut = (dt_colorspaces_lut3d_t *)calloc(1, sizeof(dt_colorspaces_lut3d_t));
+      lut->input = input;
+    }
+    lut->key = key;
+    g_hash_table_insert(_cache, &lut->key, lut);
+  }
+
+  if(lut->table) lut->refs++;
+  g_mutex_unlock(&_cache_lock);
+  return lut->table ? lut : NULL;
+}
+
+void dt_colorspaces_lut3d_unref(dt_colorspaces_lut3d_t *lut)
+{
+  if(!lut) return;
+  g_mutex_lock(&_cache_lock);
+  lut->refs--;
+  g_mutex_unlock(&_cache_lock);
+}
+
+void dt_colorspaces_lut3d_cache_cleanup(void)
+{
+  g_mutex_lock(&_cache_lock);
+  if(_cache) g_hash_table_destroy(_cache);
+  _cache = NULL;
+  g_mutex_unlock(&_cache_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
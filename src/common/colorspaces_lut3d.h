@@ -0,0 +1,82 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <lcms2.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 3d lookup tables for lcms2 transforms.
+ *
+ * profiles which are not matrix/shaper (lut based printer and cmyk profiles, softproofing) can't take the fast
+ * matrix path of colorin and colorout. instead of running every pixel through cmsDoTransform the transform is
+ * sampled once on a grid and the pixels are interpolated tetrahedrally. a table is only used when it matches
+ * lcms2 within DT_COLORSPACES_LUT3D_MAX_DE on a set of probe colors, pixels outside of the grid still go
+ * through lcms2.
+ */
+
+// largest CIE76 delta E between the table and lcms2 we accept on the probe colors
+#define DT_COLORSPACES_LUT3D_MAX_DE 1.0f
+
+typedef enum dt_colorspaces_lut3d_input_t
+{
+  DT_COLORSPACES_LUT3D_INPUT_RGB = 0, // rgb or xyz in [0, 1], sampled with a square root shaper
+  DT_COLORSPACES_LUT3D_INPUT_LAB = 1  // L in [0, 100], a and b in [-128, 128]
+} dt_colorspaces_lut3d_input_t;
+
+typedef struct dt_colorspaces_lut3d_t
+{
+  uint64_t key;
+  int refs;
+  int size;     // grid points per axis
+  dt_colorspaces_lut3d_input_t input;
+  float *table; // size^3 nodes of 4 floats, red (or L) changing slowest
+  float max_de, mean_de;
+} dt_colorspaces_lut3d_t;
+
+/** samples the transform (4 floats per pixel in and out) and checks it against lcms2. output is the profile
+ * of the transform's rgb output to compute the delta E with, NULL if the transform outputs Lab. returns NULL if
+ * no table gets close enough. */
+dt_colorspaces_lut3d_t *dt_colorspaces_lut3d_new(cmsHTRANSFORM xform, const dt_colorspaces_lut3d_input_t input,
+                                                 cmsHPROFILE output);
+void dt_colorspaces_lut3d_free(dt_colorspaces_lut3d_t *lut);
+
+/** as above, but shared by all pipes through a cache, failures included. the key describes the transform, see
+ * dt_colorspaces_lut3d_key(). release the table with dt_colorspaces_lut3d_unref(). */
+dt_colorspaces_lut3d_t *dt_colorspaces_lut3d_get(const uint64_t key, cmsHTRANSFORM xform,
+                                                 const dt_colorspaces_lut3d_input_t input, cmsHPROFILE output);
+void dt_colorspaces_lut3d_unref(dt_colorspaces_lut3d_t *lut);
+
+/** hashes the profiles (NULL is fine) and the parameters of a transform into a cache key. */
+uint64_t dt_colorspaces_lut3d_key(cmsHPROFILE input, cmsHPROFILE output, cmsHPROFILE proof, const int intent,
+                                  const uint32_t flags, const uint32_t input_format, const uint32_t output_format);
+
+/** transforms npixels of 4 floats, through the table where possible and lcms2 otherwise. in and out may be
+ * the same buffer, alpha is not touched. lut may be NULL. */
+void dt_colorspaces_lut3d_transform(const dt_colorspaces_lut3d_t *lut, cmsHTRANSFORM xform, const float *in,
+                                    float *out, const size_t npixels);
+
+/** drops the cached tables, on shutdown. */
+void dt_colorspaces_lut3d_cache_cleanup(void);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -40,6 +40,7 @@
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/cpuid.h"
+#include "common/file_buffer.h"
 #include "common/film.h"
 #include "common/grealpath.h"
 #include "common/image.h"
@@ -51,6 +52,7 @@
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/points.h"
+#include "common/profiling.h"
 #include "common/resource_limits.h"
 #include "common/undo.h"
 #include "control/conf.h"
@@ -135,6 +137,7 @@ static int usage(const char *argv0)
   printf("  --noiseprofiles <noiseprofiles json file>\n");
   printf("  -t <num openmp threads>\n");
   printf("  --tmpdir <tmp directory>\n");
+  printf("  --trace <trace file, chrome json or .csv>\n");
   printf("  --version\n");
 #ifdef _WIN32
   printf("\n");
@@ -296,15 +299,29 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+#ifdef DT_HAVE_TARGET_AVX2
+    darktable.codepath.AVX2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+    darktable.codepath.AVX512 = darktable.codepath.AVX2 && __builtin_cpu_supports("avx512f");
+#endif
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+#ifdef DT_HAVE_TARGET_AVX2
+    darktable.codepath.AVX2 = ((flags & (CPU_FLAG_AVX2)) && (flags & (CPU_FLAG_FMA)));
+    darktable.codepath.AVX512 = darktable.codepath.AVX2 && (flags & (CPU_FLAG_AVX512F));
+#endif
 #endif
   }
 
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  // the wider paths fall back to the sse2 ones for borders and tails, they can't go without them
+  if(!dt_conf_get_bool("codepaths/avx2") || !darktable.codepath.SSE2) darktable.codepath.AVX2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx512") || !darktable.codepath.AVX2) darktable.codepath.AVX512 = 0;
+
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] sse2: %d, avx2: %d, avx512: %d\n", darktable.codepath.SSE2,
+           darktable.codepath.AVX2, darktable.codepath.AVX512);
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -331,6 +348,14 @@ static void dt_codepaths_init()
   }
 }
 
+// prints how long a part of the startup took with -d perf, returns the start of the next one
+static double _init_phase(const char *phase, const double start)
+{
+  const double now = dt_get_wtime();
+  dt_print(DT_DEBUG_PERF, "[init] %s took %.3f s\n", phase, now - start);
+  return now;
+}
+
 int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load_data, lua_State *L)
 {
   double start_wtime = dt_get_wtime();
@@ -661,6 +686,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         }
         g_free(keyval);
       }
+      else if(!strcmp(argv[k], "--trace") && argc > k + 1)
+      {
+        dt_trace_init(argv[++k]);
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--noiseprofiles") && argc > k + 1)
       {
         noiseprofiles_from_command = argv[++k];
@@ -795,11 +826,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
   }
 
+  double phase = _init_phase("config and gtk", start_wtime);
+
   // detect cpu features and decide which codepaths to enable
   dt_codepaths_init();
 
   // get the list of color profiles
   darktable.color_profiles = dt_colorspaces_init();
+  phase = _init_phase("color profiles", phase);
 
   // initialize the database
   darktable.db = dt_database_init(dbfilename_from_command, load_data);
@@ -838,6 +872,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     return 1;
   }
 
+  phase = _init_phase("database", phase);
+
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
@@ -887,15 +923,18 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_set_signal_handlers();
 #endif
 
+  phase = _init_phase("control", phase);
+
   darktable.opencl = (dt_opencl_t *)calloc(1, sizeof(dt_opencl_t));
 #ifdef HAVE_OPENCL
   dt_opencl_init(darktable.opencl, exclude_opencl, print_statistics);
 #endif
+  phase = _init_phase("opencl", phase);
 
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
-  darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
+  dt_noiseprofile_init(noiseprofiles_from_command);
 
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
@@ -904,6 +943,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
+  phase = _init_phase("caches", phase);
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -917,6 +957,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   }
   else
     darktable.gui = NULL;
+  phase = _init_phase("gui", phase);
 
   darktable.view_manager = (dt_view_manager_t *)calloc(1, sizeof(dt_view_manager_t));
   dt_view_manager_init(darktable.view_manager);
@@ -926,6 +967,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.imageio = (dt_imageio_t *)calloc(1, sizeof(dt_imageio_t));
   dt_imageio_init(darktable.imageio);
+  phase = _init_phase("views and imageio", phase);
 
   // load iop order
   darktable.iop_order_list = dt_ioppr_get_iop_order_list(NULL);
@@ -935,6 +977,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_iop_load_modules_so();
   // check if all modules have a iop order assigned
   if(dt_ioppr_check_so_iop_order(darktable.iop, darktable.iop_order_list)) return 1;
+  phase = _init_phase("iop plugins", phase);
 
   if(init_gui)
   {
@@ -946,6 +989,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
     darktable.lib = (dt_lib_t *)calloc(1, sizeof(dt_lib_t));
     dt_lib_init(darktable.lib);
+    phase = _init_phase("lib plugins", phase);
 
     dt_gui_gtk_load_config();
 
@@ -970,6 +1014,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
     // initialize undo struct
     darktable.undo = dt_undo_init();
+    phase = _init_phase("gui config and keymap", phase);
   }
 
   if(darktable.unmuted & DT_DEBUG_MEMORY)
@@ -983,6 +1028,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 /* init lua last, since it's user made stuff it must be in the real environment */
 #ifdef USE_LUA
   dt_lua_init(darktable.lua_state.state, lua_command);
+  phase = _init_phase("lua", phase);
 #endif
 
   if(init_gui)
@@ -1028,7 +1074,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     dt_control_crawler_show_image_list(changed_xmp_files);
   }
 
-  dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
+  dt_print(DT_DEBUG_CONTROL | DT_DEBUG_PERF, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
 
   return 0;
 }
@@ -1113,6 +1159,9 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
 
   dt_exif_cleanup();
+  dt_file_buffer_cleanup();
+
+  dt_trace_cleanup();
 }
 
 void dt_print(dt_debug_thread_t thread, const char *msg, ...)
@@ -187,9 +187,19 @@ typedef enum dt_debug_thread_t
   DT_DEBUG_CAMERA_SUPPORT = 1 << 16,
 } dt_debug_thread_t;
 
+// the wider vector extensions are not part of the baseline we compile for. code using them lives in
+// functions carrying one of these target attributes and must only be reached through darktable.codepath.
+#if(defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (__GNUC__ >= 5))
+#define DT_HAVE_TARGET_AVX2 1
+#define DT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define DT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int AVX2 : 1;   // implies FMA
+  unsigned int AVX512 : 1; // AVX512F, implies AVX2
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -58,6 +58,7 @@ extern "C" {
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/file_buffer.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
@@ -88,6 +89,26 @@ public:
 
 static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos);
 
+// opens the image from the shared file buffer when possible, so exiv2 and rawspeed read the file only once.
+// the buffer has to be released after the image is gone.
+static std::unique_ptr<Exiv2::Image> _exif_open(const char *path, dt_file_buffer_t **buffer)
+{
+  *buffer = dt_file_buffer_get(path);
+  if(!*buffer) return std::unique_ptr<Exiv2::Image>(Exiv2::ImageFactory::open(WIDEN(path)));
+
+  try
+  {
+    return std::unique_ptr<Exiv2::Image>(
+        Exiv2::ImageFactory::open((const Exiv2::byte *)(*buffer)->data, (long)(*buffer)->size));
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    dt_file_buffer_release(*buffer);
+    *buffer = NULL;
+    throw;
+  }
+}
+
 // this array should contain all XmpBag and XmpSeq keys used by dt
 const char *dt_xmp_keys[]
     = { "Xmp.dc.subject", "Xmp.lr.hierarchicalSubject", "Xmp.darktable.colorlabels", "Xmp.darktable.history",
@@ -983,11 +1004,12 @@ int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size)
 /**
  * Get the largest possible thumbnail from the image
  */
-int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type)
+static int _exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type,
+                               dt_file_buffer_t **file)
 {
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    std::unique_ptr<Exiv2::Image> image(_exif_open(path, file));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
 
@@ -1031,26 +1053,93 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
-/** read the metadata of an image.
- * XMP data trumps IPTC data trumps EXIF data
- */
-int dt_exif_read(dt_image_t *img, const char *path)
+int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type)
 {
-  // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
-  // ...)
-  struct stat statbuf;
+  dt_file_buffer_t *file = NULL;
+  const int res = _exif_get_thumbnail(path, buffer, size, mime_type, &file);
+  dt_file_buffer_release(file);
+  return res;
+}
+
+struct dt_exif_parsed_t
+{
+  std::string path;
+  dt_file_buffer_t *buffer;            // the bytes image is reading from, if the file could be mapped
+  std::unique_ptr<Exiv2::Image> image; // empty if exiv2 couldn't read the file
+  char datetime_taken[20];             // modification time of the file, empty if it couldn't be stat'ed
+
+  ~dt_exif_parsed_t()
+  {
+    image.reset();
+    dt_file_buffer_release(buffer);
+  }
+};
 
+static dt_exif_parsed_t *_exif_parse(const char *path, const bool sidecar)
+{
+  dt_exif_parsed_t *parsed = new dt_exif_parsed_t;
+  parsed->path = path;
+  parsed->buffer = NULL;
+  parsed->datetime_taken[0] = '\0';
+
+  struct stat statbuf;
   if(!stat(path, &statbuf))
   {
     struct tm result;
-    strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
+    strftime(parsed->datetime_taken, sizeof(parsed->datetime_taken), "%Y:%m:%d %H:%M:%S",
+             localtime_r(&statbuf.st_mtime, &result));
   }
 
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
-    assert(image.get() != 0);
-    read_metadata_threadsafe(image);
+    // sidecars are small, only the images themselves go through the shared buffers
+    if(sidecar)
+      parsed->image = std::unique_ptr<Exiv2::Image>(Exiv2::ImageFactory::open(WIDEN(path)));
+    else
+      parsed->image = _exif_open(path, &parsed->buffer);
+    assert(parsed->image.get() != 0);
+    read_metadata_threadsafe(parsed->image);
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    // a missing sidecar is nothing to complain about, a corrupt one is
+    if(!sidecar || g_file_test(path, G_FILE_TEST_EXISTS))
+    {
+      std::string s(e.what());
+      std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    }
+    parsed->image.reset();
+  }
+  return parsed;
+}
+
+dt_exif_parsed_t *dt_exif_parse(const char *path)
+{
+  return _exif_parse(path, false);
+}
+
+dt_exif_parsed_t *dt_exif_parse_xmp(const char *filename)
+{
+  return _exif_parse(filename, true);
+}
+
+void dt_exif_parsed_free(dt_exif_parsed_t *parsed)
+{
+  delete parsed;
+}
+
+int dt_exif_read_parsed(dt_image_t *img, dt_exif_parsed_t *parsed)
+{
+  // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
+  // ...)
+  if(parsed->datetime_taken[0])
+    g_strlcpy(img->exif_datetime_taken, parsed->datetime_taken, sizeof(img->exif_datetime_taken));
+
+  if(!parsed->image) return 1;
+
+  try
+  {
+    Exiv2::Image *image = parsed->image.get();
     bool res = true;
 
     // EXIF metadata
@@ -1082,11 +1171,22 @@ int dt_exif_read(dt_image_t *img, const char *path)
   catch(Exiv2::AnyError &e)
   {
     std::string s(e.what());
-    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    std::cerr << "[exiv2] " << parsed->path << ": " << s << std::endl;
     return 1;
   }
 }
 
+/** read the metadata of an image.
+ * XMP data trumps IPTC data trumps EXIF data
+ */
+int dt_exif_read(dt_image_t *img, const char *path)
+{
+  dt_exif_parsed_t *parsed = dt_exif_parse(path);
+  const int res = dt_exif_read_parsed(img, parsed);
+  dt_exif_parsed_free(parsed);
+  return res;
+}
+
 int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int compressed)
 {
   try
@@ -2332,12 +2432,21 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
   // exclude pfm to avoid stupid errors on the console
   const char *c = filename + strlen(filename) - 4;
   if(c >= filename && !strcmp(c, ".pfm")) return 1;
+
+  // read xmp sidecar
+  dt_exif_parsed_t *parsed = dt_exif_parse_xmp(filename);
+  const int res = dt_exif_xmp_read_parsed(img, parsed, history_only);
+  dt_exif_parsed_free(parsed);
+  return res;
+}
+
+int dt_exif_xmp_read_parsed(dt_image_t *img, dt_exif_parsed_t *parsed, const int history_only)
+{
+  if(!parsed->image) return 1;
+  const char *filename = parsed->path.c_str();
   try
   {
-    // read xmp sidecar
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(filename)));
-    assert(image.get() != 0);
-    read_metadata_threadsafe(image);
+    Exiv2::Image *image = parsed->image.get();
     Exiv2::XmpData &xmpData = image->xmpData();
 
     sqlite3_stmt *stmt;
@@ -2413,7 +2522,8 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     // now add all masks that are not used for cloning. keeping them might be useful.
     // TODO: make this configurable? or remove it altogether?
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    // savepoints instead of transactions, the caller might have one open already (batched imports)
+    sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT xmp_read_masks", NULL, NULL, NULL);
     if(version < 3)
     {
     g_hash_table_foreach(mask_entries, add_non_clone_mask_entries_to_db, &img->id);
@@ -2430,7 +2540,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
         m_entries = g_list_next(m_entries);
       }
     }
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    sqlite3_exec(dt_database_get(darktable.db), "RELEASE xmp_read_masks", NULL, NULL, NULL);
 
     // history
     int num = 0;
@@ -2453,7 +2563,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT xmp_read_history", NULL, NULL, NULL);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                                 &stmt, NULL);
@@ -2639,12 +2749,13 @@ end:
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      sqlite3_exec(dt_database_get(darktable.db), "RELEASE xmp_read_history", NULL, NULL, NULL);
     }
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TO xmp_read_history", NULL, NULL, NULL);
+      sqlite3_exec(dt_database_get(darktable.db), "RELEASE xmp_read_history", NULL, NULL, NULL);
       return 1;
     }
 
@@ -30,6 +30,22 @@ extern "C" {
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** metadata of a file, parsed but not yet applied to an image. */
+typedef struct dt_exif_parsed_t dt_exif_parsed_t;
+
+/** parse the metadata of a file. doesn't touch the database or the image cache, so imports can do this for
+ * several files in parallel and apply the results later on. never returns NULL, free with
+ * dt_exif_parsed_free(). */
+dt_exif_parsed_t *dt_exif_parse(const char *path);
+
+/** same for an xmp sidecar file, which quietly might not be there. */
+dt_exif_parsed_t *dt_exif_parse_xmp(const char *filename);
+
+void dt_exif_parsed_free(dt_exif_parsed_t *parsed);
+
+/** dt_exif_read() with the metadata from dt_exif_parse(). */
+int dt_exif_read_parsed(dt_image_t *img, dt_exif_parsed_t *parsed);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -53,6 +69,9 @@ char *dt_exif_xmp_read_string(const int imgid);
 /** read xmp sidecar file. */
 int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only);
 
+/** dt_exif_xmp_read() with the sidecar from dt_exif_parse_xmp(). */
+int dt_exif_xmp_read_parsed(dt_image_t *img, dt_exif_parsed_t *parsed, const int history_only);
+
 /** fetch largest exif thumbnail jpg bytestream into buffer*/
 int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type);
 
@@ -0,0 +1,130 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/file_buffer.h"
+#include "common/darktable.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+// released files which stay mapped. on windows a mapped file can't be deleted or renamed, so nothing stays.
+#ifdef _WIN32
+#define DT_FILE_BUFFER_KEEP 0
+#else
+#define DT_FILE_BUFFER_KEEP 4
+#endif
+
+static GMutex _lock;
+static GList *_buffers = NULL; // most recently used first
+
+static void _free(dt_file_buffer_t *b)
+{
+  g_mapped_file_unref(b->map);
+  g_free(b->filename);
+  g_free(b);
+}
+
+// drops unused buffers beyond the ones we keep around. called with the lock held.
+static void _trim(const int keep)
+{
+  int unused = 0;
+  GList *l = _buffers;
+  while(l)
+  {
+    GList *next = g_list_next(l);
+    dt_file_buffer_t *b = (dt_file_buffer_t *)l->data;
+    if(b->refs == 0 && ++unused > keep)
+    {
+      _buffers = g_list_delete_link(_buffers, l);
+      _free(b);
+    }
+    l = next;
+  }
+}
+
+dt_file_buffer_t *dt_file_buffer_get(const char *filename)
+{
+  GStatBuf statbuf;
+  if(g_stat(filename, &statbuf) || !S_ISREG(statbuf.st_mode) || statbuf.st_size == 0) return NULL;
+
+  g_mutex_lock(&_lock);
+  for(GList *l = _buffers; l; l = g_list_next(l))
+  {
+    dt_file_buffer_t *b = (dt_file_buffer_t *)l->data;
+    // the file might have been replaced since it was mapped
+    if(!strcmp(b->filename, filename) && b->mtime == (int64_t)statbuf.st_mtime
+       && b->size == (size_t)statbuf.st_size)
+    {
+      b->refs++;
+      _buffers = g_list_remove_link(_buffers, l);
+      _buffers = g_list_concat(l, _buffers);
+      g_mutex_unlock(&_lock);
+      return b;
+    }
+  }
+  g_mutex_unlock(&_lock);
+
+  // map outside the lock, other files shouldn't have to wait for a slow disk
+  GError *error = NULL;
+  GMappedFile *map = g_mapped_file_new(filename, FALSE, &error);
+  if(!map)
+  {
+    dt_print(DT_DEBUG_CACHE, "[file_buffer] can't map `%s': %s\n", filename, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  dt_file_buffer_t *b = (dt_file_buffer_t *)g_malloc0(sizeof(dt_file_buffer_t));
+  b->map = map;
+  b->data = (const uint8_t *)g_mapped_file_get_contents(map);
+  b->size = g_mapped_file_get_length(map);
+  b->filename = g_strdup(filename);
+  b->mtime = statbuf.st_mtime;
+  b->refs = 1;
+
+  if(!b->data)
+  {
+    _free(b);
+    return NULL;
+  }
+
+  g_mutex_lock(&_lock);
+  _buffers = g_list_prepend(_buffers, b);
+  g_mutex_unlock(&_lock);
+  return b;
+}
+
+void dt_file_buffer_release(dt_file_buffer_t *buffer)
+{
+  if(!buffer) return;
+  g_mutex_lock(&_lock);
+  buffer->refs--;
+  _trim(DT_FILE_BUFFER_KEEP);
+  g_mutex_unlock(&_lock);
+}
+
+void dt_file_buffer_cleanup(void)
+{
+  g_mutex_lock(&_lock);
+  _trim(0);
+  g_mutex_unlock(&_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
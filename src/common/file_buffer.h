@@ -0,0 +1,60 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * read only, memory mapped view of an image file, shared by everyone reading that file.
+ *
+ * exiv2, rawspeed and the embedded thumbnail extraction all get their bytes from here, so a raw which gets its
+ * metadata read and is then decoded is opened and read once only. that matters a lot on network file systems.
+ * the last few released files stay mapped, as the next reader is usually not far behind.
+ */
+typedef struct dt_file_buffer_t
+{
+  const uint8_t *data;
+  size_t size;
+
+  // private
+  char *filename;
+  GMappedFile *map;
+  int64_t mtime;
+  int refs;
+} dt_file_buffer_t;
+
+/** maps the file, or finds it mapped already. NULL if it can't be mapped, read it the usual way then. */
+dt_file_buffer_t *dt_file_buffer_get(const char *filename);
+void dt_file_buffer_release(dt_file_buffer_t *buffer);
+
+/** unmaps the files nobody holds anymore. */
+void dt_file_buffer_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
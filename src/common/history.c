@@ -34,6 +34,13 @@
 #include "develop/blend.h"
 #include "develop/masks.h"
 
+// develop contexts which may be built ahead of the writer, each holds all the modules of one image
+#define DT_HISTORY_BATCH_WINDOW 32
+// images written to the database in one transaction
+#define DT_HISTORY_BATCH_SIZE 64
+// the workers share the database connection with the writer, more than that doesn't help
+#define DT_HISTORY_BATCH_MAX_WORKERS 8
+
 void dt_history_item_free(gpointer data)
 {
   dt_history_item_t *item = (dt_history_item_t *)data;
@@ -86,6 +93,7 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
   sqlite3_finalize(stmt);
 
   remove_preset_flag(imgid);
+  dt_collection_image_changed();
 
   /* if current image in develop reload history */
   if(dt_dev_is_current_image(darktable.develop, imgid)) dt_dev_reload_history_items(darktable.develop);
@@ -524,34 +532,21 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops)
+// loads the history of imgid into a fresh headless develop context
+static void _history_dev_load(dt_develop_t *dev, const int32_t imgid)
 {
-  GList *modules_used = NULL;
-
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
-
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
-
-  // we will do the copy/paste on memory so we can deal with masks
-  dt_dev_init(dev_src, FALSE);
-  dt_dev_init(dev_dest, FALSE);
-
-  dev_src->iop = dt_iop_load_modules_ext(dev_src, TRUE);
-  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
-
-  dt_dev_read_history_ext(dev_src, imgid, TRUE);
-  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge ");
-  dt_ioppr_check_iop_order(dev_dest, imgid, "_history_copy_and_paste_on_image_merge ");
-
-  dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
-  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+  dt_dev_init(dev, FALSE);
+  dev->iop = dt_iop_load_modules_ext(dev, TRUE);
+  dt_dev_read_history_ext(dev, imgid, TRUE);
+  dt_ioppr_check_iop_order(dev, imgid, "_history_dev_load ");
+  dt_dev_pop_history_items_ext(dev, dev->history_end);
+  dt_ioppr_check_iop_order(dev, imgid, "_history_dev_load 1");
+}
 
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
-  dt_ioppr_check_iop_order(dev_dest, imgid, "_history_copy_and_paste_on_image_merge 1");
+// merges the history of dev_src, or only the entries in ops, into dev_dest
+static void _history_merge(dt_develop_t *dev_dest, dt_develop_t *dev_src, GList *ops)
+{
+  GList *modules_used = NULL;
 
   // the user have selected some history entries
   if(ops)
@@ -592,8 +587,25 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
     }
   }
 
+  g_list_free(modules_used);
+}
+
+static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops)
+{
+  dt_develop_t _dev_src = { 0 };
+  dt_develop_t _dev_dest = { 0 };
+
+  dt_develop_t *dev_src = &_dev_src;
+  dt_develop_t *dev_dest = &_dev_dest;
+
+  // we will do the copy/paste on memory so we can deal with masks
+  _history_dev_load(dev_src, imgid);
+  _history_dev_load(dev_dest, dest_imgid);
+
+  _history_merge(dev_dest, dev_src, ops);
+
   dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 2");
-  dt_ioppr_check_iop_order(dev_dest, imgid, "_history_copy_and_paste_on_image_merge 2");
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 2");
 
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
@@ -601,17 +613,14 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   dt_dev_cleanup(dev_src);
   dt_dev_cleanup(dev_dest);
 
-  g_list_free(modules_used);
-
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops)
+// removes the history of dest_imgid. with copy it is replaced by the one of imgid, straight in the database.
+static void _history_overwrite(int32_t imgid, int32_t dest_imgid, gboolean copy)
 {
-  int ret_val = 0;
   sqlite3_stmt *stmt;
 
-  // replace history stack
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                               &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, dest_imgid);
@@ -633,7 +642,7 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
   sqlite3_finalize(stmt);
 
   // the user wants an exact duplicate of the history, so just copy the db
-  if(!ops)
+  if(copy)
   {
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                 "INSERT INTO main.history "
@@ -684,13 +693,19 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
-  else
-  {
-    // since the history and masks where deleted we can do a merge
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
-  }
 
-  return ret_val;
+  dt_collection_image_changed();
+}
+
+static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops)
+{
+  // replace history stack
+  _history_overwrite(imgid, dest_imgid, ops == NULL);
+
+  // since the history and masks where deleted we can do a merge
+  if(ops) return _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+
+  return 0;
 }
 
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
@@ -748,6 +763,250 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   return ret_val;
 }
 
+typedef struct dt_history_batch_slot_t
+{
+  int32_t imgid;
+  dt_develop_t *dev; // NULL if there is nothing to write
+  gboolean ready;
+} dt_history_batch_slot_t;
+
+/* the develop contexts are built by a couple of worker threads (loading the modules and the history, merging
+ * the new items) while the calling thread writes them to the database in selection order. */
+typedef struct dt_history_batch_queue_t
+{
+  GMutex lock;
+  GCond cond;
+  const dt_history_batch_t *batch;
+  dt_history_batch_slot_t *slots;
+  guint total;
+  guint next;      // next image to build
+  guint committed; // images the writer is done with
+} dt_history_batch_queue_t;
+
+static dt_develop_t *_history_batch_build(const dt_history_batch_t *batch, const int32_t imgid, void *worker_data)
+{
+  dt_develop_t *dev = (dt_develop_t *)calloc(1, sizeof(dt_develop_t));
+  _history_dev_load(dev, imgid);
+  if(!batch->apply(dev, imgid, worker_data, batch->user_data))
+  {
+    dt_dev_cleanup(dev);
+    free(dev);
+    return NULL;
+  }
+  return dev;
+}
+
+static void *_history_batch_worker(void *data)
+{
+  dt_history_batch_queue_t *q = (dt_history_batch_queue_t *)data;
+  const dt_history_batch_t *batch = q->batch;
+  dt_pthread_setname("history");
+
+  void *worker_data = batch->worker_init ? batch->worker_init(batch->user_data) : NULL;
+
+  g_mutex_lock(&q->lock);
+  while(q->next < q->total)
+  {
+    if(q->next >= q->committed + DT_HISTORY_BATCH_WINDOW)
+    {
+      g_cond_wait(&q->cond, &q->lock);
+      continue;
+    }
+    const guint k = q->next++;
+    g_mutex_unlock(&q->lock);
+
+    dt_develop_t *dev = _history_batch_build(batch, q->slots[k].imgid, worker_data);
+
+    g_mutex_lock(&q->lock);
+    q->slots[k].dev = dev;
+    q->slots[k].ready = TRUE;
+    g_cond_broadcast(&q->cond);
+  }
+  g_mutex_unlock(&q->lock);
+
+  if(batch->worker_cleanup) batch->worker_cleanup(worker_data);
+  return NULL;
+}
+
+// waits for image k to be built, or builds it right here if no worker took it yet
+static dt_develop_t *_history_batch_get(dt_history_batch_queue_t *q, const guint k, void **worker_data)
+{
+  const dt_history_batch_t *batch = q->batch;
+  g_mutex_lock(&q->lock);
+  if(q->next == k)
+  {
+    q->next++;
+    g_mutex_unlock(&q->lock);
+    if(!*worker_data && batch->worker_init) *worker_data = batch->worker_init(batch->user_data);
+    return _history_batch_build(batch, q->slots[k].imgid, *worker_data);
+  }
+  while(!q->slots[k].ready) g_cond_wait(&q->cond, &q->lock);
+  dt_develop_t *dev = q->slots[k].dev;
+  q->slots[k].dev = NULL;
+  g_mutex_unlock(&q->lock);
+  return dev;
+}
+
+static gboolean _history_batch_is_ready(dt_history_batch_queue_t *q, const guint k)
+{
+  g_mutex_lock(&q->lock);
+  const gboolean ready = k >= q->total || q->slots[k].ready;
+  g_mutex_unlock(&q->lock);
+  return ready;
+}
+
+static void _history_batch_done(dt_history_batch_queue_t *q, const guint k)
+{
+  g_mutex_lock(&q->lock);
+  q->committed = k + 1;
+  g_cond_broadcast(&q->cond);
+  g_mutex_unlock(&q->lock);
+}
+
+int dt_history_batch_run(const dt_history_batch_t *batch, GList *imgs)
+{
+  const guint total = g_list_length(imgs);
+  if(total == 0) return 1;
+
+  const double start = dt_get_wtime();
+
+  // be sure the current history is written before changing it
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+
+  /* attach changed tag reflecting actual change, once for all images */
+  guint tagid = 0;
+  dt_tag_new("darktable|changed", &tagid);
+  dt_tag_attach_images(tagid, imgs);
+
+  dt_history_batch_queue_t q = { 0 };
+  g_mutex_init(&q.lock);
+  g_cond_init(&q.cond);
+  q.batch = batch;
+  q.total = total;
+  q.slots = (dt_history_batch_slot_t *)calloc(total, sizeof(dt_history_batch_slot_t));
+  dt_undo_lt_history_t **hists = (dt_undo_lt_history_t **)calloc(total, sizeof(dt_undo_lt_history_t *));
+
+  // the before snapshots and the plain database changes go in one transaction, before any context is built
+  gboolean in_darkroom_image = FALSE;
+  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  {
+    guint k = 0;
+    for(GList *l = g_list_first(imgs); l; l = g_list_next(l), k++)
+    {
+      const int32_t imgid = GPOINTER_TO_INT(l->data);
+      q.slots[k].imgid = imgid;
+      hists[k] = dt_history_snapshot_item_init();
+      hists[k]->imgid = imgid;
+      dt_history_snapshot_undo_create(imgid, &hists[k]->before, &hists[k]->before_history_end);
+      if(batch->prepare) batch->prepare(imgid, batch->user_data);
+      if(dt_dev_is_current_image(darktable.develop, imgid)) in_darkroom_image = TRUE;
+    }
+  }
+  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+  // without apply the prepare step did everything, there is nothing to build
+  int started = 0;
+  pthread_t *workers = NULL;
+  if(batch->apply)
+  {
+    const int num_workers = total < 2 ? 0 : MIN(MIN(dt_get_num_threads(), DT_HISTORY_BATCH_MAX_WORKERS), (int)total);
+    workers = (pthread_t *)calloc(MAX(num_workers, 1), sizeof(pthread_t));
+    for(int k = 0; k < num_workers; k++)
+    {
+      if(dt_pthread_create(&workers[k], _history_batch_worker, &q)) break;
+      started++;
+    }
+    // without workers the loop below builds the contexts itself
+  }
+
+  const gboolean aspect_ratio = darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO;
+  void *worker_data = NULL;
+  double time_waiting = 0.0;
+  guint in_transaction = 0;
+
+  for(guint k = 0; k < total; k++)
+  {
+    const int32_t imgid = q.slots[k].imgid;
+
+    if(batch->apply)
+    {
+      // don't keep the transaction open while waiting for the workers
+      if(in_transaction && !_history_batch_is_ready(&q, k))
+      {
+        sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+        in_transaction = 0;
+      }
+
+      const double wait_start = dt_get_wtime();
+      dt_develop_t *dev = _history_batch_get(&q, k, &worker_data);
+      time_waiting += dt_get_wtime() - wait_start;
+
+      if(!in_transaction) sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+      if(dev)
+      {
+        // write history and forms to db
+        dt_dev_write_history_ext(dev, imgid);
+        dt_dev_cleanup(dev);
+        free(dev);
+      }
+    }
+    else if(!in_transaction)
+      sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    dt_undo_lt_history_t *hist = hists[k];
+    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t *)hist,
+                   &dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+
+    /* update xmp file */
+    dt_image_synch_xmp(imgid);
+
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+
+    /* update the aspect ratio if the current sorting is based on aspect ratio, otherwise the aspect ratio will
+       be recalculated when the mimpap will be recreated */
+    if(aspect_ratio) dt_image_set_aspect_ratio(imgid);
+
+    if(++in_transaction >= DT_HISTORY_BATCH_SIZE)
+    {
+      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      in_transaction = 0;
+    }
+    _history_batch_done(&q, k);
+  }
+  if(in_transaction) sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+  for(int k = 0; k < started; k++) pthread_join(workers[k], NULL);
+  if(worker_data && batch->worker_cleanup) batch->worker_cleanup(worker_data);
+  free(workers);
+  free(hists);
+  free(q.slots);
+  g_cond_clear(&q.cond);
+  g_mutex_clear(&q.lock);
+
+  /* if current image in develop reload history */
+  if(in_darkroom_image)
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+  }
+
+  dt_undo_end_group(darktable.undo);
+
+  const double seconds = MAX(dt_get_wtime() - start, 1e-6);
+  dt_print(DT_DEBUG_PERF,
+           "[history_batch] %u images in %.2f s (%.1f images/s) with %d worker threads, "
+           "writer waited %.2f s for the workers\n",
+           total, seconds, total / seconds, started, time_waiting);
+
+  dt_control_queue_redraw_center();
+
+  return 0;
+}
+
 GList *dt_history_get_items(int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -832,33 +1091,66 @@ char *dt_history_get_items_as_string(int32_t imgid)
   return result;
 }
 
+typedef struct dt_history_paste_t
+{
+  int32_t imgid;
+  gboolean merge;
+  GList *ops;
+} dt_history_paste_t;
+
+// every worker loads the source history once and merges it into all the images it builds
+static void *_history_paste_worker_init(void *user_data)
+{
+  dt_history_paste_t *paste = (dt_history_paste_t *)user_data;
+  dt_develop_t *dev_src = (dt_develop_t *)calloc(1, sizeof(dt_develop_t));
+  _history_dev_load(dev_src, paste->imgid);
+  return dev_src;
+}
+
+static void _history_paste_worker_cleanup(void *worker_data)
+{
+  dt_develop_t *dev_src = (dt_develop_t *)worker_data;
+  dt_dev_cleanup(dev_src);
+  free(dev_src);
+}
+
+static void _history_paste_prepare(const int32_t imgid, void *user_data)
+{
+  dt_history_paste_t *paste = (dt_history_paste_t *)user_data;
+  // replace history stack, an exact duplicate is just a copy in the database
+  if(!paste->merge) _history_overwrite(paste->imgid, imgid, paste->ops == NULL);
+}
+
+static gboolean _history_paste_apply(dt_develop_t *dev, const int32_t imgid, void *worker_data, void *user_data)
+{
+  dt_history_paste_t *paste = (dt_history_paste_t *)user_data;
+  _history_merge(dev, (dt_develop_t *)worker_data, paste->ops);
+  return TRUE;
+}
+
 int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList *ops)
 {
   if(imgid < 0) return 1;
 
-  int res = 0;
+  GList *imgs = NULL;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT imgid FROM main.selected_images WHERE imgid != ?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    do
-    {
-      /* get imgid of selected image */
-      int32_t dest_imgid = sqlite3_column_int(stmt, 0);
-
-      /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid, dest_imgid, merge, ops);
-
-    } while(sqlite3_step(stmt) == SQLITE_ROW);
-    dt_undo_end_group(darktable.undo);
-  }
-  else
-    res = 1;
-
+  while(sqlite3_step(stmt) == SQLITE_ROW) imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
   sqlite3_finalize(stmt);
+  imgs = g_list_reverse(imgs);
+
+  if(!imgs) return 1;
+
+  dt_history_paste_t paste = { .imgid = imgid, .merge = merge, .ops = ops };
+  const dt_history_batch_t batch = { .worker_init = _history_paste_worker_init,
+                                     .worker_cleanup = _history_paste_worker_cleanup,
+                                     .prepare = _history_paste_prepare,
+                                     .apply = (!merge && !ops) ? NULL : _history_paste_apply,
+                                     .user_data = &paste };
+  const int res = dt_history_batch_run(&batch, imgs);
+  g_list_free(imgs);
   return res;
 }
 
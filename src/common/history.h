@@ -52,6 +52,23 @@ int dt_history_load_and_apply(int imgid, gchar *filename, int history_only);
 /** delete historystack of selected images */
 void dt_history_delete_on_selection();
 
+/** a batch changing the history of many images. the develop contexts are built by worker threads, which
+ * only read the database, and written back in list order by the calling thread. */
+typedef struct dt_history_batch_t
+{
+  /** per worker state, created and freed on the worker's thread (optional) */
+  void *(*worker_init)(void *user_data);
+  void (*worker_cleanup)(void *worker_data);
+  /** runs on the calling thread for every image, in one transaction, before any context is built (optional) */
+  void (*prepare)(const int32_t imgid, void *user_data);
+  /** changes the history loaded into dev, returns FALSE if there is nothing to write. NULL if prepare did it all */
+  gboolean (*apply)(struct dt_develop_t *dev, const int32_t imgid, void *worker_data, void *user_data);
+  void *user_data;
+} dt_history_batch_t;
+
+/** runs the batch on the list of image ids (GINT_TO_POINTER), with undo, tags, xmp and thumbnails updated */
+int dt_history_batch_run(const dt_history_batch_t *batch, GList *imgs);
+
 typedef struct dt_history_item_t
 {
   guint num;
@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "common/collection.h"
 #include "common/darktable.h"
 #include "common/history.h"
 #include "common/debug.h"
@@ -53,7 +54,8 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
     *snap_id = sqlite3_column_int(stmt, 0) + 1;
   sqlite3_finalize(stmt);
 
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  // a savepoint, so this nests into the transaction of a history batch
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT undo_snapshot", NULL, NULL, NULL);
 
   // copy current state into undo_history
 
@@ -63,7 +65,7 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
                               " FROM main.history WHERE imgid=?2", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, *snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   // copy current state into undo_masks_history
@@ -73,13 +75,11 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
                               "points, points_count, source FROM main.masks_history WHERE imgid=?2", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, *snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
-  if(all_ok)
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
-  else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+  if(!all_ok) sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TO undo_snapshot", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "RELEASE undo_snapshot", NULL, NULL, NULL);
 }
 
 static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int history_end)
@@ -100,7 +100,7 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               " FROM memory.undo_history WHERE imgid=?2 AND id=?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   // copy undo_masks_history snapshot back as current masks_history state
@@ -111,7 +111,7 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   // set history end
@@ -120,13 +120,15 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               "UPDATE main.images SET history_end=?2 WHERE id=?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, history_end);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   if(all_ok)
     sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
   else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+
+  dt_collection_image_changed();
 }
 
 static void _clear_undo_snapshot(int32_t imgid, int snap_id)
@@ -451,6 +451,7 @@ void dt_image_set_flip(const int32_t imgid, const dt_image_orientation_t orienta
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  dt_collection_image_changed();
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
   // write that through to xmp:
   dt_image_write_sidecar_file(imgid);
@@ -551,6 +552,8 @@ void dt_image_set_aspect_ratio_to(const int32_t imgid, double aspect_ratio)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
 
+    dt_collection_image_changed();
+
     if (darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
       dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
   }
@@ -771,6 +774,20 @@ void dt_image_remove(const int32_t imgid)
   dt_tag_update_used_tags();
 }
 
+int dt_image_history_op_alters(const char *op)
+{
+  // FIXME: this is clearly a terrible way to determine which modules
+  // are okay to still load the thumbnail and which aren't.
+  // it is also used to display the altered symbol on the thumbnails.
+  if(!op) return 0; // can happen while importing or something like that
+  if(!strcmp(op, "basecurve") && dt_conf_get_bool("plugins/darkroom/basecurve/auto_apply")) return 0;
+  if(!strcmp(op, "flip")) return 0;
+  if(!strcmp(op, "sharpen") && dt_conf_get_bool("plugins/darkroom/sharpen/auto_apply")) return 0;
+  if(!strcmp(op, "dither")) return 0;
+  if(!strcmp(op, "highlights")) return 0;
+  return 1;
+}
+
 int dt_image_altered(const uint32_t imgid)
 {
   int altered = 0;
@@ -782,18 +799,11 @@ int dt_image_altered(const uint32_t imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    const char *op = (const char *)sqlite3_column_text(stmt, 0);
-    // FIXME: this is clearly a terrible way to determine which modules
-    // are okay to still load the thumbnail and which aren't.
-    // it is also used to display the altered symbol on the thumbnails.
-    if(!op) continue; // can happen while importing or something like that
-    if(!strcmp(op, "basecurve") && dt_conf_get_bool("plugins/darkroom/basecurve/auto_apply")) continue;
-    if(!strcmp(op, "flip")) continue;
-    if(!strcmp(op, "sharpen") && dt_conf_get_bool("plugins/darkroom/sharpen/auto_apply")) continue;
-    if(!strcmp(op, "dither")) continue;
-    if(!strcmp(op, "highlights")) continue;
-    altered = 1;
-    break;
+    if(dt_image_history_op_alters((const char *)sqlite3_column_text(stmt, 0)))
+    {
+      altered = 1;
+      break;
+    }
   }
   sqlite3_finalize(stmt);
 
@@ -801,10 +811,9 @@ int dt_image_altered(const uint32_t imgid)
 }
 
 
-void dt_image_read_duplicates(const uint32_t id, const char *filename)
+// the sidecar files of all versions of the image, doesn't touch the database
+static GList *_image_find_duplicates(const char *filename)
 {
-  // Search for duplicate's sidecar files and import them if found and not in DB yet
-  gchar *imgfname = g_path_get_basename(filename);
   gchar *imgpath = g_path_get_dirname(filename);
   gchar pattern[PATH_MAX] = { 0 };
 
@@ -853,6 +862,15 @@ void dt_image_read_duplicates(const uint32_t id, const char *filename)
     glob_pattern++;
   }
 
+  g_free(imgpath);
+  return files;
+}
+
+// imports the sidecars found by _image_find_duplicates() and frees the list
+static void _image_read_duplicates(const uint32_t id, const char *filename, GList *files)
+{
+  gchar pattern[PATH_MAX] = { 0 };
+
   // we store the xmp filename without version part in pattern to speed up string comparison later
   g_snprintf(pattern, sizeof(pattern), "%s.xmp", filename);
 
@@ -895,18 +913,23 @@ void dt_image_read_duplicates(const uint32_t id, const char *filename)
   }
 
   g_list_free_full(files, g_free);
-  g_free(imgfname);
-  g_free(imgpath);
+}
+
+void dt_image_read_duplicates(const uint32_t id, const char *filename)
+{
+  // Search for duplicate's sidecar files and import them if found and not in DB yet
+  _image_read_duplicates(id, filename, _image_find_duplicates(filename));
 }
 
 
-static uint32_t dt_image_import_internal(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs, gboolean lua_locking)
+dt_image_import_prepared_t *dt_image_import_prepare(const char *filename, const gboolean override_ignore_jpegs,
+                                                    const gboolean read_metadata)
 {
   char *normalized_filename = dt_util_normalize_path(filename);
   if(!normalized_filename || !g_file_test(normalized_filename, G_FILE_TEST_IS_REGULAR) || dt_util_get_file_size(normalized_filename) == 0)
   {
     g_free(normalized_filename);
-    return 0;
+    return NULL;
   }
   const char *cc = normalized_filename + strlen(normalized_filename);
   for(; *cc != '.' && cc > normalized_filename; cc--)
@@ -914,7 +937,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   if(!strcasecmp(cc, ".dt") || !strcasecmp(cc, ".dttags") || !strcasecmp(cc, ".xmp"))
   {
     g_free(normalized_filename);
-    return 0;
+    return NULL;
   }
   char *ext = g_ascii_strdown(cc + 1, -1);
   if(override_ignore_jpegs == FALSE && (!strcmp(ext, "jpg") || !strcmp(ext, "jpeg"))
@@ -922,7 +945,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   {
     g_free(normalized_filename);
     g_free(ext);
-    return 0;
+    return NULL;
   }
   int supported = 0;
   for(const char **i = dt_supported_extensions; *i != NULL; i++)
@@ -935,8 +958,56 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   {
     g_free(normalized_filename);
     g_free(ext);
-    return 0;
+    return NULL;
+  }
+
+  dt_image_import_prepared_t *prepared = g_malloc0(sizeof(dt_image_import_prepared_t));
+  prepared->filename = normalized_filename;
+  prepared->ext = ext;
+
+  // set the bits in flags that indicate if any of the extra files (.txt, .wav) are present
+  char *extra_file = dt_image_get_audio_path_from_path(normalized_filename);
+  if(extra_file)
+  {
+    prepared->flags |= DT_IMAGE_HAS_WAV;
+    g_free(extra_file);
+  }
+  extra_file = dt_image_get_text_path_from_path(normalized_filename);
+  if(extra_file)
+  {
+    prepared->flags |= DT_IMAGE_HAS_TXT;
+    g_free(extra_file);
+  }
+
+  if(read_metadata)
+  {
+    prepared->metadata_read = TRUE;
+    prepared->exif = dt_exif_parse(normalized_filename);
+    gchar *xmpfilename = g_strconcat(normalized_filename, ".xmp", NULL);
+    if(g_file_test(xmpfilename, G_FILE_TEST_IS_REGULAR)) prepared->xmp = dt_exif_parse_xmp(xmpfilename);
+    g_free(xmpfilename);
+    prepared->duplicates = _image_find_duplicates(normalized_filename);
   }
+
+  return prepared;
+}
+
+void dt_image_import_prepared_free(dt_image_import_prepared_t *prepared)
+{
+  if(!prepared) return;
+  g_free(prepared->filename);
+  g_free(prepared->ext);
+  if(prepared->exif) dt_exif_parsed_free(prepared->exif);
+  if(prepared->xmp) dt_exif_parsed_free(prepared->xmp);
+  g_list_free_full(prepared->duplicates, g_free);
+  g_free(prepared);
+}
+
+static uint32_t _image_import_commit(const int32_t film_id, dt_image_import_prepared_t *prepared,
+                                     gboolean lua_locking)
+{
+  const char *normalized_filename = prepared->filename;
+  const char *ext = prepared->ext;
   int rc;
   uint32_t id = 0;
   // select from images; if found => return
@@ -955,10 +1026,11 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
     dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
     img->flags &= ~DT_IMAGE_REMOVE;
     dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
-    dt_image_read_duplicates(id, normalized_filename);
+    _image_read_duplicates(id, normalized_filename, prepared->metadata_read
+                                                        ? prepared->duplicates
+                                                        : _image_find_duplicates(normalized_filename));
+    prepared->duplicates = NULL;
     dt_image_synch_all_xmp(normalized_filename);
-    g_free(ext);
-    g_free(normalized_filename);
     return id;
   }
   sqlite3_finalize(stmt);
@@ -971,19 +1043,8 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
     dt_conf_set_int("ui_last/import_initial_rating", 1);
   }
   flags |= DT_IMAGE_NO_LEGACY_PRESETS;
-  // set the bits in flags that indicate if any of the extra files (.txt, .wav) are present
-  char *extra_file = dt_image_get_audio_path_from_path(normalized_filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_WAV;
-    g_free(extra_file);
-  }
-  extra_file = dt_image_get_text_path_from_path(normalized_filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_TXT;
-    g_free(extra_file);
-  }
+  // the extra files (.txt, .wav) were checked already
+  flags |= prepared->flags;
 
   // insert dummy image entry in database
 
@@ -1114,13 +1175,22 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void)dt_exif_read(img, normalized_filename);
-  char dtfilename[PATH_MAX] = { 0 };
-  g_strlcpy(dtfilename, normalized_filename, sizeof(dtfilename));
-  // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
-  g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
+  int res;
+  if(prepared->metadata_read)
+  {
+    (void)dt_exif_read_parsed(img, prepared->exif);
+    res = prepared->xmp ? dt_exif_xmp_read_parsed(img, prepared->xmp, 0) : 1;
+  }
+  else
+  {
+    (void)dt_exif_read(img, normalized_filename);
+    char dtfilename[PATH_MAX] = { 0 };
+    g_strlcpy(dtfilename, normalized_filename, sizeof(dtfilename));
+    // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
+    g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
 
-  int res = dt_exif_xmp_read(img, dtfilename, 0);
+    res = dt_exif_xmp_read(img, dtfilename, 0);
+  }
 
   // write through to db, but not to xmp.
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
@@ -1135,7 +1205,6 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   guint tagid = 0;
   char tagname[512];
   snprintf(tagname, sizeof(tagname), "darktable|format|%s", ext);
-  g_free(ext);
   dt_tag_new(tagname, &tagid);
   dt_tag_attach(tagid, id);
 
@@ -1143,13 +1212,15 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   dt_mipmap_cache_remove(darktable.mipmap_cache, id);
 
   // read all sidecar files
-  dt_image_read_duplicates(id, normalized_filename);
+  _image_read_duplicates(id, normalized_filename, prepared->metadata_read
+                                                      ? prepared->duplicates
+                                                      : _image_find_duplicates(normalized_filename));
+  prepared->duplicates = NULL;
   dt_image_synch_all_xmp(normalized_filename);
 
   g_free(imgfname);
   g_free(basename);
   g_free(sql_pattern);
-  g_free(normalized_filename);
 
 #ifdef USE_LUA
   //Synchronous calling of lua post-import-image events
@@ -1173,6 +1244,20 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   return id;
 }
 
+uint32_t dt_image_import_commit(const int32_t film_id, dt_image_import_prepared_t *prepared)
+{
+  return _image_import_commit(film_id, prepared, TRUE);
+}
+
+static uint32_t dt_image_import_internal(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs, gboolean lua_locking)
+{
+  dt_image_import_prepared_t *prepared = dt_image_import_prepare(filename, override_ignore_jpegs, FALSE);
+  if(!prepared) return 0;
+  const uint32_t id = _image_import_commit(film_id, prepared, lua_locking);
+  dt_image_import_prepared_free(prepared);
+  return id;
+}
+
 uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
 {
   return dt_image_import_internal(film_id, filename, override_ignore_jpegs, TRUE);
@@ -216,6 +216,27 @@ void dt_image_print_exif(const dt_image_t *img, char *line, size_t line_len);
 void dt_image_read_duplicates(uint32_t id, const char *filename);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. Use from threads other than lua.*/
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+
+/** everything of an import that only needs the file, gathered by dt_image_import_prepare(). */
+typedef struct dt_image_import_prepared_t
+{
+  char *filename;     // normalized full path
+  char *ext;          // lower case extension
+  uint32_t flags;     // DT_IMAGE_HAS_WAV and DT_IMAGE_HAS_TXT
+  gboolean metadata_read;
+  struct dt_exif_parsed_t *exif; // metadata of the image, only if metadata_read
+  struct dt_exif_parsed_t *xmp;  // its sidecar, if metadata_read and there is one
+  GList *duplicates;  // sidecars of all versions, if metadata_read
+} dt_image_import_prepared_t;
+
+/** checks the file and, with read_metadata, parses its exif data and sidecars. doesn't touch the database or
+    the caches, so many files can be prepared in parallel. returns NULL if the file is not to be imported. */
+dt_image_import_prepared_t *dt_image_import_prepare(const char *filename, const gboolean override_ignore_jpegs,
+                                                    const gboolean read_metadata);
+/** the database part of dt_image_import(), for a prepared file. the caller may wrap many of these in one
+    transaction. */
+uint32_t dt_image_import_commit(const int32_t film_id, dt_image_import_prepared_t *prepared);
+void dt_image_import_prepared_free(dt_image_import_prepared_t *prepared);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. Use from lua thread.*/
 uint32_t dt_image_import_lua(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
 /** removes the given image from the database. */
@@ -238,6 +259,8 @@ void dt_image_set_location(const int32_t imgid, double lon, double lat);
 void dt_image_set_location_and_elevation(const int32_t imgid, double lon, double lat, double ele);
 /** returns 1 if there is history data found for this image, 0 else. */
 int dt_image_altered(const uint32_t imgid);
+/** returns 1 if a history item of this operation counts as an alteration of the image, 0 else. */
+int dt_image_history_op_alters(const char *op);
 /** set the image final/cropped aspect ratio */
 void dt_image_set_aspect_ratio(const int32_t imgid);
 /** set the image final/cropped aspect ratio */
@@ -17,6 +17,7 @@
 */
 
 #include "common/image_cache.h"
+#include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
@@ -161,7 +162,9 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  const int cache_shards = dt_conf_get_int("cache_shards");
+  const uint32_t num_shards = cache_shards > 0 ? cache_shards : CLAMP(dt_get_num_threads(), 1, 16);
+  dt_cache_init_sharded(&cache->cache, sizeof(dt_image_t), max_mem, num_shards);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
@@ -175,9 +178,9 @@ void dt_image_cache_cleanup(dt_image_cache_t *cache)
 
 void dt_image_cache_print(dt_image_cache_t *cache)
 {
-  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cache->cache.cost / (1024.0 * 1024.0),
+  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", dt_cache_get_cost(&cache->cache) / (1024.0 * 1024.0),
          cache->cache.cost_quota / (1024.0 * 1024.0),
-         (float)cache->cache.cost / (float)cache->cache.cost_quota);
+         (float)dt_cache_get_cost(&cache->cache) / (float)cache->cache.cost_quota);
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const uint32_t imgid, char mode)
@@ -254,6 +257,9 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
   sqlite3_finalize(stmt);
 
+  // rating, date, location, ... might have changed what the collections show
+  dt_collection_image_changed();
+
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
   {
@@ -43,6 +43,7 @@
 #include "common/imageio_rgbe.h"
 #include "common/imageio_tiff.h"
 #include "common/mipmap_cache.h"
+#include "common/profiling.h"
 #include "common/styles.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -68,6 +69,54 @@
 #include "lua/image.h"
 #endif
 
+// parsed style items, shared between exports while a batch keeps the cache enabled.
+// the items are only read by dt_styles_apply_style_item(), so concurrent pipes can use the same list.
+static GMutex _export_styles_lock;
+static GHashTable *_export_styles = NULL;
+
+static void _export_style_items_free(gpointer data)
+{
+  g_list_free_full((GList *)data, dt_style_item_free);
+}
+
+void dt_imageio_export_style_cache_init()
+{
+  g_mutex_lock(&_export_styles_lock);
+  if(!_export_styles)
+    _export_styles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _export_style_items_free);
+  g_mutex_unlock(&_export_styles_lock);
+}
+
+void dt_imageio_export_style_cache_cleanup()
+{
+  g_mutex_lock(&_export_styles_lock);
+  if(_export_styles) g_hash_table_destroy(_export_styles);
+  _export_styles = NULL;
+  g_mutex_unlock(&_export_styles_lock);
+}
+
+// returns the items of the style, *owned tells whether the caller has to free the list.
+static GList *_export_style_items(const char *name, gboolean *owned)
+{
+  g_mutex_lock(&_export_styles_lock);
+  if(!_export_styles)
+  {
+    g_mutex_unlock(&_export_styles_lock);
+    *owned = TRUE;
+    return dt_styles_get_item_list(name, TRUE, -1);
+  }
+
+  GList *items = g_hash_table_lookup(_export_styles, name);
+  if(!items)
+  {
+    items = dt_styles_get_item_list(name, TRUE, -1);
+    if(items) g_hash_table_insert(_export_styles, g_strdup(name), items);
+  }
+  g_mutex_unlock(&_export_styles_lock);
+  *owned = FALSE;
+  return items;
+}
+
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
@@ -583,6 +632,115 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_mod
                                         storage_params, num, total);
 }
 
+// strips of a streaming export hold about this many pixels
+#define DT_IMAGEIO_EXPORT_STRIP_PIXELS (16 * 1024 * 1024)
+// formats with the row api get the output in chunks of about this many pixels, small enough to stay in the cache
+// between converting and encoding them
+#define DT_IMAGEIO_EXPORT_HANDOFF_PIXELS (64 * 1024)
+
+// converts the pixelpipe output in place to what the format wants to write
+static void _export_convert_buffer(uint8_t *outbuf, const size_t pixels, const int bpp,
+                                   const gboolean display_byteorder, const gboolean high_quality_processing)
+{
+  // downconversion to low-precision formats:
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < pixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < pixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < pixels; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(size_t k = 0; k < pixels; k++)
+    {
+      // convert in place
+      for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+    }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// whether an export of that size is large enough to be streamed, if the pipe allows it
+static gboolean _export_streaming(dt_imageio_module_format_t *format, const gboolean thumbnail_export,
+                                  const int width, const int height)
+{
+  if(thumbnail_export || !format->write_image_begin) return FALSE;
+  const int megapixels = dt_conf_get_int("plugins/lighttable/export/streaming_megapixels");
+  return megapixels > 0 && (double)width * height > megapixels * 1e6;
+}
+
+// number of rows per strip if this export should be processed and written strip by strip, 0 for the full frame
+static int _export_strip_rows(dt_imageio_module_format_t *format, const dt_dev_pixelpipe_t *pipe,
+                              const gboolean thumbnail_export, const int width, const int height)
+{
+  if(!_export_streaming(format, thumbnail_export, width, height)) return 0;
+
+  // modules which need to see the whole image at once can't work on strips, same as for tiling.
+  // gamma only converts pixels for display.
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && !piece->process_tiling_ready && strcmp(piece->module->op, "gamma"))
+    {
+      dt_print(DT_DEBUG_PERF, "[export] `%s' needs the full frame, not streaming\n", piece->module->op);
+      return 0;
+    }
+  }
+
+  const int rows = DT_IMAGEIO_EXPORT_STRIP_PIXELS / width;
+  return CLAMP(rows, 1, height);
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
@@ -594,6 +752,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total)
 {
+  const double trace_start = dt_get_wtime();
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
   dt_dev_load_image(&dev, imgid);
@@ -625,8 +784,12 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   dt_times_t start;
   dt_get_times(&start);
   dt_dev_pixelpipe_t pipe;
+  // a streamed export only ever needs buffers of a strip, so don't preallocate cache lines for the full
+  // frame. they grow on demand, also if streaming turns out not to be possible.
+  const gboolean may_stream = _export_streaming(format, thumbnail_export, wd, ht);
   res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-                         : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params), TRUE); // TODO
+                         : dt_dev_pixelpipe_init_export(&pipe, may_stream ? 0 : wd, may_stream ? 0 : ht,
+                                                        format->levels(format_params), TRUE); // TODO
   if(!res)
   {
     dt_control_log(
@@ -638,7 +801,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   //  If a style is to be applied during export, add the iop params into the history
   if(!thumbnail_export && format_params->style[0] != '\0')
   {
-    GList *style_items = dt_styles_get_item_list(format_params->style, TRUE, -1);
+    gboolean style_items_owned = TRUE;
+    GList *style_items = _export_style_items(format_params->style, &style_items_owned);
     if(!style_items)
     {
       dt_control_log(_("cannot find the style '%s' to apply during export."), format_params->style);
@@ -660,7 +824,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     }
 
     g_list_free(modules_used);
-    g_list_free_full(style_items, dt_style_item_free);
+    if(style_items_owned) g_list_free_full(style_items, dt_style_item_free);
   }
 
   dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
@@ -727,146 +891,139 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   const int bpp = format->bpp(format_params);
 
-  dt_get_times(&start);
-  if(high_quality_processing)
-  {
-    /*
-     * if high quality processing was requested, downsampling will be done
-     * at the very end of the pipe (just before border and watermark)
-     */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-  }
-  else
+  // find the finalscale module
+  dt_dev_pixelpipe_iop_t *finalscale = NULL;
+  if(!high_quality_processing)
   {
-    // else, downsampling will be right after demosaic
-
-    // so we need to turn temporarily disable in-pipe late downsampling iop.
-
-    // find the finalscale module
-    dt_dev_pixelpipe_iop_t *finalscale = NULL;
+    GList *nodes = g_list_last(pipe.nodes);
+    while(nodes)
     {
-      GList *nodes = g_list_last(pipe.nodes);
-      while(nodes)
+      dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
+      if(!strcmp(node->module->op, "finalscale"))
       {
-        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
-        if(!strcmp(node->module->op, "finalscale"))
-        {
-          finalscale = node;
-          break;
-        }
-        nodes = g_list_previous(nodes);
+        finalscale = node;
+        break;
       }
+      nodes = g_list_previous(nodes);
     }
+  }
 
-    if(finalscale) finalscale->enabled = 0;
+  // formats with the row api are handed the output a few rows at a time, each chunk converted in place right
+  // before, instead of converting the whole frame first and having the format walk it again.
+  const gboolean row_handoff = format->write_image_begin != NULL;
+  // very large exports are processed and written in strips of rows, so neither the pipe nor the format
+  // has to hold the full output frame.
+  const int strip_rows = _export_strip_rows(format, &pipe, thumbnail_export, processed_width, processed_height);
 
-    // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+  format_params->width = processed_width;
+  format_params->height = processed_height;
 
-    if(finalscale) finalscale->enabled = 1;
+  uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
+                                // adding new tags could make it go over that... so let it be and see what
+                                // happens when we write the image
+  int length = 0;
+  if(!ignore_exif)
+  {
+    char pathname[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+    // last param is dng mode, it's false here
+    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
   }
-  dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
-                                         : "[dev_process_export] pixel pipeline processing",
-                NULL);
 
-  uint8_t *outbuf = pipe.backbuf;
+  void *handle = NULL;
+  if(row_handoff)
+  {
+    handle = format->write_image_begin(format_params, filename, icc_type, icc_filename,
+                                       ignore_exif ? NULL : exif_profile, length, imgid, num, total, &pipe);
+    if(!handle)
+    {
+      free(exif_profile);
+      goto error;
+    }
+    if(strip_rows)
+      dt_print(DT_DEBUG_PERF, "[export] streaming %dx%d in strips of %d rows\n", processed_width,
+               processed_height, strip_rows);
+  }
 
-  // downconversion to low-precision formats:
-  if(bpp == 8)
+  dt_get_times(&start);
+  int failed = 0;
+  for(int y = 0; y < processed_height && !failed; y += strip_rows ? strip_rows : processed_height)
   {
-    if(display_byteorder)
+    const int rows = strip_rows ? MIN(strip_rows, processed_height - y) : processed_height;
+
+    if(high_quality_processing)
     {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
+      /*
+       * if high quality processing was requested, downsampling will be done
+       * at the very end of the pipe (just before border and watermark)
+       */
+      failed = dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, y, processed_width, rows, scale);
     }
-    else // need to flip
+    else
     {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
+      // else, downsampling will be right after demosaic
+
+      // so we need to turn temporarily disable in-pipe late downsampling iop.
+      if(finalscale) finalscale->enabled = 0;
+
+      // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
+      if(bpp == 8)
+        failed = dt_dev_pixelpipe_process(&pipe, &dev, 0, y, processed_width, rows, scale);
       else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
+        failed = dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, y, processed_width, rows, scale);
+
+      if(finalscale) finalscale->enabled = 1;
     }
-  }
-  else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
+    // the full frame path has always written whatever the pipe left behind
+    if(!strip_rows) failed = 0;
+    if(failed) break;
+
+    if(row_handoff)
+    {
+      // the pipe output is 8-bit already only if it went through gamma
+      const size_t stride = (size_t)processed_width * 4 * ((bpp == 8 && !high_quality_processing) ? 1 : sizeof(float));
+      const int chunk = CLAMP(DT_IMAGEIO_EXPORT_HANDOFF_PIXELS / processed_width, 1, rows);
+      for(int cy = 0; cy < rows && !failed; cy += chunk)
       {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+        const int chunk_rows = MIN(chunk, rows - cy);
+        uint8_t *const rowbuf = (uint8_t *)pipe.backbuf + stride * cy;
+        _export_convert_buffer(rowbuf, (size_t)processed_width * chunk_rows, bpp, display_byteorder,
+                               high_quality_processing);
+        failed = format->write_image_rows(format_params, handle, rowbuf, y + cy, chunk_rows);
       }
+    }
+    else
+      _export_convert_buffer(pipe.backbuf, (size_t)processed_width * rows, bpp, display_byteorder,
+                             high_quality_processing);
   }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+  dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
+                                         : "[dev_process_export] pixel pipeline processing",
+                NULL);
 
-  if(!ignore_exif)
-  {
-    int length;
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-    // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+  if(row_handoff)
+    res = format->write_image_end(format_params, handle, failed);
+  else
+    res = format->write_image(format_params, filename, pipe.backbuf, icc_type, icc_filename,
+                              ignore_exif ? NULL : exif_profile, length, imgid, num, total, &pipe);
 
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe);
+  free(exif_profile);
 
-    free(exif_profile);
-  }
-  else
+  if(dt_trace_enabled())
   {
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
-                              &pipe);
+    // the whole image, from loading to the written file
+    const dt_trace_event_t ev = { .name = thumbnail_export ? "thumbnail" : "export",
+                                  .category = "export",
+                                  .pipe = format->mime(format_params),
+                                  .imgid = imgid,
+                                  .start = trace_start,
+                                  .end = dt_get_wtime(),
+                                  .flags = res ? DT_TRACE_FAILED : DT_TRACE_NONE,
+                                  .width = processed_width,
+                                  .height = processed_height,
+                                  .bytes = (size_t)processed_width * (strip_rows ? strip_rows : processed_height)
+                                           * 4 * MAX(bpp / 8, 1) };
+    dt_trace_event(&ev);
   }
 
   dt_dev_pixelpipe_cleanup(&pipe);
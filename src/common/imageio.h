@@ -80,6 +80,10 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total);
 
+// keep the parsed items of export styles around between exports (batch mode of darktable-cli), until cleanup.
+void dt_imageio_export_style_cache_init();
+void dt_imageio_export_style_cache_cleanup();
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
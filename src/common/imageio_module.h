@@ -119,6 +119,14 @@ typedef struct dt_imageio_module_format_t
   int (*write_image)(dt_imageio_module_data_t *data, const char *filename, const void *in,
                      dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                      void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe);
+  /* optional: the same, but strip by strip. NULL if the format can only write the full frame. */
+  void *(*write_image_begin)(dt_imageio_module_data_t *data, const char *filename,
+                             dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                             void *exif, int exif_len, int imgid, int num, int total,
+                             struct dt_dev_pixelpipe_t *pipe);
+  int (*write_image_rows)(dt_imageio_module_data_t *data, void *handle, const void *in, const int y,
+                          const int rows);
+  int (*write_image_end)(dt_imageio_module_data_t *data, void *handle, const int failed);
   /* flag that describes the available precision/levels of output format. mainly used for dithering. */
   int (*levels)(dt_imageio_module_data_t *data);
 
@@ -30,6 +30,7 @@ extern "C" {
 #include "common/colorspaces.h"
 #include "common/darktable.h"
 #include "common/exif.h"
+#include "common/file_buffer.h"
 #include "common/file_location.h"
 #include "common/imageio_rawspeed.h"
 #include "imageio.h"
@@ -109,9 +110,26 @@ uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint3
   return ColorFilterArray::shiftDcrawFilter(filters, crop_x, crop_y);
 }
 
+// holds on to the shared file buffer for as long as rawspeed might read from it
+class FileBufferRef
+{
+public:
+  explicit FileBufferRef(const char *filename) : buffer(dt_file_buffer_get(filename)) {}
+  ~FileBufferRef() { release(); }
+  void release()
+  {
+    dt_file_buffer_release(buffer);
+    buffer = NULL;
+  }
+  dt_file_buffer_t *buffer;
+};
+
 dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filename,
                                              dt_mipmap_buffer_t *mbuf)
 {
+  // map the file first, so exiv2 gets its bytes from the same buffer as rawspeed
+  FileBufferRef file(filename);
+
   if(!img->exif_inited) (void)dt_exif_read(img, filename);
 
   char filen[PATH_MAX] = { 0 };
@@ -125,7 +143,11 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
-    m = f.readFile();
+    // rawspeed's buffers are limited to 32 bit sizes
+    if(file.buffer && file.buffer->size <= UINT32_MAX)
+      m = std::unique_ptr<const Buffer>(new Buffer(file.buffer->data, (Buffer::size_type)file.buffer->size));
+    else
+      m = f.readFile();
 
     RawParser t(m.get());
     d = t.getDecoder(meta);
@@ -220,6 +242,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+    file.release();
 
     // Grab the WB
     for(int i = 0; i < 4; i++) img->wb_coeffs[i] = r->metadata.wbCoeffs[i];
@@ -17,6 +17,7 @@
 */
 
 #include "common/metadata.h"
+#include "common/collection.h"
 #include "common/debug.h"
 #include "common/undo.h"
 #include "control/signal.h"
@@ -184,6 +185,8 @@ static void _metadata_set_xmp(const int id, const gint keyid, const char *value,
     }
   }
 
+  dt_collection_image_changed();
+
   if(undo_actif)
   {
     dt_undo_record(darktable.undo, NULL, DT_UNDO_METADATA, (dt_undo_data_t *)undo, &_pop_undo, _metadata_undo_data_free);
@@ -584,6 +587,7 @@ void dt_metadata_clear(int id)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed();
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -359,7 +359,22 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
-    if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+    if(cache->container[mip])
+    {
+      // single file backend, decoded straight out of the mapped container
+      dt_colorspaces_color_profile_type_t color_space;
+      uint32_t width, height;
+      if(!dt_mipmap_container_read(cache->container[mip], get_imgid(entry->key), entry->data + sizeof(*dsc),
+                                   &width, &height, &color_space))
+      {
+        dsc->width = width;
+        dsc->height = height;
+        dsc->iscale = 1.0f;
+        dsc->color_space = color_space;
+        loaded_from_disk = 1;
+      }
+    }
+    else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -426,6 +441,29 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
     g_unlink(filename);
   }
+  if(cache->container[mip]) dt_mipmap_container_remove(cache->container[mip], imgid);
+}
+
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return FALSE;
+  if(cache->container[mip]) return dt_mipmap_container_contains(cache->container[mip], imgid);
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
+int64_t dt_mipmap_cache_get_ondisk_thumbnail_timestamp(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                                       const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return 0;
+  if(cache->container[mip]) return dt_mipmap_container_get_timestamp(cache->container[mip], imgid);
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
+  GStatBuf statbuf;
+  if(g_stat(filename, &statbuf)) return 0;
+  return MAX((int64_t)statbuf.st_mtime, 1);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -442,6 +480,12 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
+      else if(cache->container[mip])
+      {
+        const int cache_quality = dt_conf_get_int("database_cache_quality");
+        dt_mipmap_container_write(cache->container[mip], get_imgid(entry->key), entry->data + sizeof(*dsc),
+                                  dsc->width, dsc->height, dsc->color_space, MIN(100, MAX(10, cache_quality)));
+      }
       else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
       {
         // serialize to disk
@@ -545,6 +589,29 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
     cache->buffer_size[k] = sizeof(struct dt_mipmap_buffer_dsc)
                                 + cache->max_width[k] * cache->max_height[k] * 4;
 
+  // one memory mapped file per thumbnail level instead of a jpg per image:
+  for(int k = 0; k < DT_MIPMAP_F; k++) cache->container[k] = NULL;
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend")
+     && dt_conf_get_bool("cache_disk_backend_container"))
+  {
+    char dirname[PATH_MAX] = { 0 };
+    snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+    if(!g_mkdir_with_parents(dirname, 0750))
+    {
+      for(int k = 0; k < DT_MIPMAP_F; k++)
+      {
+        char filename[PATH_MAX] = { 0 };
+        snprintf(filename, sizeof(filename), "%s/%d.dtmc", dirname, k);
+        dt_mipmap_container_t *container = (dt_mipmap_container_t *)malloc(sizeof(dt_mipmap_container_t));
+        if(container
+           && !dt_mipmap_container_open(container, filename, k, cache->max_width[k], cache->max_height[k]))
+          cache->container[k] = container;
+        else
+          free(container);
+      }
+    }
+  }
+
   // clear stats:
   cache->mip_thumbs.stats_requests = 0;
   cache->mip_thumbs.stats_near_match = 0;
@@ -562,7 +629,11 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // spread the thumbnails over independently locked shards, lighttable scrolling and
+  // thumbnail jobs hit this one from all threads at once:
+  const int cache_shards = dt_conf_get_int("cache_shards");
+  const uint32_t num_shards = cache_shards > 0 ? cache_shards : CLAMP(dt_get_num_threads(), 1, 16);
+  dt_cache_init_sharded(&cache->mip_thumbs.cache, 0, max_mem, num_shards);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -587,23 +658,31 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // thumbnails get written to the disk backend on the way out, so close it last:
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    if(!cache->container[k]) continue;
+    dt_mipmap_container_close(cache->container[k]);
+    free(cache->container[k]);
+    cache->container[k] = NULL;
+  }
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
 {
   printf("[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)\n",
-         cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+         dt_cache_get_cost(&cache->mip_thumbs.cache) / (1024.0 * 1024.0),
          cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-         100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+         100.0f * (float)dt_cache_get_cost(&cache->mip_thumbs.cache) / (float)cache->mip_thumbs.cache.cost_quota);
   printf("[mipmap_cache] float fill %d/%d slots (%.2f%%)\n",
-         (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-         100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+         (uint32_t)dt_cache_get_cost(&cache->mip_f.cache), (uint32_t)cache->mip_f.cache.cost_quota,
+         100.0f * (float)dt_cache_get_cost(&cache->mip_f.cache) / (float)cache->mip_f.cache.cost_quota);
   printf("[mipmap_cache] full  fill %d/%d slots (%.2f%%)\n",
-         (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-         100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+         (uint32_t)dt_cache_get_cost(&cache->mip_full.cache), (uint32_t)cache->mip_full.cache.cost_quota,
+         100.0f * (float)dt_cache_get_cost(&cache->mip_full.cache) / (float)cache->mip_full.cache.cost_quota);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -714,10 +793,8 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -897,13 +974,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -1212,6 +1284,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
+    format.write_image_begin = NULL;
     format.levels = _levels;
     dat.head.max_width = wd;
     dat.head.max_height = ht;
@@ -1263,6 +1336,11 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      if(cache->container[mip])
+      {
+        dt_mipmap_container_copy(cache->container[mip], dst_imgid, src_imgid);
+        continue;
+      }
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
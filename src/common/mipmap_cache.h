@@ -21,6 +21,7 @@
 #include "common/cache.h"
 #include "common/colorspaces.h"
 #include "common/image.h"
+#include "common/mipmap_container.h"
 
 // sizes stored in the mipmap cache, set to fixed values in mipmap_cache.c
 typedef enum dt_mipmap_size_t
@@ -99,6 +100,8 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // single file disk backend per thumbnail level, NULL if the jpg files are used
+  dt_mipmap_container_t *container[DT_MIPMAP_F];
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -145,6 +148,13 @@ void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid);
 // evict thumbnails from cache. They will be written to disc if not existing
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid);
 
+// whether the disk backend has a thumbnail of that size for the image
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const dt_mipmap_size_t mip);
+// when that thumbnail was written to disk (seconds since the epoch), 0 if there is none
+int64_t dt_mipmap_cache_get_ondisk_thumbnail_timestamp(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                                       const dt_mipmap_size_t mip);
+
 // return the closest mipmap size
 // for the given window you wish to draw.
 // a dt_mipmap_size_t has always a fixed resolution associated with it,
@@ -160,7 +170,7 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
-// only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
+// only copies over the disk backend, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
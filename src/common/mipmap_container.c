@@ -0,0 +1,441 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_container.h"
+#include "common/darktable.h"
+#include "common/imageio_jpeg.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define DT_MIPMAP_CONTAINER_MAGIC 0xD7133C
+#define DT_MIPMAP_CONTAINER_VERSION 2
+
+// the file only grows by this much at a time, to not remap for every thumbnail:
+#define DT_MIPMAP_CONTAINER_GROW (16u << 20)
+// compact once that many bytes are held by removed or replaced thumbnails, and they are the majority:
+#define DT_MIPMAP_CONTAINER_DEAD_MIN (64u << 20)
+
+typedef enum dt_mipmap_container_codec_t
+{
+  DT_MIPMAP_CONTAINER_CODEC_NONE = 0,
+  DT_MIPMAP_CONTAINER_CODEC_JPEG = 1
+} dt_mipmap_container_codec_t;
+
+typedef struct dt_mipmap_container_header_t
+{
+  int32_t magic;
+  int32_t version;
+  int32_t mip;
+  uint32_t max_width, max_height;
+  uint32_t capacity; // number of index slots, for image ids 1 .. capacity
+  uint64_t data_end; // thumbnails are appended here
+  uint64_t dead;     // bytes held by removed or replaced thumbnails
+  uint8_t padding[24];
+} dt_mipmap_container_header_t;
+
+typedef struct dt_mipmap_container_slot_t
+{
+  uint64_t offset; // 0 means empty
+  uint32_t length;
+  uint16_t width, height;
+  int32_t color_space;
+  int32_t codec;
+  int64_t timestamp; // when the thumbnail was written, seconds since the epoch
+} dt_mipmap_container_slot_t;
+
+static inline dt_mipmap_container_header_t *_header(const dt_mipmap_container_t *c)
+{
+  return (dt_mipmap_container_header_t *)c->map;
+}
+
+// slot for imgid, or NULL if the index doesn't reach that far. needs (at least) the read lock.
+static inline dt_mipmap_container_slot_t *_slot(const dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  if(!c->map || imgid == 0 || imgid > _header(c)->capacity) return NULL;
+  dt_mipmap_container_slot_t *index = (dt_mipmap_container_slot_t *)(c->map + sizeof(dt_mipmap_container_header_t));
+  return index + imgid - 1;
+}
+
+static inline size_t _data_start(const uint32_t capacity)
+{
+  return sizeof(dt_mipmap_container_header_t) + (size_t)capacity * sizeof(dt_mipmap_container_slot_t);
+}
+
+#if !defined(_WIN32)
+
+static void _unmap(dt_mipmap_container_t *c)
+{
+  if(c->map) munmap(c->map, c->map_size);
+  if(c->fd >= 0) close(c->fd);
+  c->map = NULL;
+  c->map_size = 0;
+  c->fd = -1;
+}
+
+// maps the whole file, growing it to at least size bytes first.
+static int _map(dt_mipmap_container_t *c, const size_t size)
+{
+  if(c->map) munmap(c->map, c->map_size);
+  c->map = NULL;
+  c->map_size = 0;
+
+  struct stat st;
+  if(fstat(c->fd, &st)) return 1;
+  size_t file_size = st.st_size;
+  if(file_size < size)
+  {
+    // sparse, the tail costs nothing until thumbnails get written there:
+    if(ftruncate(c->fd, size)) return 1;
+    file_size = size;
+  }
+
+  void *map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+  if(map == MAP_FAILED) return 1;
+  c->map = map;
+  c->map_size = file_size;
+  return 0;
+}
+
+// writes an empty container with room for capacity slots to fd.
+static int _init_file(const int fd, const int mip, const uint32_t max_width, const uint32_t max_height,
+                      const uint32_t capacity)
+{
+  dt_mipmap_container_header_t header = { 0 };
+  header.magic = DT_MIPMAP_CONTAINER_MAGIC;
+  header.version = DT_MIPMAP_CONTAINER_VERSION;
+  header.mip = mip;
+  header.max_width = max_width;
+  header.max_height = max_height;
+  header.capacity = capacity;
+  header.data_end = _data_start(capacity);
+  if(ftruncate(fd, 0) || ftruncate(fd, header.data_end)) return 1;
+  if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) return 1;
+  return 0;
+}
+
+// rewrites the container with room for capacity slots and only the live thumbnails. needs the write lock.
+static int _rebuild(dt_mipmap_container_t *c, uint32_t capacity)
+{
+  const dt_mipmap_container_header_t *header = _header(c);
+  capacity = MAX(capacity, header->capacity);
+
+  size_t live = 0;
+  for(uint32_t imgid = 1; imgid <= header->capacity; imgid++)
+  {
+    const dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+    if(slot->offset) live += slot->length;
+  }
+
+  char tmpname[PATH_MAX] = { 0 };
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", c->filename);
+  const int fd = g_open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0640);
+  if(fd < 0) return 1;
+  if(_init_file(fd, c->mip, c->max_width, c->max_height, capacity)) goto error;
+
+  const size_t size = _data_start(capacity) + live;
+  if(ftruncate(fd, size)) goto error;
+  uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED) goto error;
+
+  dt_mipmap_container_slot_t *index = (dt_mipmap_container_slot_t *)(map + sizeof(dt_mipmap_container_header_t));
+  size_t end = _data_start(capacity);
+  for(uint32_t imgid = 1; imgid <= header->capacity; imgid++)
+  {
+    const dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+    if(!slot->offset) continue;
+    memcpy(map + end, c->map + slot->offset, slot->length);
+    index[imgid - 1] = *slot;
+    index[imgid - 1].offset = end;
+    end += slot->length;
+  }
+  ((dt_mipmap_container_header_t *)map)->data_end = end;
+  munmap(map, size);
+
+  if(g_rename(tmpname, c->filename)) goto error;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_container] rebuilt `%s' for %u images, %zu bytes of thumbnails\n",
+           c->filename, capacity, live);
+
+  munmap(c->map, c->map_size);
+  c->map = NULL;
+  close(c->fd);
+  c->fd = fd;
+  if(_map(c, 0))
+  {
+    _unmap(c);
+    return 1;
+  }
+  return 0;
+
+error:
+  close(fd);
+  g_unlink(tmpname);
+  return 1;
+}
+
+int dt_mipmap_container_open(dt_mipmap_container_t *c, const char *filename, const int mip,
+                             const uint32_t max_width, const uint32_t max_height)
+{
+  memset(c, 0, sizeof(*c));
+  c->fd = -1;
+  c->mip = mip;
+  c->max_width = max_width;
+  c->max_height = max_height;
+  g_strlcpy(c->filename, filename, sizeof(c->filename));
+  dt_pthread_rwlock_init(&c->lock, NULL);
+
+  c->fd = g_open(filename, O_RDWR | O_CREAT, 0640);
+  if(c->fd < 0)
+  {
+    fprintf(stderr, "[mipmap_container] could not open `%s': %s\n", filename, g_strerror(errno));
+    dt_pthread_rwlock_destroy(&c->lock);
+    return 1;
+  }
+
+  dt_mipmap_container_header_t header = { 0 };
+  const ssize_t rd = pread(c->fd, &header, sizeof(header), 0);
+  struct stat st;
+  if(rd != sizeof(header) || header.magic != DT_MIPMAP_CONTAINER_MAGIC
+     || header.version != DT_MIPMAP_CONTAINER_VERSION || header.mip != mip || header.max_width != max_width
+     || header.max_height != max_height || fstat(c->fd, &st) || header.data_end > (uint64_t)st.st_size
+     || header.data_end < _data_start(header.capacity))
+  {
+    // new, from an older darktable or with different thumbnail sizes: start over.
+    if(rd > 0) dt_print(DT_DEBUG_CACHE, "[mipmap_container] discarding outdated `%s'\n", filename);
+    // room for a few thousand images before the index has to grow:
+    if(_init_file(c->fd, mip, max_width, max_height, 4096)) goto error;
+  }
+
+  if(_map(c, 0)) goto error;
+  return 0;
+
+error:
+  fprintf(stderr, "[mipmap_container] could not initialize `%s'\n", filename);
+  _unmap(c);
+  dt_pthread_rwlock_destroy(&c->lock);
+  return 1;
+}
+
+void dt_mipmap_container_close(dt_mipmap_container_t *c)
+{
+  dt_pthread_rwlock_wrlock(&c->lock);
+  _unmap(c);
+  dt_pthread_rwlock_unlock(&c->lock);
+  dt_pthread_rwlock_destroy(&c->lock);
+}
+
+gboolean dt_mipmap_container_contains(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  return dt_mipmap_container_get_timestamp(c, imgid) > 0;
+}
+
+int64_t dt_mipmap_container_get_timestamp(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  dt_pthread_rwlock_rdlock(&c->lock);
+  const dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+  // a thumbnail without timestamp still counts as being there
+  const int64_t timestamp = (slot && slot->offset) ? MAX(slot->timestamp, 1) : 0;
+  dt_pthread_rwlock_unlock(&c->lock);
+  return timestamp;
+}
+
+int dt_mipmap_container_read(dt_mipmap_container_t *c, const uint32_t imgid, uint8_t *out, uint32_t *width,
+                             uint32_t *height, dt_colorspaces_color_profile_type_t *color_space)
+{
+  int res = 1;
+  gboolean broken = FALSE;
+  dt_pthread_rwlock_rdlock(&c->lock);
+  const dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+  if(!slot || !slot->offset) goto exit;
+  broken = TRUE;
+  if(slot->codec != DT_MIPMAP_CONTAINER_CODEC_JPEG || slot->offset + slot->length > c->map_size) goto exit;
+
+  // decode straight from the mapping:
+  dt_imageio_jpeg_t jpg;
+  if(dt_imageio_jpeg_decompress_header(c->map + slot->offset, slot->length, &jpg)
+     || jpg.width > c->max_width || jpg.height > c->max_height || jpg.width != slot->width
+     || jpg.height != slot->height || dt_imageio_jpeg_decompress(&jpg, out))
+  {
+    fprintf(stderr, "[mipmap_container] failed to decompress thumbnail for image %u from `%s'!\n", imgid,
+            c->filename);
+    goto exit;
+  }
+  *width = jpg.width;
+  *height = jpg.height;
+  *color_space = slot->color_space;
+  broken = FALSE;
+  res = 0;
+
+exit:
+  dt_pthread_rwlock_unlock(&c->lock);
+  // a broken thumbnail would fail over and over again, drop it so it gets regenerated:
+  if(broken) dt_mipmap_container_remove(c, imgid);
+  return res;
+}
+
+// appends blob and points the slot of imgid to it. needs the write lock.
+static int _append(dt_mipmap_container_t *c, const uint32_t imgid, const uint8_t *blob, const uint32_t length,
+                   const uint32_t width, const uint32_t height,
+                   const dt_colorspaces_color_profile_type_t color_space)
+{
+  if(!c->map) return 1;
+
+  // the index doesn't reach this image yet, make room for twice as many:
+  if(imgid > _header(c)->capacity && _rebuild(c, MAX(2 * _header(c)->capacity, imgid))) return 1;
+
+  dt_mipmap_container_header_t *header = _header(c);
+  const size_t end = header->data_end + length;
+  if(end > c->map_size && _map(c, MAX(end, c->map_size + DT_MIPMAP_CONTAINER_GROW))) return 1;
+
+  header = _header(c);
+  memcpy(c->map + header->data_end, blob, length);
+  // only publish the thumbnail once the data is in place
+  dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+  if(slot->offset) header->dead += slot->length;
+  slot->length = length;
+  slot->width = width;
+  slot->height = height;
+  slot->color_space = color_space;
+  slot->codec = DT_MIPMAP_CONTAINER_CODEC_JPEG;
+  slot->timestamp = g_get_real_time() / G_USEC_PER_SEC;
+  slot->offset = header->data_end;
+  header->data_end = end;
+  return 0;
+}
+
+int dt_mipmap_container_write(dt_mipmap_container_t *c, const uint32_t imgid, const uint8_t *in,
+                              const uint32_t width, const uint32_t height,
+                              const dt_colorspaces_color_profile_type_t color_space, const int quality)
+{
+  if(imgid == 0 || width > c->max_width || height > c->max_height || width > UINT16_MAX || height > UINT16_MAX)
+    return 1;
+  // don't write existing thumbnails as both performance and quality (lossy jpg) suffer
+  if(dt_mipmap_container_contains(c, imgid)) return 0;
+
+  // compress without holding the lock:
+  uint8_t *blob = (uint8_t *)malloc((size_t)4 * width * height);
+  if(!blob) return 1;
+  const int length = dt_imageio_jpeg_compress(in, blob, width, height, quality);
+  if(length <= 1)
+  {
+    free(blob);
+    return 1;
+  }
+
+  dt_pthread_rwlock_wrlock(&c->lock);
+  const dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+  // someone else might have been faster
+  const int res = (slot && slot->offset) ? 0 : _append(c, imgid, blob, length, width, height, color_space);
+  dt_pthread_rwlock_unlock(&c->lock);
+
+  free(blob);
+  return res;
+}
+
+void dt_mipmap_container_remove(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  dt_pthread_rwlock_wrlock(&c->lock);
+  dt_mipmap_container_slot_t *slot = _slot(c, imgid);
+  if(slot && slot->offset)
+  {
+    dt_mipmap_container_header_t *header = _header(c);
+    header->dead += slot->length;
+    memset(slot, 0, sizeof(*slot));
+    if(header->dead > DT_MIPMAP_CONTAINER_DEAD_MIN && 2 * header->dead > header->data_end) _rebuild(c, 0);
+  }
+  dt_pthread_rwlock_unlock(&c->lock);
+}
+
+void dt_mipmap_container_copy(dt_mipmap_container_t *c, const uint32_t dst_imgid, const uint32_t src_imgid)
+{
+  dt_pthread_rwlock_wrlock(&c->lock);
+  const dt_mipmap_container_slot_t *src = _slot(c, src_imgid);
+  if(src && src->offset)
+  {
+    // the blob moves when the map does, so take a copy first:
+    const dt_mipmap_container_slot_t s = *src;
+    uint8_t *blob = (uint8_t *)malloc(s.length);
+    if(blob)
+    {
+      memcpy(blob, c->map + s.offset, s.length);
+      _append(c, dst_imgid, blob, s.length, s.width, s.height, s.color_space);
+      free(blob);
+    }
+  }
+  dt_pthread_rwlock_unlock(&c->lock);
+}
+
+#else // _WIN32
+
+// no mmap, the per image jpg files are used instead.
+int dt_mipmap_container_open(dt_mipmap_container_t *c, const char *filename, const int mip,
+                             const uint32_t max_width, const uint32_t max_height)
+{
+  return 1;
+}
+
+void dt_mipmap_container_close(dt_mipmap_container_t *c)
+{
+}
+
+gboolean dt_mipmap_container_contains(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  return FALSE;
+}
+
+int64_t dt_mipmap_container_get_timestamp(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+  return 0;
+}
+
+int dt_mipmap_container_read(dt_mipmap_container_t *c, const uint32_t imgid, uint8_t *out, uint32_t *width,
+                             uint32_t *height, dt_colorspaces_color_profile_type_t *color_space)
+{
+  return 1;
+}
+
+int dt_mipmap_container_write(dt_mipmap_container_t *c, const uint32_t imgid, const uint8_t *in,
+                              const uint32_t width, const uint32_t height,
+                              const dt_colorspaces_color_profile_type_t color_space, const int quality)
+{
+  return 1;
+}
+
+void dt_mipmap_container_remove(dt_mipmap_container_t *c, const uint32_t imgid)
+{
+}
+
+void dt_mipmap_container_copy(dt_mipmap_container_t *c, const uint32_t dst_imgid, const uint32_t src_imgid)
+{
+}
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
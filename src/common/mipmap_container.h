@@ -0,0 +1,75 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <limits.h>
+#include <stdint.h>
+
+/**
+ * single file disk backend for one thumbnail mip level.
+ *
+ * instead of one jpg per image and mip level, all thumbnails of a level live in one
+ * memory mapped container: a header, an index with one slot per image id and the
+ * compressed thumbnails appended behind it. lookups are a pointer dereference into the
+ * index and thumbnails are decoded straight out of the mapping, without opening files.
+ */
+typedef struct dt_mipmap_container_t
+{
+  dt_pthread_rwlock_t lock; // read: lookups and decoding, write: anything that changes or remaps the file
+  int fd;
+  uint8_t *map;
+  size_t map_size;
+  int mip;
+  uint32_t max_width, max_height;
+  char filename[PATH_MAX];
+} dt_mipmap_container_t;
+
+/** opens (or creates) the container, an outdated or broken file is started over. returns 0 on success. */
+int dt_mipmap_container_open(dt_mipmap_container_t *c, const char *filename, const int mip,
+                             const uint32_t max_width, const uint32_t max_height);
+void dt_mipmap_container_close(dt_mipmap_container_t *c);
+
+/** whether a thumbnail is stored for this image. */
+gboolean dt_mipmap_container_contains(dt_mipmap_container_t *c, const uint32_t imgid);
+
+/** when the thumbnail of this image was stored (seconds since the epoch), 0 if there is none. */
+int64_t dt_mipmap_container_get_timestamp(dt_mipmap_container_t *c, const uint32_t imgid);
+
+/** decodes the thumbnail into out, which has room for max_width * max_height rgba pixels. returns 0 on success. */
+int dt_mipmap_container_read(dt_mipmap_container_t *c, const uint32_t imgid, uint8_t *out, uint32_t *width,
+                             uint32_t *height, dt_colorspaces_color_profile_type_t *color_space);
+
+/** stores the rgba thumbnail, unless there is one already. returns 0 on success. */
+int dt_mipmap_container_write(dt_mipmap_container_t *c, const uint32_t imgid, const uint8_t *in,
+                              const uint32_t width, const uint32_t height,
+                              const dt_colorspaces_color_profile_type_t color_space, const int quality);
+
+/** forgets the thumbnail, the space is reclaimed when the container gets compacted. */
+void dt_mipmap_container_remove(dt_mipmap_container_t *c, const uint32_t imgid);
+
+/** stores the thumbnail of src_imgid for dst_imgid as well. */
+void dt_mipmap_container_copy(dt_mipmap_container_t *c, const uint32_t dst_imgid, const uint32_t src_imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
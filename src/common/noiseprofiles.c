@@ -21,32 +21,80 @@
 #include "common/file_location.h"
 #include "control/control.h"
 
+#include <glib/gstdio.h>
+#include <string.h>
+
 // bump this when the noiseprofiles are getting a differen layout or meaning (raw-raw data, ...)
 #define DT_NOISE_PROFILE_VERSION 0
 
 const dt_noiseprofile_t dt_noiseprofile_generic = {N_("generic poissonian"), "", "", 0, {0.0001f, 0.0001f, 0.0001}, {0.0f, 0.0f, 0.0f}};
 
+// the binary noiseprofile table, compiled from the json at build time by darktable-compile-noiseprofiles and
+// mapped instead of parsing megabytes of json. all numbers are in host byte order, a table from another
+// machine fails the magic check and the json is used.
+#define DT_NOISE_PROFILE_BIN_MAGIC 0x504e5444 // "DTNP"
+// bump this when the layout of the structs below changes
+#define DT_NOISE_PROFILE_BIN_FORMAT 2
+
+typedef struct dt_noiseprofile_bin_header_t
+{
+  uint32_t magic;
+  uint32_t format;
+  uint32_t version;      // DT_NOISE_PROFILE_VERSION of the json
+  uint32_t n_models;
+  uint32_t n_profiles;
+  uint32_t strings_size;
+  uint64_t source_size;  // of the json, together with the mtime to notice a table that was not rebuilt
+  int64_t source_mtime;
+} dt_noiseprofile_bin_header_t;
+
+// the models are sorted by model name and then by their position in the json, so the first match of a binary
+// search is the one a walk over the json would have found first
+typedef struct dt_noiseprofile_bin_model_t
+{
+  uint32_t maker, model; // offsets into the strings
+  uint32_t order;        // position in the json
+  uint32_t first_profile, n_profiles;
+} dt_noiseprofile_bin_model_t;
+
+// sorted by iso, without the skipped ones
+typedef struct dt_noiseprofile_bin_profile_t
+{
+  uint32_t name;
+  int32_t iso;
+  float a[3];
+  float b[3];
+} dt_noiseprofile_bin_profile_t;
+
 static gboolean dt_noiseprofile_verify(JsonParser *parser);
 
-JsonParser *dt_noiseprofile_init(const char *alternative)
+// parsing the json takes a noticeable part of the startup, and only denoise (profiled) ever needs it. so the
+// file is only remembered on startup and read the first time a profile is looked up.
+static GMutex _noiseprofile_lock;
+static gchar *_noiseprofile_alternative = NULL;
+static gboolean _noiseprofile_loaded = FALSE;
+static GMappedFile *_noiseprofile_mapped = NULL;
+
+void dt_noiseprofile_init(const char *alternative)
 {
-  GError *error = NULL;
-  char filename[PATH_MAX] = { 0 };
+  g_mutex_lock(&_noiseprofile_lock);
+  g_free(_noiseprofile_alternative);
+  _noiseprofile_alternative = g_strdup(alternative);
+  _noiseprofile_loaded = FALSE;
+  if(darktable.noiseprofile_parser) g_object_unref(darktable.noiseprofile_parser);
+  darktable.noiseprofile_parser = NULL;
+  if(_noiseprofile_mapped) g_mapped_file_unref(_noiseprofile_mapped);
+  _noiseprofile_mapped = NULL;
+  g_mutex_unlock(&_noiseprofile_lock);
+}
 
-  if(alternative == NULL)
-  {
-    // TODO: shall we look for profiles in the user config dir?
-    char datadir[PATH_MAX] = { 0 };
-    dt_loc_get_datadir(datadir, sizeof(datadir));
-    snprintf(filename, sizeof(filename), "%s/%s", datadir, "noiseprofiles.json");
-  }
-  else
-    snprintf(filename, sizeof(filename), "%s", alternative);
+static JsonParser *_noiseprofile_parse(const char *filename)
+{
+  GError *error = NULL;
 
   dt_print(DT_DEBUG_CONTROL, "[noiseprofile] loading noiseprofiles from `%s'\n", filename);
   if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return NULL;
 
-  // TODO: shall we cache the content? for now this looks fast enough(TM)
   JsonParser *parser = json_parser_new();
   if(!json_parser_load_from_file(parser, filename, &error))
   {
@@ -59,7 +107,7 @@ JsonParser *dt_noiseprofile_init(const char *alternative)
   // run over the file once to verify that it is sane
   if(!dt_noiseprofile_verify(parser))
   {
-    dt_control_log(_("noiseprofile file `%s' is not valid"), filename);
+    if(darktable.control) dt_control_log(_("noiseprofile file `%s' is not valid"), filename);
     fprintf(stderr, "[noiseprofile] error: `%s' is not a valid noiseprofile file. run with -d control for details\n", filename);
     g_object_unref(parser);
     return NULL;
@@ -68,6 +116,103 @@ JsonParser *dt_noiseprofile_init(const char *alternative)
   return parser;
 }
 
+static inline const dt_noiseprofile_bin_header_t *_bin_header(GMappedFile *mapped)
+{
+  return (const dt_noiseprofile_bin_header_t *)g_mapped_file_get_contents(mapped);
+}
+
+static inline const dt_noiseprofile_bin_model_t *_bin_models(const dt_noiseprofile_bin_header_t *header)
+{
+  return (const dt_noiseprofile_bin_model_t *)(header + 1);
+}
+
+static inline const dt_noiseprofile_bin_profile_t *_bin_profiles(const dt_noiseprofile_bin_header_t *header)
+{
+  return (const dt_noiseprofile_bin_profile_t *)(_bin_models(header) + header->n_models);
+}
+
+static inline const char *_bin_strings(const dt_noiseprofile_bin_header_t *header)
+{
+  return (const char *)(_bin_profiles(header) + header->n_profiles);
+}
+
+// maps a compiled table, NULL if the file is not one or wasn't compiled from a json of source_size bytes last
+// modified at source_mtime (source_size -1 to not check)
+static GMappedFile *_noiseprofile_map(const char *filename, const goffset source_size, const int64_t source_mtime)
+{
+  GMappedFile *mapped = g_mapped_file_new(filename, FALSE, NULL);
+  if(!mapped) return NULL;
+
+  const size_t size = g_mapped_file_get_length(mapped);
+  const dt_noiseprofile_bin_header_t *header = _bin_header(mapped);
+  const char *reason = NULL;
+  if(size < sizeof(dt_noiseprofile_bin_header_t) || header->magic != DT_NOISE_PROFILE_BIN_MAGIC)
+    reason = "not a noiseprofile table";
+  else if(header->format != DT_NOISE_PROFILE_BIN_FORMAT || header->version != DT_NOISE_PROFILE_VERSION)
+    reason = "wrong version";
+  else if(source_size >= 0
+          && (header->source_size != (uint64_t)source_size || header->source_mtime != source_mtime))
+    reason = "out of date";
+  else if(size != sizeof(dt_noiseprofile_bin_header_t) + sizeof(dt_noiseprofile_bin_model_t) * header->n_models
+                      + sizeof(dt_noiseprofile_bin_profile_t) * header->n_profiles + header->strings_size
+          || header->strings_size == 0 || _bin_strings(header)[header->strings_size - 1] != '\0')
+    reason = "truncated";
+  else
+  {
+    // check all offsets once, so the lookups don't have to
+    const dt_noiseprofile_bin_model_t *models = _bin_models(header);
+    const dt_noiseprofile_bin_profile_t *profiles = _bin_profiles(header);
+    for(uint32_t k = 0; k < header->n_models && !reason; k++)
+      if(models[k].maker >= header->strings_size || models[k].model >= header->strings_size
+         || models[k].first_profile > header->n_profiles
+         || models[k].n_profiles > header->n_profiles - models[k].first_profile)
+        reason = "corrupt";
+    for(uint32_t k = 0; k < header->n_profiles && !reason; k++)
+      if(profiles[k].name >= header->strings_size) reason = "corrupt";
+  }
+
+  if(reason)
+  {
+    dt_print(DT_DEBUG_CONTROL, "[noiseprofile] not using `%s': %s\n", filename, reason);
+    g_mapped_file_unref(mapped);
+    return NULL;
+  }
+
+  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] mapped %u profiles of %u models from `%s'\n", header->n_profiles,
+           header->n_models, filename);
+  return mapped;
+}
+
+// called with _noiseprofile_lock held
+static void _noiseprofile_load()
+{
+  char filename[PATH_MAX] = { 0 };
+
+  if(_noiseprofile_alternative)
+  {
+    // a user supplied file is taken as it is, a compiled table or json
+    _noiseprofile_mapped = _noiseprofile_map(_noiseprofile_alternative, -1, 0);
+    if(!_noiseprofile_mapped) darktable.noiseprofile_parser = _noiseprofile_parse(_noiseprofile_alternative);
+    return;
+  }
+
+  // TODO: shall we look for profiles in the user config dir?
+  char datadir[PATH_MAX] = { 0 };
+  dt_loc_get_datadir(datadir, sizeof(datadir));
+
+  // the table only counts as long as it belongs to the installed json
+  snprintf(filename, sizeof(filename), "%s/%s", datadir, "noiseprofiles.json");
+  GStatBuf statbuf;
+  const gboolean found = !g_stat(filename, &statbuf);
+  const goffset source_size = found ? statbuf.st_size : -1;
+  const int64_t source_mtime = found ? (int64_t)statbuf.st_mtime : 0;
+
+  char binname[PATH_MAX] = { 0 };
+  snprintf(binname, sizeof(binname), "%s/%s", datadir, "noiseprofiles.bin");
+  _noiseprofile_mapped = _noiseprofile_map(binname, source_size, source_mtime);
+  if(!_noiseprofile_mapped) darktable.noiseprofile_parser = _noiseprofile_parse(filename);
+}
+
 int is_member(gchar** names, char* name)
 {
   while(*names)
@@ -224,8 +369,66 @@ end:
 }
 #undef _ERROR
 
+static GList *_noiseprofile_get_matching_bin(const dt_noiseprofile_bin_header_t *header, const dt_image_t *cimg)
+{
+  const dt_noiseprofile_bin_model_t *models = _bin_models(header);
+  const dt_noiseprofile_bin_profile_t *profiles = _bin_profiles(header);
+  const char *strings = _bin_strings(header);
+  GList *result = NULL;
+
+  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] looking for maker `%s', model `%s'\n", cimg->camera_maker, cimg->camera_model);
+
+  // first model of that name
+  uint32_t lo = 0, hi = header->n_models;
+  while(lo < hi)
+  {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if(strcmp(strings + models[mid].model, cimg->camera_model) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for(uint32_t m = lo; m < header->n_models && !strcmp(strings + models[m].model, cimg->camera_model); m++)
+  {
+    // makers match as in the json, by substring
+    if(!g_strstr_len(cimg->camera_maker, -1, strings + models[m].maker)) continue;
+
+    dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found %s, %u profiles\n", cimg->camera_model, models[m].n_profiles);
+    for(uint32_t k = models[m].first_profile; k < models[m].first_profile + models[m].n_profiles; k++)
+    {
+      dt_noiseprofile_t *profile = (dt_noiseprofile_t *)malloc(sizeof(dt_noiseprofile_t));
+      profile->name = g_strdup(strings + profiles[k].name);
+      profile->maker = g_strdup(cimg->camera_maker);
+      profile->model = g_strdup(cimg->camera_model);
+      profile->iso = profiles[k].iso;
+      for(int c = 0; c < 3; c++)
+      {
+        profile->a[c] = profiles[k].a[c];
+        profile->b[c] = profiles[k].b[c];
+      }
+      result = g_list_prepend(result, profile);
+    }
+    break;
+  }
+
+  return g_list_reverse(result);
+}
+
 GList *dt_noiseprofile_get_matching(const dt_image_t *cimg)
 {
+  g_mutex_lock(&_noiseprofile_lock);
+  if(!_noiseprofile_loaded)
+  {
+    const double start = dt_get_wtime();
+    _noiseprofile_load();
+    _noiseprofile_loaded = TRUE;
+    dt_print(DT_DEBUG_PERF, "[noiseprofile] loading took %.3f s\n", dt_get_wtime() - start);
+  }
+  g_mutex_unlock(&_noiseprofile_lock);
+
+  if(_noiseprofile_mapped) return _noiseprofile_get_matching_bin(_bin_header(_noiseprofile_mapped), cimg);
+
   JsonParser *parser = darktable.noiseprofile_parser;
   JsonReader *reader = NULL;
   GList *result = NULL;
@@ -363,6 +566,175 @@ end:
   return result;
 }
 
+typedef struct _compile_model_t
+{
+  const char *maker, *model;
+  uint32_t order;
+  GList *profiles;
+} _compile_model_t;
+
+static int _compile_model_cmp(const void *a, const void *b)
+{
+  const _compile_model_t *ma = (const _compile_model_t *)a;
+  const _compile_model_t *mb = (const _compile_model_t *)b;
+  const int cmp = strcmp(ma->model, mb->model);
+  if(cmp) return cmp;
+  return ma->order < mb->order ? -1 : ma->order > mb->order;
+}
+
+static uint32_t _compile_string(GByteArray *strings, const char *str)
+{
+  const uint32_t offset = strings->len;
+  g_byte_array_append(strings, (const guint8 *)str, strlen(str) + 1);
+  return offset;
+}
+
+gboolean dt_noiseprofile_compile(const char *json, const char *bin)
+{
+  GStatBuf statbuf;
+  if(g_stat(json, &statbuf)) return FALSE;
+  JsonParser *parser = _noiseprofile_parse(json);
+  if(!parser) return FALSE;
+
+  // collect all models in the order of the json, the file has been verified already
+  GArray *models = g_array_new(FALSE, TRUE, sizeof(_compile_model_t));
+  JsonReader *reader = json_reader_new(json_parser_get_root(parser));
+  json_reader_read_member(reader, "noiseprofiles");
+  const int n_makers = json_reader_count_elements(reader);
+  for(int i = 0; i < n_makers; i++)
+  {
+    json_reader_read_element(reader, i);
+    json_reader_read_member(reader, "maker");
+    const char *maker = json_reader_get_string_value(reader);
+    json_reader_end_member(reader);
+
+    json_reader_read_member(reader, "models");
+    const int n_models = json_reader_count_elements(reader);
+    for(int j = 0; j < n_models; j++)
+    {
+      _compile_model_t model = { maker, NULL, models->len, NULL };
+      json_reader_read_element(reader, j);
+      json_reader_read_member(reader, "model");
+      model.model = json_reader_get_string_value(reader);
+      json_reader_end_member(reader);
+
+      json_reader_read_member(reader, "profiles");
+      const int n_profiles = json_reader_count_elements(reader);
+      for(int k = 0; k < n_profiles; k++)
+      {
+        json_reader_read_element(reader, k);
+        gboolean skip = FALSE;
+        if(json_reader_read_member(reader, "skip")) skip = json_reader_get_boolean_value(reader);
+        json_reader_end_member(reader);
+        if(!skip)
+        {
+          dt_noiseprofile_t *profile = (dt_noiseprofile_t *)calloc(1, sizeof(dt_noiseprofile_t));
+          json_reader_read_member(reader, "name");
+          profile->name = (char *)json_reader_get_string_value(reader);
+          json_reader_end_member(reader);
+          json_reader_read_member(reader, "iso");
+          profile->iso = json_reader_get_double_value(reader);
+          json_reader_end_member(reader);
+          json_reader_read_member(reader, "a");
+          for(int c = 0; c < 3; c++)
+          {
+            json_reader_read_element(reader, c);
+            profile->a[c] = json_reader_get_double_value(reader);
+            json_reader_end_element(reader);
+          }
+          json_reader_end_member(reader);
+          json_reader_read_member(reader, "b");
+          for(int c = 0; c < 3; c++)
+          {
+            json_reader_read_element(reader, c);
+            profile->b[c] = json_reader_get_double_value(reader);
+            json_reader_end_element(reader);
+          }
+          json_reader_end_member(reader);
+          model.profiles = g_list_prepend(model.profiles, profile);
+        }
+        json_reader_end_element(reader);
+      }
+      json_reader_end_member(reader);
+      json_reader_end_element(reader);
+
+      // the same (stable) sort as for the json lookups, so equal isos stay in the same order
+      model.profiles = g_list_sort(g_list_reverse(model.profiles), _sort_by_iso);
+      g_array_append_val(models, model);
+    }
+    json_reader_end_member(reader);
+    json_reader_end_element(reader);
+  }
+  json_reader_end_member(reader);
+
+  qsort(models->data, models->len, sizeof(_compile_model_t), _compile_model_cmp);
+
+  GByteArray *table = g_byte_array_new();
+  GByteArray *profiles = g_byte_array_new();
+  GByteArray *strings = g_byte_array_new();
+  dt_noiseprofile_bin_header_t header = { 0 };
+  header.magic = DT_NOISE_PROFILE_BIN_MAGIC;
+  header.format = DT_NOISE_PROFILE_BIN_FORMAT;
+  header.version = DT_NOISE_PROFILE_VERSION;
+  header.n_models = models->len;
+  header.source_size = statbuf.st_size;
+  header.source_mtime = statbuf.st_mtime;
+
+  GByteArray *model_table = g_byte_array_new();
+  for(guint m = 0; m < models->len; m++)
+  {
+    const _compile_model_t *model = &g_array_index(models, _compile_model_t, m);
+    dt_noiseprofile_bin_model_t entry = { 0 };
+    entry.maker = _compile_string(strings, model->maker);
+    entry.model = _compile_string(strings, model->model);
+    entry.order = model->order;
+    entry.first_profile = header.n_profiles;
+    for(GList *l = model->profiles; l; l = g_list_next(l))
+    {
+      const dt_noiseprofile_t *profile = (dt_noiseprofile_t *)l->data;
+      dt_noiseprofile_bin_profile_t p = { 0 };
+      p.name = _compile_string(strings, profile->name);
+      p.iso = profile->iso;
+      for(int c = 0; c < 3; c++)
+      {
+        p.a[c] = profile->a[c];
+        p.b[c] = profile->b[c];
+      }
+      g_byte_array_append(profiles, (const guint8 *)&p, sizeof(p));
+      entry.n_profiles++;
+    }
+    header.n_profiles += entry.n_profiles;
+    g_byte_array_append(model_table, (const guint8 *)&entry, sizeof(entry));
+    g_list_free_full(model->profiles, free); // the names belong to the parser
+  }
+  header.strings_size = strings->len;
+
+  g_byte_array_append(table, (const guint8 *)&header, sizeof(header));
+  g_byte_array_append(table, model_table->data, model_table->len);
+  g_byte_array_append(table, profiles->data, profiles->len);
+  g_byte_array_append(table, strings->data, strings->len);
+
+  GError *error = NULL;
+  const gboolean ok = g_file_set_contents(bin, (const gchar *)table->data, table->len, &error);
+  if(!ok)
+  {
+    fprintf(stderr, "[noiseprofile] error: can't write `%s': %s\n", bin, error->message);
+    g_error_free(error);
+  }
+  else
+    dt_print(DT_DEBUG_CONTROL, "[noiseprofile] compiled %u profiles of %u models into `%s'\n", header.n_profiles,
+             header.n_models, bin);
+
+  g_byte_array_free(table, TRUE);
+  g_byte_array_free(model_table, TRUE);
+  g_byte_array_free(profiles, TRUE);
+  g_byte_array_free(strings, TRUE);
+  g_array_free(models, TRUE);
+  g_object_unref(reader);
+  g_object_unref(parser);
+  return ok;
+}
+
 void dt_noiseprofile_free(gpointer data)
 {
   dt_noiseprofile_t *profile = (dt_noiseprofile_t *)data;
@@ -36,8 +36,13 @@ dt_noiseprofile_t;
 
 extern const dt_noiseprofile_t dt_noiseprofile_generic;
 
-/** read the noiseprofile file once on startup (kind of)*/
-JsonParser *dt_noiseprofile_init(const char *alternative);
+/** remember the noiseprofile file (NULL for the default one), it is read on the first lookup. the default
+ * is the compiled noiseprofiles.bin as long as it matches noiseprofiles.json, an alternative file can be
+ * either. */
+void dt_noiseprofile_init(const char *alternative);
+
+/** compiles a noiseprofile json into the binary table that can be mapped instead, at build time */
+gboolean dt_noiseprofile_compile(const char *json, const char *bin);
 
 /*
  * returns the noiseprofiles matching the image's exif data.
@@ -30,6 +30,7 @@
 #include "common/heal.h"
 #include "common/nvidia_gpus.h"
 #include "common/opencl_drivers_blacklist.h"
+#include "common/profiling.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -141,6 +142,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   cl->dev[dev].eventlist = NULL;
   cl->dev[dev].eventtags = NULL;
   cl->dev[dev].numevents = 0;
+  cl->dev[dev].trace_pipe = NULL;
+  cl->dev[dev].trace_imgid = -1;
   cl->dev[dev].eventsconsolidated = 0;
   cl->dev[dev].maxevents = 0;
   cl->dev[dev].lostevents = 0;
@@ -341,7 +344,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   }
   // create a command queue for first device the context reported
   cl->dev[dev].cmd_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(
-      cl->dev[dev].context, devid, (darktable.unmuted & DT_DEBUG_PERF) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+      cl->dev[dev].context, devid, ((darktable.unmuted & DT_DEBUG_PERF) || dt_trace_enabled()) ? CL_QUEUE_PROFILING_ENABLE : 0,
+      &err);
   if(err != CL_SUCCESS)
   {
     dt_print(DT_DEBUG_OPENCL, "[opencl_init] could not create command queue for device %d: %d\n", k, err);
@@ -2565,6 +2569,7 @@ cl_event *dt_opencl_events_get_slot(const int devid, const char *tag)
       (*eventtags)[*numevents - 1].tag[0] = '\0';
     }
 
+    (*eventtags)[*numevents - 1].queued = dt_get_wtime();
     (*totalevents)++;
     return (*eventlist) + *numevents - 1;
   }
@@ -2606,6 +2611,7 @@ cl_event *dt_opencl_events_get_slot(const int devid, const char *tag)
   {
     (*eventtags)[*numevents - 1].tag[0] = '\0';
   }
+  (*eventtags)[*numevents - 1].queued = dt_get_wtime();
 
   (*totalevents)++;
   return (*eventlist) + *numevents - 1;
@@ -2683,6 +2689,39 @@ void dt_opencl_events_wait_for(const int devid)
 }
 
 
+void dt_opencl_events_set_owner(const int devid, const char *pipe, const int imgid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return;
+  cl->dev[devid].trace_pipe = pipe;
+  cl->dev[devid].trace_imgid = imgid;
+}
+
+/** records a terminated event in the --trace timeline. the device clock is put on the host timeline through
+    the time the command was queued, as seen from both sides. */
+static void _events_trace(const int devid, cl_event event, const dt_opencl_eventtag_t *tag, const cl_ulong start,
+                          const cl_ulong end)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  cl_ulong queued;
+  if((cl->dlocl->symbols->dt_clGetEventProfilingInfo)(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong),
+                                                      &queued, NULL) != CL_SUCCESS)
+    queued = start;
+
+  // the tags of copies are like "[Write Image (from host to device)]", kernels are named after themselves
+  const gboolean copy = strstr(tag->tag, "host") != NULL;
+  const dt_trace_event_t ev = { .name = tag->tag[0] ? tag->tag : "<?>",
+                                .category = copy ? "copy" : "opencl",
+                                .pipe = cl->dev[devid].trace_pipe,
+                                .imgid = cl->dev[devid].trace_imgid,
+                                .start = tag->queued + (double)(start - queued) * 1e-9,
+                                .end = tag->queued + (double)(end - queued) * 1e-9,
+                                .flags = DT_TRACE_ON_GPU | DT_TRACE_DEVICE
+                                         | (tag->retval != CL_COMPLETE ? DT_TRACE_FAILED : DT_TRACE_NONE),
+                                .devid = devid };
+  dt_trace_event(&ev);
+}
+
 /** Wait for events in eventlist to terminate, check for return status and profiling
 info of events.
 If "reset" is TRUE report summary info (would be CL_COMPLETE or last error code) and
@@ -2706,6 +2745,8 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
 
   if(*eventlist == NULL || *numevents == 0) return CL_COMPLETE; // nothing to do, no news is good news
 
+  const gboolean trace = dt_trace_enabled();
+
   // Wait for command queue to terminate (side effect: might adjust *numevents)
   dt_opencl_events_wait_for(devid);
 
@@ -2733,9 +2774,9 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
     else
       (*totalsuccess)++;
 
-    if(darktable.unmuted & DT_DEBUG_PERF)
+    if((darktable.unmuted & DT_DEBUG_PERF) || trace)
     {
-      // get profiling info of event (only if darktable was called with '-d perf')
+      // get profiling info of event (only if darktable was called with '-d perf' or '--trace')
       cl_ulong start;
       cl_ulong end;
       cl_int errs = (cl->dlocl->symbols->dt_clGetEventProfilingInfo)(
@@ -2745,6 +2786,7 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
       if(errs == CL_SUCCESS && erre == CL_SUCCESS)
       {
         (*eventtags)[k].timelapsed = end - start;
+        if(trace) _events_trace(devid, (*eventlist)[k], (*eventtags) + k, start, end);
       }
       else
       {
@@ -67,6 +67,7 @@ typedef struct dt_opencl_eventtag_t
 {
   cl_int retval;
   cl_ulong timelapsed;
+  double queued; // host time of the enqueue, to put the device timestamps on the trace timeline
   char tag[DT_OPENCL_EVENTNAMELENGTH];
 } dt_opencl_eventtag_t;
 
@@ -108,6 +109,9 @@ typedef struct dt_opencl_device_t
   float benchmark;
   size_t memory_in_use;
   size_t peak_memory;
+  // who the events belong to, for --trace
+  const char *trace_pipe;
+  int trace_imgid;
 } dt_opencl_device_t;
 
 struct dt_bilateral_cl_global_t;
@@ -371,6 +375,9 @@ cl_int dt_opencl_events_flush(const int devid, const int reset);
 /** display OpenCL profiling information. If summary is not 0, try to generate summarized info for kernels */
 void dt_opencl_events_profiling(const int devid, const int aggregated);
 
+/** tells which pipe and image the following events of the device belong to, for --trace */
+void dt_opencl_events_set_owner(const int devid, const char *pipe, const int imgid);
+
 /** utility function to calculate optimal work group dimensions for a given kernel */
 int dt_opencl_local_buffer_opt(const int devid, const int kernel, dt_opencl_local_buffer_t *factors);
 
@@ -497,6 +504,9 @@ static inline int dt_opencl_events_flush(const int devid, const int reset)
 static inline void dt_opencl_events_profiling(const int devid, const int aggregated)
 {
 }
+static inline void dt_opencl_events_set_owner(const int devid, const char *pipe, const int imgid)
+{
+}
 #endif
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
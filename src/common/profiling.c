@@ -17,7 +17,178 @@
 */
 
 #include "common/profiling.h"
+#include "common/darktable.h"
 
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// events are kept per thread and written out once a batch is full
+#define DT_TRACE_BATCH 256
+
+typedef struct dt_trace_record_t
+{
+  dt_trace_event_t ev;
+  char name[64];
+  char category[16];
+  char pipe[32];
+} dt_trace_record_t;
+
+typedef struct dt_trace_batch_t
+{
+  int thread;
+  int count;
+  dt_trace_record_t records[DT_TRACE_BATCH];
+} dt_trace_batch_t;
+
+typedef struct dt_trace_t
+{
+  GMutex lock; // protects the file and the list of batches, taken once per batch
+  FILE *f;
+  gboolean csv;
+  uint64_t events;
+  double t0;
+  int threads;
+  GList *batches; // every thread's dt_trace_batch_t
+} dt_trace_t;
+
+static dt_trace_t _trace = { 0 };
+static __thread dt_trace_batch_t *_trace_batch = NULL;
+
+gboolean dt_trace_init(const char *filename)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    fprintf(stderr, "[trace] can't write `%s'\n", filename);
+    return FALSE;
+  }
+
+  g_mutex_lock(&_trace.lock);
+  if(_trace.f) fclose(_trace.f);
+  _trace.f = f;
+  _trace.csv = g_str_has_suffix(filename, ".csv");
+  _trace.events = 0;
+  _trace.t0 = dt_get_wtime();
+  if(_trace.csv)
+    fprintf(f, "category,name,pipe,imgid,thread,start_us,duration_us,device,tiling,cache,blend,width,height,"
+               "bytes,peak_bytes,failed,devid\n");
+  else
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  g_mutex_unlock(&_trace.lock);
+  return TRUE;
+}
+
+static const char *_trace_device(const uint32_t flags)
+{
+  return (flags & DT_TRACE_ON_GPU) ? "gpu" : (flags & DT_TRACE_ON_CPU) ? "cpu" : "";
+}
+
+static const char *_trace_cache(const uint32_t flags)
+{
+  return (flags & DT_TRACE_DISK_CACHE_HIT) ? "disk" : (flags & DT_TRACE_CACHE_HIT) ? "hit" : "miss";
+}
+
+static const char *_trace_blend(const uint32_t flags)
+{
+  return (flags & DT_TRACE_BLEND_GPU) ? "gpu" : (flags & DT_TRACE_BLEND_CPU) ? "cpu" : "";
+}
+
+// called with the lock held
+static void _trace_write(const dt_trace_record_t *r, const int thread)
+{
+  const dt_trace_event_t *ev = &r->ev;
+  const double start_us = (ev->start - _trace.t0) * 1e6;
+  const double duration_us = MAX(ev->end - ev->start, 0.0) * 1e6;
+  const int devid = (ev->flags & DT_TRACE_DEVICE) ? ev->devid : -1;
+
+  if(_trace.csv)
+  {
+    fprintf(_trace.f, "%s,%s,%s,%d,%d,%.0f,%.0f,%s,%d,%s,%s,%d,%d,%zu,%zu,%d,%d\n", r->category, r->name, r->pipe,
+            ev->imgid, thread, start_us, duration_us, _trace_device(ev->flags),
+            (ev->flags & DT_TRACE_TILING) ? 1 : 0, _trace_cache(ev->flags), _trace_blend(ev->flags), ev->width,
+            ev->height, ev->bytes, ev->peak_bytes, (ev->flags & DT_TRACE_FAILED) ? 1 : 0, devid);
+  }
+  else
+  {
+    // complete events ("ph":"X"), one row per thread in the viewer and one per opencl device, far away from
+    // the thread numbers. names are module operations, kernel names and other plain identifiers, nothing
+    // which would need escaping.
+    const int tid = devid >= 0 ? 1000 + devid : thread;
+    fprintf(_trace.f,
+            "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f,"
+            "\"args\":{\"pipe\":\"%s\",\"imgid\":%d,\"device\":\"%s\",\"tiling\":%s,\"cache\":\"%s\","
+            "\"blend\":\"%s\",\"width\":%d,\"height\":%d,\"bytes\":%zu,\"peak_bytes\":%zu,\"failed\":%s}}",
+            _trace.events ? ",\n" : "", r->name, r->category, (int)getpid(), tid, start_us, duration_us, r->pipe,
+            ev->imgid, _trace_device(ev->flags), (ev->flags & DT_TRACE_TILING) ? "true" : "false",
+            _trace_cache(ev->flags), _trace_blend(ev->flags), ev->width, ev->height, ev->bytes, ev->peak_bytes,
+            (ev->flags & DT_TRACE_FAILED) ? "true" : "false");
+  }
+  _trace.events++;
+}
+
+// called with the lock held
+static void _trace_flush_batch(dt_trace_batch_t *batch)
+{
+  if(_trace.f)
+    for(int k = 0; k < batch->count; k++) _trace_write(batch->records + k, batch->thread);
+  batch->count = 0;
+}
+
+void dt_trace_cleanup(void)
+{
+  g_mutex_lock(&_trace.lock);
+  for(GList *l = _trace.batches; l; l = g_list_next(l)) _trace_flush_batch((dt_trace_batch_t *)l->data);
+  if(_trace.f)
+  {
+    if(!_trace.csv) fprintf(_trace.f, "\n]}\n");
+    fclose(_trace.f);
+    _trace.f = NULL;
+  }
+  // the batches stay around, threads still hold on to them
+  g_mutex_unlock(&_trace.lock);
+}
+
+gboolean dt_trace_enabled(void)
+{
+  // unlocked peek, a stale answer only costs one event
+  return _trace.f != NULL;
+}
+
+void dt_trace_event(const dt_trace_event_t *ev)
+{
+  if(!dt_trace_enabled()) return;
+
+  dt_trace_batch_t *batch = _trace_batch;
+  if(!batch)
+  {
+    batch = calloc(1, sizeof(dt_trace_batch_t));
+    if(!batch) return;
+    g_mutex_lock(&_trace.lock);
+    batch->thread = _trace.threads++;
+    _trace.batches = g_list_prepend(_trace.batches, batch);
+    g_mutex_unlock(&_trace.lock);
+    _trace_batch = batch;
+  }
+
+  dt_trace_record_t *r = batch->records + batch->count;
+  r->ev = *ev;
+  g_strlcpy(r->name, ev->name ? ev->name : "", sizeof(r->name));
+  g_strlcpy(r->category, ev->category ? ev->category : "", sizeof(r->category));
+  g_strlcpy(r->pipe, ev->pipe ? ev->pipe : "", sizeof(r->pipe));
+  r->ev.name = r->ev.category = r->ev.pipe = NULL;
+
+  if(++batch->count == DT_TRACE_BATCH)
+  {
+    g_mutex_lock(&_trace.lock);
+    _trace_flush_batch(batch);
+    g_mutex_unlock(&_trace.lock);
+  }
+}
+
+#ifdef USE_DARKTABLE_PROFILING
 dt_timer_t *dt_timer_start_with_name(const char *file, const char *function, const char *description)
 {
   dt_timer_t *t = g_malloc(sizeof(dt_timer_t));
@@ -38,6 +209,8 @@ void dt_timer_stop_with_name(dt_timer_t *t)
   g_timer_destroy(t->timer);
   g_free(t);
 }
+#endif
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -18,7 +18,9 @@
 
 #pragma once
 
-#include "gui/gtk.h"
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
 #ifdef USE_DARKTABLE_PROFILING
@@ -51,6 +53,57 @@ dt_timer_t *dt_timer_start_with_name(const char *file, const char *function, con
 void dt_timer_stop_with_name(dt_timer_t *);
 #endif
 
+/**
+ * structured trace of where the time goes, enabled with --trace <file>.
+ * every module run of a pixelpipe, every pipe run and every export is recorded as one event, written as
+ * chrome trace json (open in chrome://tracing or perfetto) or, if the file name ends in .csv, as one csv
+ * line per event, to be aggregated over whole batch runs.
+ *
+ * below the modules the same file gets the timeline of the work itself: every tile of a tiled module
+ * ("tile"), every opencl kernel ("opencl") and host <-> device copy ("copy") with the device's own
+ * timestamps, and every time a module or a whole pipe had to fall back from opencl to the cpu ("fallback").
+ * without opencl only the host side events are there, so cpu-only machines can be profiled the same way.
+ *
+ * events are collected per thread and written in batches, recording one does not take a lock.
+ */
+typedef enum dt_trace_flags_t
+{
+  DT_TRACE_NONE = 0,
+  DT_TRACE_CACHE_HIT = 1 << 0,      // output was still in the pixelpipe cache
+  DT_TRACE_DISK_CACHE_HIT = 1 << 1, // output was read back from the disk cache
+  DT_TRACE_ON_CPU = 1 << 2,
+  DT_TRACE_ON_GPU = 1 << 3,
+  DT_TRACE_TILING = 1 << 4,
+  DT_TRACE_BLEND_CPU = 1 << 5,
+  DT_TRACE_BLEND_GPU = 1 << 6,
+  DT_TRACE_FAILED = 1 << 7,
+  DT_TRACE_DEVICE = 1 << 8          // timed by the opencl device devid, shown as a row of its own
+} dt_trace_flags_t;
+
+typedef struct dt_trace_event_t
+{
+  const char *name;     // module operation, or what else has been timed
+  const char *category; // "module", "pipe", "export", "tile", "opencl", "copy", "fallback"
+  const char *pipe;     // pixelpipe type, or mime type of an export, may be NULL
+  int32_t imgid;
+  double start, end;    // dt_get_wtime()
+  uint32_t flags;       // dt_trace_flags_t
+  int width, height;    // size of the output
+  size_t bytes;         // size of the output buffer
+  size_t peak_bytes;    // estimated working memory, including what tiling would need
+  int devid;            // opencl device, with DT_TRACE_DEVICE
+} dt_trace_event_t;
+
+/** starts writing the trace to filename. returns TRUE on success. */
+gboolean dt_trace_init(const char *filename);
+/** writes out what all threads have collected so far, finishes and closes the trace file. to be called once
+ * no more events are recorded. */
+void dt_trace_cleanup(void);
+/** whether events are recorded at all, so callers can skip collecting them. */
+gboolean dt_trace_enabled(void);
+/** records one event, may be called from any thread. the strings are copied. */
+void dt_trace_event(const dt_trace_event_t *ev);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -473,33 +473,6 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
-void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
-{
-  gboolean selected = FALSE;
-
-  /* write current history changes so nothing gets lost, do that only in the darkroom as there is nothing to
-     be
-     save when in the lighttable (and it would write over current history stack) */
-  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
-
-  /* for each selected image apply style */
-  sqlite3_stmt *stmt;
-  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
-                              -1, &stmt, NULL);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int imgid = sqlite3_column_int(stmt, 0);
-    dt_styles_apply_to_image(name, duplicate, imgid);
-    selected = TRUE;
-  }
-  sqlite3_finalize(stmt);
-  dt_undo_end_group(darktable.undo);
-
-  if(!selected) dt_control_log(_("no image selected!"));
-}
-
 void dt_styles_create_from_selection()
 {
   gboolean selected = FALSE;
@@ -651,10 +624,140 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
   }
 }
 
+// reads the items of the style as they are applied, in order
+static GList *_styles_get_apply_items(const int id)
+{
+  GList *items = NULL;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, module, operation, op_params, enabled, "
+                              "blendop_params, blendop_version, multi_priority, multi_name, iop_order "
+                              "FROM data.style_items WHERE styleid=?1 "
+                              "ORDER BY num",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)calloc(1, sizeof(dt_style_item_t));
+
+    style_item->num = sqlite3_column_int(stmt, 0);
+    style_item->selimg_num = 0;
+    style_item->enabled = sqlite3_column_int(stmt, 4);
+    style_item->multi_priority = sqlite3_column_int(stmt, 7);
+    style_item->name = NULL;
+    style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
+    style_item->module_version = sqlite3_column_int(stmt, 1);
+    style_item->blendop_version = sqlite3_column_int(stmt, 6);
+    style_item->params_size = sqlite3_column_bytes(stmt, 3);
+    style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
+    style_item->iop_order = sqlite3_column_double(stmt, 9);
+
+    const void *params = sqlite3_column_blob(stmt, 3);
+    if(params)
+    {
+      style_item->params = malloc(style_item->params_size);
+      memcpy(style_item->params, params, style_item->params_size);
+    }
+    const void *blendop_params = sqlite3_column_blob(stmt, 5);
+    if(blendop_params)
+    {
+      style_item->blendop_params = malloc(style_item->blendop_params_size);
+      memcpy(style_item->blendop_params, blendop_params, style_item->blendop_params_size);
+    }
+
+    items = g_list_prepend(items, style_item);
+  }
+  sqlite3_finalize(stmt);
+  return g_list_reverse(items);
+}
+
+static void _styles_apply_items(dt_develop_t *dev, GList *items)
+{
+  GList *modules_used = NULL;
+
+  // go through all entries in style
+  for(GList *l = g_list_first(items); l; l = g_list_next(l))
+    dt_styles_apply_style_item(dev, (dt_style_item_t *)l->data, &modules_used, FALSE);
+
+  g_list_free(modules_used);
+}
+
+static gboolean _styles_batch_apply(dt_develop_t *dev, const int32_t imgid, void *worker_data, void *user_data)
+{
+  _styles_apply_items(dev, (GList *)user_data);
+  dt_ioppr_check_iop_order(dev, imgid, "dt_styles_apply_to_selection");
+  return TRUE;
+}
+
+void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
+{
+  /* write current history changes so nothing gets lost, do that only in the darkroom as there is nothing to
+     be
+     save when in the lighttable (and it would write over current history stack) */
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  GList *imgs = NULL;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW) imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+  imgs = g_list_reverse(imgs);
+
+  if(!imgs)
+  {
+    dt_control_log(_("no image selected!"));
+    return;
+  }
+
+  const int id = dt_styles_get_id_by_name(name);
+  if(id == 0)
+  {
+    g_list_free(imgs);
+    return;
+  }
+
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+
+  /* check if we should make duplicates before applying style, they get the style instead of the originals */
+  if(duplicate)
+  {
+    for(GList *l = imgs; l; l = g_list_next(l))
+    {
+      const int32_t imgid = GPOINTER_TO_INT(l->data);
+      const int32_t newimgid = dt_image_duplicate(imgid);
+      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
+      l->data = GINT_TO_POINTER(newimgid);
+    }
+    imgs = g_list_remove_all(imgs, GINT_TO_POINTER(-1));
+  }
+
+  /* add tag, before the xmp files get written */
+  guint tagid = 0;
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+  dt_tag_new(ntag, &tagid);
+  dt_tag_attach_images(tagid, imgs);
+
+  // the items are read once and applied to all images
+  GList *items = _styles_get_apply_items(id);
+  const dt_history_batch_t batch = { .apply = _styles_batch_apply, .user_data = items };
+  dt_history_batch_run(&batch, imgs);
+  g_list_free_full(items, dt_style_item_free);
+
+  dt_undo_end_group(darktable.undo);
+
+  /* if we have created duplicates, reset collected images */
+  if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+
+  g_list_free(imgs);
+}
+
 void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgid)
 {
   int id = 0;
-  sqlite3_stmt *stmt;
   int32_t newimgid;
 
   if((id = dt_styles_get_id_by_name(name)) != 0)
@@ -669,8 +772,6 @@ void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgi
       newimgid = imgid;
 
     // now deal with the history
-    GList *modules_used = NULL;
-
     dt_develop_t _dev_dest = { 0 };
 
     dt_develop_t *dev_dest = &_dev_dest;
@@ -687,36 +788,9 @@ void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgi
 
     dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
 
-    // go through all entries in style
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT num, module, operation, op_params, enabled, "
-                                "blendop_params, blendop_version, multi_priority, multi_name, iop_order "
-                                "FROM data.style_items WHERE styleid=?1 "
-                                "ORDER BY num",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      dt_style_item_t style_item = { 0 };
-
-      style_item.num = sqlite3_column_int(stmt, 0);
-      style_item.selimg_num = 0;
-      style_item.enabled = sqlite3_column_int(stmt, 4);
-      style_item.multi_priority = sqlite3_column_int(stmt, 7);
-      style_item.name = NULL;
-      style_item.operation = (char *)sqlite3_column_text(stmt, 2);
-      style_item.multi_name = (char *)sqlite3_column_text(stmt, 8);
-      style_item.module_version = sqlite3_column_int(stmt, 1);
-      style_item.blendop_version = sqlite3_column_int(stmt, 6);
-      style_item.params = (void *)sqlite3_column_blob(stmt, 3);
-      style_item.blendop_params = (void *)sqlite3_column_blob(stmt, 5);
-      style_item.params_size = sqlite3_column_bytes(stmt, 3);
-      style_item.blendop_params_size = sqlite3_column_bytes(stmt, 5);
-      style_item.iop_order = sqlite3_column_double(stmt, 9);
-
-      dt_styles_apply_style_item(dev_dest, &style_item, &modules_used, FALSE);
-    }
-    sqlite3_finalize(stmt);
+    GList *items = _styles_get_apply_items(id);
+    _styles_apply_items(dev_dest, items);
+    g_list_free_full(items, dt_style_item_free);
 
     dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
 
@@ -735,8 +809,6 @@ void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgi
 
     dt_dev_cleanup(dev_dest);
 
-    g_list_free(modules_used);
-
     /* add tag */
     guint tagid = 0;
     gchar ntag[512] = { 0 };
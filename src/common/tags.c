@@ -82,6 +82,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t *d
     }
 
     dt_tag_update_used_tags();
+    dt_collection_image_changed();
     dt_collection_update_query(darktable.collection);
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   }
@@ -341,6 +342,7 @@ static void _attach_tag(guint tagid, gint imgid, gboolean undo_actif)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed();
 
   if(undo_actif)
   {
@@ -379,6 +381,41 @@ void dt_tag_attach(guint tagid, gint imgid)
   }
 }
 
+void dt_tag_attach_images(guint tagid, GList *imgs)
+{
+  GList *undo = NULL;
+  sqlite3_stmt *stmt;
+
+  // one undo entry, one statement and one collection update for the whole batch
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.tagged_images (imgid, tagid) VALUES (?1, ?2)", -1,
+                              &stmt, NULL);
+  for(GList *l = g_list_first(imgs); l; l = g_list_next(l))
+  {
+    const gint imgid = GPOINTER_TO_INT(l->data);
+    if(imgid <= 0 || _tag_is_attached(tagid, imgid)) continue;
+
+    undo = g_list_prepend(undo, _get_tags(imgid, tagid, TRUE));
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  if(!undo) return;
+
+  dt_collection_image_changed();
+  dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
+  dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, (dt_undo_data_t *)undo, &_pop_undo, _tags_undo_data_free);
+  dt_undo_end_group(darktable.undo);
+
+  dt_tag_update_used_tags();
+
+  dt_collection_update_query(darktable.collection);
+}
+
 void dt_tag_attach_list(GList *tags, gint imgid)
 {
   GList *child = NULL;
@@ -454,6 +491,7 @@ void _detach_tag(guint tagid, gint imgid, gboolean undo_actif)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed();
 
   if(undo_actif)
   {
@@ -484,6 +522,7 @@ void dt_tag_detach_by_string(const char *name, gint imgid)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  dt_collection_image_changed();
   dt_tag_update_used_tags();
 
   dt_collection_update_query(darktable.collection);
@@ -0,0 +1,135 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/worker_pool.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "control/conf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// rough number of full size float buffers a pipe keeps alive at the same time (input, output and cache lines)
+#define DT_WORKER_POOL_PIPE_BUFFERS 3
+
+void dt_worker_pool_init(dt_worker_pool_t *pool, const int num_jobs, const int num_workers, int memory_limit)
+{
+  memset(pool, 0, sizeof(dt_worker_pool_t));
+  pool->num_jobs = num_jobs;
+  pool->num_workers = MAX(MIN(num_workers, num_jobs), 1);
+  pool->memory = (size_t *)calloc(MAX(num_jobs, 1), sizeof(size_t));
+
+  // all pipes together have to stay below the memory limit, by default the one configured for tiling
+  if(memory_limit < 0) memory_limit = dt_conf_get_int("host_memory_limit");
+  if(memory_limit > 0)
+    dt_conf_set_override_int("host_memory_limit", MAX(memory_limit / pool->num_workers, 500));
+  pool->memory_limit = (size_t)MAX(memory_limit, 0) * 1024 * 1024;
+  pool->omp_threads = MAX(darktable.num_openmp_threads / pool->num_workers, 1);
+
+  // until we know better
+  for(int k = 0; k < num_jobs; k++) pool->memory[k] = pool->memory_limit / pool->num_workers;
+
+  g_mutex_init(&pool->lock);
+  g_cond_init(&pool->done);
+}
+
+void dt_worker_pool_cleanup(dt_worker_pool_t *pool)
+{
+  free(pool->memory);
+  pool->memory = NULL;
+  g_cond_clear(&pool->done);
+  g_mutex_clear(&pool->lock);
+}
+
+void dt_worker_pool_set_image_size(dt_worker_pool_t *pool, const int job, const size_t width, const size_t height)
+{
+  if(width == 0 || height == 0) return;
+  pool->memory[job] = width * height * 4 * sizeof(float) * DT_WORKER_POOL_PIPE_BUFFERS;
+}
+
+static void *_worker(void *data)
+{
+  dt_worker_pool_t *pool = (dt_worker_pool_t *)data;
+  dt_pthread_setname(pool->name);
+#ifdef _OPENMP
+  // the pipes running next to each other share the cores
+  omp_set_num_threads(pool->omp_threads);
+#endif
+
+  void *worker = pool->init ? pool->init(pool->data) : NULL;
+  if(pool->init && !worker) return NULL;
+
+  while(TRUE)
+  {
+    g_mutex_lock(&pool->lock);
+    if(pool->next >= pool->num_jobs)
+    {
+      g_mutex_unlock(&pool->lock);
+      break;
+    }
+    const int job = pool->next++;
+    const size_t memory = pool->memory[job];
+    while(pool->memory_limit && pool->in_flight > 0 && pool->memory_used + memory > pool->memory_limit)
+      g_cond_wait(&pool->done, &pool->lock);
+    pool->memory_used += memory;
+    pool->in_flight++;
+    g_mutex_unlock(&pool->lock);
+
+    pool->run(pool->data, worker, job);
+
+    g_mutex_lock(&pool->lock);
+    pool->memory_used -= memory;
+    pool->in_flight--;
+    g_cond_broadcast(&pool->done);
+    g_mutex_unlock(&pool->lock);
+  }
+
+  if(pool->cleanup) pool->cleanup(pool->data, worker);
+  return NULL;
+}
+
+void dt_worker_pool_run(dt_worker_pool_t *pool, const char *name, void *(*init)(void *data),
+                        void (*run)(void *data, void *worker, const int job),
+                        void (*cleanup)(void *data, void *worker), void *data)
+{
+  pool->name = name;
+  pool->init = init;
+  pool->run = run;
+  pool->cleanup = cleanup;
+  pool->data = data;
+  pool->next = 0;
+
+  pthread_t *threads = (pthread_t *)calloc(pool->num_workers, sizeof(pthread_t));
+  int started = 0;
+  for(int k = 0; k < pool->num_workers; k++)
+  {
+    if(dt_pthread_create(&threads[k], _worker, pool)) break;
+    started++;
+  }
+  if(started == 0) _worker(pool); // do the work ourselves then
+  for(int k = 0; k < started; k++) pthread_join(threads[k], NULL);
+  free(threads);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
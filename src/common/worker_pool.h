@@ -0,0 +1,74 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+/**
+ * runs a list of pipe jobs on several threads, the way darktable-cli --jobs and darktable-generate-cache do.
+ *
+ * the estimated memory of all jobs in flight stays below a limit, a job only starts when its estimate fits next
+ * to the running ones. a single job is always let through, even if it is bigger than the whole limit, tiling
+ * has to deal with it then. the cores are split evenly between the workers.
+ */
+typedef struct dt_worker_pool_t
+{
+  int num_jobs;
+  int num_workers;
+  size_t *memory;      // estimated footprint per job
+  size_t memory_limit; // for all jobs in flight together, 0 means no limit
+  int omp_threads;     // per worker
+
+  // private
+  GMutex lock;
+  GCond done;
+  int next;
+  int in_flight;
+  size_t memory_used;
+  const char *name;
+  void *(*init)(void *data);
+  void (*run)(void *data, void *worker, const int job);
+  void (*cleanup)(void *data, void *worker);
+  void *data;
+} dt_worker_pool_t;
+
+/**
+ * sets up num_jobs jobs for at most num_workers workers, which share memory_limit (in MB, < 0 for
+ * host_memory_limit). every worker's pipe gets its share as tiling limit, for this run only, darktablerc keeps
+ * the user's limit.
+ */
+void dt_worker_pool_init(dt_worker_pool_t *pool, const int num_jobs, const int num_workers, int memory_limit);
+void dt_worker_pool_cleanup(dt_worker_pool_t *pool);
+
+/** estimates the memory of a job from its image size, images we know nothing about take an equal share. */
+void dt_worker_pool_set_image_size(dt_worker_pool_t *pool, const int job, const size_t width, const size_t height);
+
+/**
+ * runs all jobs and returns when they are done. init (optional) gives every worker its private state, a worker
+ * which gets NULL from it doesn't take any jobs. run processes a job and must not touch the pool. if no thread
+ * can be started the caller does all the work itself.
+ */
+void dt_worker_pool_run(dt_worker_pool_t *pool, const char *name, void *(*init)(void *data),
+                        void (*run)(void *data, void *worker, const int job),
+                        void (*cleanup)(void *data, void *worker), void *data);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,54 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compiles noiseprofiles.json into the table darktable maps at runtime, see common/noiseprofiles.c.
+// run during the build, it doesn't need a full dt_init().
+
+#include "common/darktable.h"
+#include "common/noiseprofiles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char *arg[])
+{
+  int k = 1;
+  if(argc > k && !strcmp(arg[k], "-v"))
+  {
+    darktable.unmuted |= DT_DEBUG_CONTROL;
+    k++;
+  }
+
+  if(argc - k != 2)
+  {
+    fprintf(stderr, "usage: %s [-v] <noiseprofiles.json> <noiseprofiles.bin>\n", arg[0]);
+    exit(1);
+  }
+
+  if(!dt_noiseprofile_compile(arg[k], arg[k + 1]))
+  {
+    fprintf(stderr, "%s: can't compile `%s'\n", arg[0], arg[k]);
+    exit(1);
+  }
+
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -139,6 +139,15 @@ static inline void dt_conf_set_string(const char *name, const char *val)
   dt_pthread_mutex_unlock(&darktable.conf->mutex);
 }
 
+/** set a value for this session only, like --conf on the command line. it wins over darktablerc and is not
+ * written back to it. */
+static inline void dt_conf_set_override_int(const char *name, int val)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  g_hash_table_replace(darktable.conf->override_entries, g_strdup(name), g_strdup_printf("%d", val));
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+}
+
 static inline int dt_conf_get_int(const char *name)
 {
   dt_pthread_mutex_lock(&darktable.conf->mutex);
@@ -151,9 +151,6 @@ void dt_control_shutdown(dt_control_t *s)
   dt_pthread_mutex_unlock(&s->cond_mutex);
   pthread_cond_broadcast(&s->cond);
 
-  /* first wait for kick_on_workers_thread */
-  pthread_join(s->kick_on_workers_thread, NULL);
-
   int k;
   for(k = 0; k < s->num_threads; k++)
     // pthread_kill(s->thread[k], 9);
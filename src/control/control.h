@@ -173,8 +173,15 @@ typedef struct dt_control_t
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
-  pthread_t *thread, kick_on_workers_thread;
+  pthread_t *thread;
   dt_job_t **job;
+  struct dt_control_job_deque_t *deques; // one per worker, see dt_control_add_job_local()
+  uint64_t job_generation;               // bumped under cond_mutex whenever a job is added
+
+  // time jobs spent waiting in each queue, protected by queue_mutex
+  double queue_wait[DT_JOB_QUEUE_MAX], queue_wait_max[DT_JOB_QUEUE_MAX];
+  size_t queue_wait_count[DT_JOB_QUEUE_MAX];
+  size_t jobs_stolen;
 
   GList *queues[DT_JOB_QUEUE_MAX];
   size_t queue_length[DT_JOB_QUEUE_MAX];
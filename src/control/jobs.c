@@ -24,12 +24,7 @@
 #include "control/control.h"
 
 #define DT_CONTROL_FG_PRIORITY 4
-#define DT_CONTROL_MAX_JOBS 30
 
-/* the queue can have scheduled jobs but all
-    the workers are sleeping, so this kicks the workers
-    on timed interval.
-*/
 typedef struct worker_thread_parameters_t
 {
   dt_control_t *self;
@@ -50,6 +45,8 @@ typedef struct _dt_job_t
   dt_job_state_t state;
   unsigned char priority;
   dt_job_queue_t queue;
+  gboolean local;     // sub-job in a worker's deque, see dt_control_add_job_local()
+  double queued_time; // when the job was added to a queue, for wait time statistics
 
   dt_job_state_change_callback state_changed_cb;
 
@@ -58,6 +55,15 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
+/* every worker owns a deque of sub-jobs it spawned. the owner takes the newest
+   job from the tail while its data is still hot, idle workers steal the oldest
+   from the head. */
+typedef struct dt_control_job_deque_t
+{
+  dt_pthread_mutex_t mutex;
+  GQueue jobs;
+} dt_control_job_deque_t;
+
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
@@ -228,7 +234,51 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
-static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+// wake up all workers. the generation counter makes sure a worker which just
+// found all queues empty doesn't go to sleep and miss this job.
+static void dt_control_notify_workers(dt_control_t *control)
+{
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  control->job_generation++;
+  pthread_cond_broadcast(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+}
+
+static uint64_t dt_control_get_job_generation(dt_control_t *control)
+{
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  const uint64_t generation = control->job_generation;
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+  return generation;
+}
+
+// sleep until new jobs have been added since generation was read, or we shut down.
+static void dt_control_wait_for_jobs(dt_control_t *control, const uint64_t generation)
+{
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  while(control->job_generation == generation && dt_control_running())
+    dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+}
+
+// needs queue_mutex to be held
+static void dt_control_job_account_wait(dt_control_t *control, _dt_job_t *job)
+{
+  const double wait = dt_get_wtime() - job->queued_time;
+  control->queue_wait[job->queue] += wait;
+  control->queue_wait_max[job->queue] = MAX(control->queue_wait_max[job->queue], wait);
+  control->queue_wait_count[job->queue]++;
+}
+
+static _dt_job_t *dt_control_job_deque_pop(dt_control_job_deque_t *deque, const gboolean steal)
+{
+  dt_pthread_mutex_lock(&deque->mutex);
+  _dt_job_t *job = steal ? (_dt_job_t *)g_queue_pop_head(&deque->jobs) : (_dt_job_t *)g_queue_pop_tail(&deque->jobs);
+  dt_pthread_mutex_unlock(&deque->mutex);
+  return job;
+}
+
+static _dt_job_t *dt_control_schedule_global_job(dt_control_t *control)
 {
   /*
    * job scheduling works like this:
@@ -278,6 +328,7 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
 
   // and place it in scheduled job array (for job deduping)
   control->job[dt_control_get_threadid()] = job;
+  dt_control_job_account_wait(control, job);
 
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
@@ -291,6 +342,43 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   return job;
 }
 
+static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+{
+  const int32_t threadid = dt_control_get_threadid();
+
+  // gui actions go first. after that we finish the sub-jobs this worker spawned itself
+  // before taking on anything new.
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  const gboolean gui_waiting = control->queues[DT_JOB_QUEUE_USER_FG] != NULL;
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  _dt_job_t *job = NULL;
+  if(!gui_waiting) job = dt_control_job_deque_pop(&control->deques[threadid], FALSE);
+
+  if(!job)
+  {
+    job = dt_control_schedule_global_job(control);
+    if(job) return job;
+  }
+
+  // nothing to do for us, help the others:
+  gboolean stolen = FALSE;
+  for(int k = 1; !job && k < control->num_threads; k++)
+  {
+    job = dt_control_job_deque_pop(&control->deques[(threadid + k) % control->num_threads], TRUE);
+    stolen = job != NULL;
+  }
+  if(!job) return NULL;
+
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  control->job[threadid] = job;
+  dt_control_job_account_wait(control, job);
+  if(stolen) control->jobs_stolen++;
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  return job;
+}
+
 static void dt_control_job_execute(_dt_job_t *job)
 {
   dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
@@ -325,11 +413,15 @@ static int32_t dt_control_run_job(dt_control_t *control)
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
   // remove the job from scheduled job array (for job deduping)
+  const gboolean export_done = job->queue == DT_JOB_QUEUE_USER_EXPORT && !job->local;
   dt_pthread_mutex_lock(&control->queue_mutex);
   control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
+  if(export_done) control->export_scheduled = FALSE;
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
+  // the next export might be waiting for this one
+  if(export_done) dt_control_notify_workers(control);
+
   // and free it
   dt_control_job_dispose(job);
 
@@ -364,9 +456,7 @@ int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t re
 
   dt_pthread_mutex_unlock(&control->res_mutex);
 
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  dt_control_notify_workers(control);
 
   return 0;
 }
@@ -391,6 +481,7 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   }
 
   job->queue = queue_id;
+  job->queued_time = dt_get_wtime();
 
   _dt_job_t *job_for_disposal = NULL;
 
@@ -479,9 +570,7 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  dt_control_notify_workers(control);
 
   // dispose of dropped job, if any
   dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
@@ -491,6 +580,35 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 }
 
 static __thread int threadid = -1;
+static __thread int worker_deque = -1; // only set for the generic workers, not the reserved ones
+
+int dt_control_add_job_local(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t *job)
+{
+  // only the generic workers own a deque. everybody else goes through the global queues.
+  if(worker_deque < 0 || !control->running || ((unsigned int)queue_id) >= DT_JOB_QUEUE_MAX || !job)
+    return dt_control_add_job(control, queue_id, job);
+
+  job->queue = queue_id;
+  job->local = TRUE;
+  job->priority = 0;
+  job->queued_time = dt_get_wtime();
+
+  dt_print(DT_DEBUG_CONTROL, "[add_job_local] %d | ", worker_deque);
+  dt_control_job_print(job);
+  dt_print(DT_DEBUG_CONTROL, "\n");
+
+  dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+
+  dt_control_job_deque_t *deque = &control->deques[worker_deque];
+  dt_pthread_mutex_lock(&deque->mutex);
+  g_queue_push_tail(&deque->jobs, job);
+  dt_pthread_mutex_unlock(&deque->mutex);
+
+  // idle workers may steal it
+  dt_control_notify_workers(control);
+
+  return 0;
+}
 
 int32_t dt_control_get_threadid()
 {
@@ -520,14 +638,13 @@ static void *dt_control_work_res(void *ptr)
   while(dt_control_running())
   {
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid_res);
+    const uint64_t generation = dt_control_get_job_generation(s);
     if(dt_control_run_job_res(s, threadid_res) < 0)
     {
       // wait for a new job.
       int old;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
-      dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
-      dt_pthread_mutex_unlock(&s->cond_mutex);
+      dt_control_wait_for_jobs(s, generation);
       int tmp;
       pthread_setcancelstate(old, &tmp);
     }
@@ -535,20 +652,6 @@ static void *dt_control_work_res(void *ptr)
   return NULL;
 }
 
-static void *dt_control_worker_kicker(void *ptr)
-{
-  dt_control_t *control = (dt_control_t *)ptr;
-  dt_pthread_setname("kicker");
-  while(dt_control_running())
-  {
-    sleep(2);
-    dt_pthread_mutex_lock(&control->cond_mutex);
-    pthread_cond_broadcast(&control->cond);
-    dt_pthread_mutex_unlock(&control->cond_mutex);
-  }
-  return NULL;
-}
-
 static void *dt_control_work(void *ptr)
 {
 #ifdef _OPENMP // need to do this in every thread
@@ -557,6 +660,7 @@ static void *dt_control_work(void *ptr)
   worker_thread_parameters_t *params = (worker_thread_parameters_t *)ptr;
   dt_control_t *control = params->self;
   threadid = params->threadid;
+  worker_deque = params->threadid;
   char name[16] = {0};
   snprintf(name, sizeof(name), "worker %d", threadid);
   dt_pthread_setname(name);
@@ -565,12 +669,11 @@ static void *dt_control_work(void *ptr)
   while(dt_control_running())
   {
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
+    const uint64_t generation = dt_control_get_job_generation(control);
     if(dt_control_run_job(control) < 0)
     {
       // wait for a new job.
-      dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
-      dt_pthread_mutex_unlock(&control->cond_mutex);
+      dt_control_wait_for_jobs(control, generation);
     }
   }
   return NULL;
@@ -612,6 +715,19 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->deques = (dt_control_job_deque_t *)calloc(control->num_threads, sizeof(dt_control_job_deque_t));
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&control->deques[k].mutex, NULL);
+    g_queue_init(&control->deques[k].jobs);
+  }
+  control->job_generation = 0;
+  control->jobs_stolen = 0;
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++)
+  {
+    control->queue_wait[k] = control->queue_wait_max[k] = 0.0;
+    control->queue_wait_count[k] = 0;
+  }
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -624,9 +740,6 @@ void dt_control_jobs_init(dt_control_t *control)
     dt_pthread_create(&control->thread[k], dt_control_work, params);
   }
 
-  /* create queue kicker thread */
-  dt_pthread_create(&control->kick_on_workers_thread, dt_control_worker_kicker, control);
-
   for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++)
   {
     control->job_res[k] = NULL;
@@ -639,8 +752,38 @@ void dt_control_jobs_init(dt_control_t *control)
   }
 }
 
+void dt_control_jobs_print_stats(dt_control_t *control)
+{
+  static const char *queue_names[DT_JOB_QUEUE_MAX]
+      = { "user foreground", "system foreground", "user background", "user export", "system background" };
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++)
+  {
+    const size_t count = control->queue_wait_count[k];
+    dt_print(DT_DEBUG_CONTROL | DT_DEBUG_PERF,
+             "[control_jobs] %-17s %6zu jobs, waited avg %.3fs max %.3fs\n", queue_names[k], count,
+             count ? control->queue_wait[k] / count : 0.0, control->queue_wait_max[k]);
+  }
+  dt_print(DT_DEBUG_CONTROL | DT_DEBUG_PERF, "[control_jobs] %zu sub-jobs stolen by idle workers\n",
+           control->jobs_stolen);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+}
+
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  dt_control_jobs_print_stats(control);
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    // whatever was left over when we shut down won't run anymore
+    _dt_job_t *job;
+    while((job = (_dt_job_t *)g_queue_pop_head(&control->deques[k].jobs)))
+    {
+      dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(job);
+    }
+    dt_pthread_mutex_destroy(&control->deques[k].mutex);
+  }
+  free(control->deques);
   free(control->job);
   free(control->thread);
 }
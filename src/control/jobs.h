@@ -25,6 +25,8 @@
 #include <stddef.h>
 
 #define DT_CONTROL_DESCRIPTION_LEN 256
+// the foreground queue drops its oldest jobs beyond that
+#define DT_CONTROL_MAX_JOBS 30
 // reserved workers
 #define DT_CTL_WORKER_RESERVED 2
 #define DT_CTL_WORKER_ZOOM_1 0    // dev zoom 1
@@ -85,8 +87,13 @@ double dt_control_job_get_progress(dt_job_t *job);
 struct dt_control_t;
 void dt_control_jobs_init(struct dt_control_t *control);
 void dt_control_jobs_cleanup(struct dt_control_t *control);
+/** print how long jobs waited in each queue (-d control or -d perf). */
+void dt_control_jobs_print_stats(struct dt_control_t *control);
 
 int dt_control_add_job(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_t *job);
+/** add a sub-job to the calling worker's own deque, e.g. one per image of a bigger job. the worker will run it
+  * after its current job unless an idle worker steals it first. from other threads this is dt_control_add_job(). */
+int dt_control_add_job_local(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_t *job);
 int32_t dt_control_add_job_res(struct dt_control_t *s, dt_job_t *job, int32_t res);
 
 int32_t dt_control_get_threadid();
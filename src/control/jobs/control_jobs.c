@@ -199,7 +199,7 @@ static dt_job_t *dt_control_generic_images_job_create(dt_job_execute_callback ex
   return job;
 }
 
-static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
+static int32_t dt_control_write_sidecar_files_chunk_job_run(dt_job_t *job)
 {
   int imgid = -1;
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -234,6 +234,40 @@ static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
   return 0;
 }
 
+#define DT_CONTROL_SIDECAR_CHUNK 64
+
+static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
+{
+  // split the selection into chunks, so idle workers can help writing them.
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  while(params->index)
+  {
+    GList *chunk = params->index;
+    GList *rest = g_list_nth(chunk, DT_CONTROL_SIDECAR_CHUNK);
+    if(rest)
+    {
+      rest->prev->next = NULL;
+      rest->prev = NULL;
+    }
+    params->index = rest;
+
+    dt_job_t *sub = dt_control_job_create(&dt_control_write_sidecar_files_chunk_job_run, "%s",
+                                          "write sidecar files");
+    dt_control_image_enumerator_t *sub_params = dt_control_image_enumerator_alloc();
+    if(!sub || !sub_params)
+    {
+      dt_control_job_dispose(sub);
+      free(sub_params);
+      g_list_free(chunk);
+      continue;
+    }
+    sub_params->index = chunk;
+    dt_control_job_set_params(sub, sub_params, dt_control_image_enumerator_cleanup);
+    dt_control_add_job_local(darktable.control, DT_JOB_QUEUE_USER_FG, sub);
+  }
+  return 0;
+}
+
 typedef struct dt_control_merge_hdr_t
 {
   uint32_t first_imgid;
@@ -591,6 +625,7 @@ static void _set_remove_flag(char *imgs)
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgs, -1, SQLITE_STATIC);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed();
 }
 
 static GList *_get_full_pathname(char *imgs)
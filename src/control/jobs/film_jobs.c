@@ -17,9 +17,19 @@
 */
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/film.h"
+#include "common/image.h"
+#include <sqlite3.h>
 #include <stdlib.h>
 
+// files which may be parsed ahead of the database writer, their metadata is kept in memory until then
+#define DT_FILM_IMPORT_WINDOW 256
+// images written to the database in one transaction
+#define DT_FILM_IMPORT_BATCH 64
+// the readers mostly wait for the disk, more than that doesn't help
+#define DT_FILM_IMPORT_MAX_READERS 8
+
 typedef struct dt_film_import1_t
 {
   dt_film_t *film;
@@ -133,6 +143,85 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return ret;
 }
 
+typedef struct dt_film_import_slot_t
+{
+  gchar *filename;
+  dt_image_import_prepared_t *prepared;
+  gboolean ready;
+} dt_film_import_slot_t;
+
+/* files are parsed by a couple of reader threads (exif, sidecars, all the stat()s) while the job's thread
+ * writes the results to the database in file order. */
+typedef struct dt_film_import_queue_t
+{
+  GMutex lock;
+  GCond cond;
+  dt_film_import_slot_t *slots;
+  guint total;
+  guint next;      // next file to parse
+  guint committed; // files the writer is done with
+} dt_film_import_queue_t;
+
+static void *_film_import_reader(void *data)
+{
+  dt_film_import_queue_t *q = (dt_film_import_queue_t *)data;
+  dt_pthread_setname("import");
+
+  g_mutex_lock(&q->lock);
+  while(q->next < q->total)
+  {
+    if(q->next >= q->committed + DT_FILM_IMPORT_WINDOW)
+    {
+      g_cond_wait(&q->cond, &q->lock);
+      continue;
+    }
+    const guint k = q->next++;
+    g_mutex_unlock(&q->lock);
+
+    dt_image_import_prepared_t *prepared = dt_image_import_prepare(q->slots[k].filename, FALSE, TRUE);
+
+    g_mutex_lock(&q->lock);
+    q->slots[k].prepared = prepared;
+    q->slots[k].ready = TRUE;
+    g_cond_broadcast(&q->cond);
+  }
+  g_mutex_unlock(&q->lock);
+  return NULL;
+}
+
+// waits for file k to be parsed, or parses it right here if no reader took it yet
+static dt_image_import_prepared_t *_film_import_get(dt_film_import_queue_t *q, const guint k)
+{
+  g_mutex_lock(&q->lock);
+  if(q->next == k)
+  {
+    q->next++;
+    g_mutex_unlock(&q->lock);
+    return dt_image_import_prepare(q->slots[k].filename, FALSE, TRUE);
+  }
+  while(!q->slots[k].ready) g_cond_wait(&q->cond, &q->lock);
+  dt_image_import_prepared_t *prepared = q->slots[k].prepared;
+  q->slots[k].prepared = NULL;
+  g_mutex_unlock(&q->lock);
+  return prepared;
+}
+
+static gboolean _film_import_is_ready(dt_film_import_queue_t *q, const guint k)
+{
+  g_mutex_lock(&q->lock);
+  const gboolean ready = k >= q->total || q->slots[k].ready;
+  g_mutex_unlock(&q->lock);
+  return ready;
+}
+
+static void _film_import_done(dt_film_import_queue_t *q, const guint k)
+{
+  g_mutex_lock(&q->lock);
+  q->committed = k + 1;
+  g_cond_broadcast(&q->cond);
+  g_mutex_unlock(&q->lock);
+}
+
 static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 {
   gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
@@ -200,13 +289,50 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
   dt_control_job_set_progress_message(job, message);
 
 
+  /* hand the files to the readers */
+  dt_film_import_queue_t q = { 0 };
+  g_mutex_init(&q.lock);
+  g_cond_init(&q.cond);
+  q.total = total;
+  q.slots = (dt_film_import_slot_t *)calloc(total, sizeof(dt_film_import_slot_t));
+  {
+    guint k = 0;
+    for(GList *image = g_list_first(images); image; image = g_list_next(image)) q.slots[k++].filename = image->data;
+  }
+
+  int num_readers = dt_conf_get_int("plugins/lighttable/import/metadata_threads");
+  if(num_readers <= 0) num_readers = MIN(dt_get_num_threads(), DT_FILM_IMPORT_MAX_READERS);
+  num_readers = MIN(num_readers, (int)total);
+  pthread_t *readers = (pthread_t *)calloc(num_readers, sizeof(pthread_t));
+  int started = 0;
+  for(int k = 0; k < num_readers; k++)
+  {
+    if(dt_pthread_create(&readers[k], _film_import_reader, &q)) break;
+    started++;
+  }
+  // without readers the loop below parses the files itself
+
+  const double start = dt_get_wtime();
+  double time_waiting = 0.0;
+  guint in_transaction = 0;
+  guint imported = 0;
+
   /* loop thru the images and import to current film roll */
   dt_film_t *cfr = film;
-  GList *image = g_list_first(images);
-  do
+  for(guint k = 0; k < total; k++)
   {
-    gchar *cdn = g_path_get_dirname((const gchar *)image->data);
+    // don't keep the transaction open while waiting for the disk
+    if(in_transaction && !_film_import_is_ready(&q, k))
+    {
+      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      in_transaction = 0;
+    }
+
+    const double wait_start = dt_get_wtime();
+    dt_image_import_prepared_t *prepared = _film_import_get(&q, k);
+    time_waiting += dt_get_wtime() - wait_start;
 
+    gchar *cdn = g_path_get_dirname(q.slots[k].filename);
     /* check if we need to initialize a new filmroll */
     if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
     {
@@ -253,16 +379,37 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
     g_free(cdn);
 
     /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    if(prepared)
+    {
+      if(!in_transaction) sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+      if(dt_image_import_commit(cfr->id, prepared)) imported++;
+      dt_image_import_prepared_free(prepared);
+      if(++in_transaction >= DT_FILM_IMPORT_BATCH)
+      {
+        sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+        in_transaction = 0;
+      }
+    }
+    _film_import_done(&q, k);
 
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
+  }
+  if(in_transaction) sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
 
-
-  } while((image = g_list_next(image)) != NULL);
-
+  for(int k = 0; k < started; k++) pthread_join(readers[k], NULL);
+  free(readers);
+  free(q.slots);
+  g_cond_clear(&q.cond);
+  g_mutex_clear(&q.lock);
   g_list_free_full(images, g_free);
 
+  const double seconds = MAX(dt_get_wtime() - start, 1e-6);
+  dt_print(DT_DEBUG_PERF,
+           "[film_import] %u files, %u imported in %.2f s (%.1f files/s) with %d reader threads, "
+           "writer waited %.2f s for metadata\n",
+           total, imported, seconds, total / seconds, started, time_waiting);
+
   // only redraw at the end, to not spam the cpu with exposure events
   dt_control_queue_redraw_center();
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -27,6 +27,10 @@
 #include "develop/masks.h"
 #include "develop/tiling.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define CLAMP_RANGE(x, y, z) (CLAMP(x, y, z))
 
 typedef struct _blend_buffer_desc_t
@@ -2640,6 +2644,268 @@ static void display_channel(const _blend_buffer_desc_t *bd, const float *a, floa
 }
 
 
+#if defined(__SSE2__)
+/* vectorized kernels for the common 4 channel rgb and Lab buffers. one pixel is one __m128. the blend mode
+ * is a compile time constant of the shared row kernel, so its switch is resolved outside of the pixel loop.
+ * the blend kernels scale channels with the same divisions as the plain code and give identical results, the
+ * masks use reciprocals and agree up to rounding. */
+
+static inline __m128 _blend_op_sse2(const unsigned int blend_mode, const __m128 a, const __m128 b,
+                                    const __m128 minmax_sum)
+{
+  switch(blend_mode)
+  {
+    case DEVELOP_BLEND_LIGHTEN:
+      return _mm_max_ps(a, b);
+    case DEVELOP_BLEND_DARKEN:
+      return _mm_min_ps(a, b);
+    case DEVELOP_BLEND_MULTIPLY:
+      return _mm_mul_ps(a, b);
+    case DEVELOP_BLEND_AVERAGE:
+      return _mm_div_ps(_mm_add_ps(a, b), _mm_set1_ps(2.0f));
+    case DEVELOP_BLEND_ADD:
+      return _mm_add_ps(a, b);
+    case DEVELOP_BLEND_SUBSTRACT:
+      return _mm_sub_ps(_mm_add_ps(b, a), minmax_sum);
+    default: // normal
+      return b;
+  }
+}
+
+static inline void _blend_row_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                                   const int flag, const unsigned int blend_mode, const int bounded)
+{
+  const int lab = bd->cst == iop_cs_Lab;
+  // rgb channels are divided by one, which is exact
+  const __m128 scale = lab ? _mm_set_ps(1.0f, 128.0f, 128.0f, 100.0f) : _mm_set1_ps(1.0f);
+  const __m128 vmin = lab ? _mm_set_ps(0.0f, -1.0f, -1.0f, 0.0f) : _mm_setzero_ps();
+  const __m128 vmax = _mm_set1_ps(1.0f);
+  const __m128 minmax_sum = lab ? _mm_set_ps(1.0f, 0.0f, 0.0f, 1.0f) : _mm_set1_ps(1.0f);
+  // a and b are kept from the input when only lightness gets blended
+  const __m128 keep = _mm_castsi128_ps((lab && flag) ? _mm_set_epi32(0, -1, -1, 0) : _mm_setzero_si128());
+  const __m128 alpha = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  for(size_t i = 0, j = 0; j < bd->stride; i++, j += 4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _mm_div_ps(_mm_loadu_ps(a + j), scale);
+    const __m128 tb = _mm_div_ps(_mm_loadu_ps(b + j), scale);
+
+    __m128 t = _mm_add_ps(_mm_mul_ps(ta, _mm_sub_ps(one, opacity)),
+                          _mm_mul_ps(_blend_op_sse2(blend_mode, ta, tb, minmax_sum), opacity));
+    if(bounded) t = _mm_min_ps(_mm_max_ps(t, vmin), vmax);
+    t = _mm_or_ps(_mm_and_ps(keep, ta), _mm_andnot_ps(keep, t));
+    t = _mm_mul_ps(t, scale);
+
+    _mm_storeu_ps(b + j, _mm_or_ps(_mm_and_ps(alpha, opacity), _mm_andnot_ps(alpha, t)));
+  }
+}
+
+static void _blend_normal_bounded_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b,
+                                       const float *mask, int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_BOUNDED, 1);
+}
+
+static void _blend_normal_unbounded_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b,
+                                         const float *mask, int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_NORMAL2, 0);
+}
+
+static void _blend_lighten_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                                int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_LIGHTEN, 1);
+}
+
+static void _blend_darken_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                               int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_DARKEN, 1);
+}
+
+static void _blend_multiply_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                                 int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_MULTIPLY, 1);
+}
+
+static void _blend_average_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                                int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_AVERAGE, 1);
+}
+
+static void _blend_add_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                            int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_ADD, 1);
+}
+
+static void _blend_substract_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
+                                  int flag)
+{
+  _blend_row_sse2(bd, a, b, mask, flag, DEVELOP_BLEND_SUBSTRACT, 1);
+}
+
+/* the vectorized kernel for this blend mode, NULL if there is none for the buffer */
+static _blend_row_func *_choose_blend_func_sse2(const unsigned int blend_mode, const dt_iop_colorspace_type_t cst,
+                                                const int ch)
+{
+  if(ch != 4 || (cst != iop_cs_rgb && cst != iop_cs_Lab)) return NULL;
+
+  switch(blend_mode)
+  {
+    case DEVELOP_BLEND_NORMAL:
+    case DEVELOP_BLEND_BOUNDED:
+      return _blend_normal_bounded_sse2;
+    case DEVELOP_BLEND_NORMAL2:
+    case DEVELOP_BLEND_UNBOUNDED:
+      return _blend_normal_unbounded_sse2;
+    case DEVELOP_BLEND_AVERAGE:
+      return _blend_average_sse2;
+    case DEVELOP_BLEND_ADD:
+      return _blend_add_sse2;
+    case DEVELOP_BLEND_SUBSTRACT:
+      return _blend_substract_sse2;
+    // these treat Lab lightness and chroma differently, only rgb is plain per channel
+    case DEVELOP_BLEND_LIGHTEN:
+      return cst == iop_cs_rgb ? _blend_lighten_sse2 : NULL;
+    case DEVELOP_BLEND_DARKEN:
+      return cst == iop_cs_rgb ? _blend_darken_sse2 : NULL;
+    case DEVELOP_BLEND_MULTIPLY:
+      return cst == iop_cs_rgb ? _blend_multiply_sse2 : NULL;
+    default:
+      return NULL;
+  }
+}
+
+/* blendif parameters rearranged into lanes: in channels in the first vector, out channels in the second */
+typedef struct _blendif_sse2_t
+{
+  __m128 p0[2], p1[2], p2[2], p3[2];
+  __m128 r01[2], r23[2]; // inverse widths of the ramps, as in _blendif_factor()
+  __m128 invert[2];      // lanes of inverted channels
+  __m128 active[2];      // lanes of channels with sliders not spanning the whole range
+  float constant;        // combined factor of the channels which span the whole range
+} _blendif_sse2_t;
+
+static void _blendif_sse2_init(_blendif_sse2_t *p, const dt_iop_colorspace_type_t cst,
+                               const unsigned int blendif, const float *parameters,
+                               const unsigned int mask_combine)
+{
+  const unsigned int channel_mask = cst == iop_cs_Lab ? DEVELOP_BLENDIF_Lab_MASK : DEVELOP_BLENDIF_RGB_MASK;
+  const int incl = mask_combine & DEVELOP_COMBINE_INCL;
+
+  p->constant = 1.0f;
+  for(int ch = 0; ch <= DEVELOP_BLENDIF_MAX; ch++)
+    if((channel_mask & (1 << ch)) && !(blendif & (1 << ch)))
+      p->constant *= !(blendif & (1 << (ch + 16))) == !incl ? 1.0f : 0.0f;
+
+  for(int v = 0; v < 2; v++)
+  {
+    float p0[4], p1[4], p2[4], p3[4], r01[4], r23[4];
+    int32_t invert[4], active[4];
+    for(int l = 0; l < 4; l++)
+    {
+      const int ch = 4 * v + l;
+      p0[l] = parameters[4 * ch + 0];
+      p1[l] = parameters[4 * ch + 1];
+      p2[l] = parameters[4 * ch + 2];
+      p3[l] = parameters[4 * ch + 3];
+      r01[l] = 1.0f / fmaxf(0.01f, p1[l] - p0[l]);
+      r23[l] = 1.0f / fmaxf(0.01f, p3[l] - p2[l]);
+      invert[l] = (blendif & (1 << (ch + 16))) ? -1 : 0;
+      active[l] = ((channel_mask & (1 << ch)) && (blendif & (1 << ch))) ? -1 : 0;
+    }
+    p->p0[v] = _mm_loadu_ps(p0);
+    p->p1[v] = _mm_loadu_ps(p1);
+    p->p2[v] = _mm_loadu_ps(p2);
+    p->p3[v] = _mm_loadu_ps(p3);
+    p->r01[v] = _mm_loadu_ps(r01);
+    p->r23[v] = _mm_loadu_ps(r23);
+    p->invert[v] = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)invert));
+    p->active[v] = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)active));
+  }
+}
+
+static inline __m128 _blendif_scale_sse2(const dt_iop_colorspace_type_t cst, const float *px)
+{
+  __m128 s;
+  if(cst == iop_cs_Lab)
+    s = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(px), _mm_set_ps(0.0f, 128.0f, 128.0f, 0.0f)),
+                   _mm_set_ps(1.0f, 1.0f / 256.0f, 1.0f / 256.0f, 1.0f / 100.0f));
+  else
+    s = _mm_set_ps(px[2], px[1], px[0], 0.3f * px[0] + 0.59f * px[1] + 0.11f * px[2]);
+  return _mm_min_ps(_mm_max_ps(s, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blendif_factor_sse2(const _blendif_sse2_t *p, const int v, const __m128 s, const int incl)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 in_band = _mm_and_ps(_mm_cmpge_ps(s, p->p1[v]), _mm_cmple_ps(s, p->p2[v]));
+  const __m128 lower = _mm_and_ps(_mm_cmpgt_ps(s, p->p0[v]), _mm_cmplt_ps(s, p->p1[v]));
+  const __m128 upper = _mm_and_ps(_mm_cmpgt_ps(s, p->p2[v]), _mm_cmplt_ps(s, p->p3[v]));
+  const __m128 fl = _mm_mul_ps(_mm_sub_ps(s, p->p0[v]), p->r01[v]);
+  const __m128 fu = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(s, p->p2[v]), p->r23[v]));
+
+  __m128 f = _mm_and_ps(upper, fu);
+  f = _mm_or_ps(_mm_and_ps(lower, fl), _mm_andnot_ps(lower, f));
+  f = _mm_or_ps(_mm_and_ps(in_band, one), _mm_andnot_ps(in_band, f));
+  f = _mm_or_ps(_mm_and_ps(p->invert[v], _mm_sub_ps(one, f)), _mm_andnot_ps(p->invert[v], f));
+  if(incl) f = _mm_sub_ps(one, f);
+  return _mm_or_ps(_mm_and_ps(p->active[v], f), _mm_andnot_ps(p->active[v], one));
+}
+
+/* same as _blend_make_mask(), all conditional channels of a pixel at once */
+static void _blend_make_mask_sse2(const _blend_buffer_desc_t *bd, const unsigned int blendif,
+                                  const float *blendif_parameters, const unsigned int mask_mode,
+                                  const unsigned int mask_combine, const float gopacity, const float *a,
+                                  const float *b, float *mask)
+{
+  const int incl = mask_combine & DEVELOP_COMBINE_INCL;
+  const int inv = mask_combine & DEVELOP_COMBINE_INV;
+
+  if(!(mask_mode & DEVELOP_MASK_CONDITIONAL))
+  {
+    const float conditional = incl ? 0.0f : 1.0f;
+    for(size_t i = 0; i < bd->stride / 4; i++)
+    {
+      const float form = mask[i];
+      const float opacity = incl ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional;
+      mask[i] = (inv ? 1.0f - opacity : opacity) * gopacity;
+    }
+    return;
+  }
+
+  _blendif_sse2_t p;
+  _blendif_sse2_init(&p, bd->cst, blendif, blendif_parameters, mask_combine);
+
+  for(size_t i = 0, j = 0; j < bd->stride; i++, j += 4)
+  {
+    const __m128 f = _mm_mul_ps(_blendif_factor_sse2(&p, 0, _blendif_scale_sse2(bd->cst, a + j), incl),
+                                _blendif_factor_sse2(&p, 1, _blendif_scale_sse2(bd->cst, b + j), incl));
+    float lanes[4];
+    _mm_storeu_ps(lanes, f);
+    const float result = p.constant * (lanes[0] * lanes[1] * lanes[2] * lanes[3]);
+    const float conditional = incl ? 1.0f - result : result;
+
+    const float form = mask[i];
+    const float opacity = incl ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional;
+    mask[i] = (inv ? 1.0f - opacity : opacity) * gopacity;
+  }
+}
+
+/* whether _blend_make_mask_sse2() covers these settings. hue, chroma and saturation channels need the
+ * per pixel colorspace conversions of the plain code. */
+static inline int _blend_make_mask_sse2_supported(const _blend_buffer_desc_t *bd, const unsigned int blendif)
+{
+  return bd->ch == 4 && (bd->cst == iop_cs_rgb || bd->cst == iop_cs_Lab) && !(blendif & 0x7f00);
+}
+#endif
+
 _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
 {
   _blend_row_func *blend = NULL;
@@ -2754,6 +3020,53 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
   return blend;
 }
 
+/* the vectorized kernel if there is one for this buffer, the plain one otherwise */
+static _blend_row_func *_blend_choose_row_func(const unsigned int blend_mode, const dt_iop_colorspace_type_t cst,
+                                               const int ch, const int use_sse2)
+{
+  _blend_row_func *blend = NULL;
+#if defined(__SSE2__)
+  if(use_sse2) blend = _choose_blend_func_sse2(blend_mode, cst, ch);
+#endif
+  return blend ? blend : dt_develop_choose_blend_func(blend_mode);
+}
+
+static inline void _blend_make_mask_row(const _blend_buffer_desc_t *bd, const unsigned int blendif,
+                                        const float *blendif_parameters, const unsigned int mask_mode,
+                                        const unsigned int mask_combine, const float gopacity, const float *a,
+                                        const float *b, float *mask, const int use_sse2)
+{
+#if defined(__SSE2__)
+  if(use_sse2)
+    _blend_make_mask_sse2(bd, blendif, blendif_parameters, mask_mode, mask_combine, gopacity, a, b, mask);
+  else
+#endif
+    _blend_make_mask(bd, blendif, blendif_parameters, mask_mode, mask_combine, gopacity, a, b, mask);
+}
+
+int dt_develop_blend_row(const dt_iop_colorspace_type_t cst, const unsigned int blend_mode, const int flag,
+                         const float *a, float *b, const float *mask, const size_t width, const int use_sse2)
+{
+  const _blend_buffer_desc_t bd = { .cst = cst, .stride = width * 4, .ch = 4, .bch = 3 };
+  _blend_row_func *const blend = _blend_choose_row_func(blend_mode, cst, 4, use_sse2);
+  blend(&bd, a, b, mask, flag);
+  return blend != dt_develop_choose_blend_func(blend_mode);
+}
+
+int dt_develop_blend_mask_row(const dt_iop_colorspace_type_t cst, const unsigned int blendif,
+                              const float *blendif_parameters, const unsigned int mask_mode,
+                              const unsigned int mask_combine, const float opacity, const float *a, const float *b,
+                              float *mask, const size_t width, const int use_sse2)
+{
+  const _blend_buffer_desc_t bd = { .cst = cst, .stride = width * 4, .ch = 4, .bch = 3 };
+  int vectorized = 0;
+#if defined(__SSE2__)
+  vectorized = use_sse2 && _blend_make_mask_sse2_supported(&bd, blendif);
+#endif
+  _blend_make_mask_row(&bd, blendif, blendif_parameters, mask_mode, mask_combine, opacity, a, b, mask, vectorized);
+  return vectorized;
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -2912,6 +3225,12 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
     }
 
     // get parametric mask (if any) and apply global opacity
+    int mask_sse2 = 0;
+#if defined(__SSE2__)
+    const _blend_buffer_desc_t mask_bd = { .cst = cst, .stride = (size_t)owidth * ch, .ch = ch, .bch = bch };
+    mask_sse2 = darktable.codepath.SSE2 && _blend_make_mask_sse2_supported(&mask_bd, d->blendif);
+#endif
+    const int use_sse2 = mask_sse2;
 #ifdef _OPENMP
 #pragma omp parallel for default(none)
 #endif
@@ -2923,7 +3242,8 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
       float *in = (float *)ivoid + iindex;
       float *out = (float *)ovoid + oindex;
       float *m = mask + y * owidth;
-      _blend_make_mask(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m);
+      _blend_make_mask_row(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in,
+                           out, m, use_sse2);
     }
 
     if(mask_feather)
@@ -3011,7 +3331,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
   // now apply blending with per-pixel opacity value as defined in mask
   // select the blend operator
-  _blend_row_func *const blend = dt_develop_choose_blend_func(d->blend_mode);
+  _blend_row_func *const blend = _blend_choose_row_func(d->blend_mode, cst, ch, darktable.codepath.SSE2);
 #ifdef _OPENMP
 #pragma omp parallel for default(none)
 #endif
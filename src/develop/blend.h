@@ -456,6 +456,16 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
                               const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out);
 
+/** blends one row of 4 channel pixels into b, with the vectorized kernel for the mode if use_sse2 is set and
+ * there is one. for tests and benchmarks, returns 1 if the vectorized kernel ran. */
+int dt_develop_blend_row(const dt_iop_colorspace_type_t cst, const unsigned int blend_mode, const int flag,
+                         const float *a, float *b, const float *mask, const size_t width, const int use_sse2);
+/** computes one row of the blend mask from the drawn mask in mask, same conventions as above. */
+int dt_develop_blend_mask_row(const dt_iop_colorspace_type_t cst, const unsigned int blendif,
+                              const float *blendif_parameters, const unsigned int mask_mode,
+                              const unsigned int mask_combine, const float opacity, const float *a, const float *b,
+                              float *mask, const size_t width, const int use_sse2);
+
 /** get blend version */
 int dt_develop_blend_version(void);
 
@@ -25,6 +25,7 @@
 #include <strings.h>
 #include <unistd.h>
 
+#include "common/collection.h"
 #include "common/debug.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
@@ -94,9 +95,12 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->form_visible = NULL;
   dev->form_gui = NULL;
   dev->allforms = NULL;
+  dev->masks_cache = NULL;
 
   if(dev->gui_attached)
   {
+    // export and thumbnail pipes run once, only the darkroom gets to reuse rasterized masks
+    dev->masks_cache = dt_masks_raster_cache_new();
     dev->pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
     dev->preview_pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
     dt_dev_pixelpipe_init(dev->pipe);
@@ -181,6 +185,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
 
   g_list_free_full(dev->forms, (void (*)(void *))dt_masks_free_form);
   g_list_free_full(dev->allforms, (void (*)(void *))dt_masks_free_form);
+  dt_masks_raster_cache_free(dev->masks_cache);
 
   g_list_free_full(dev->proxy.exposure, g_free);
 
@@ -1044,6 +1049,8 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, dev->iop_order_version);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+
+  dt_collection_image_changed();
 }
 
 void dt_dev_write_history(dt_develop_t *dev)
@@ -189,6 +189,8 @@ typedef struct dt_develop_t
   struct dt_masks_form_gui_t *form_gui;
   // all forms to be linked here for cleanup:
   GList *allforms;
+  // rasterized masks, reused as long as the forms and the distortions before the module don't change
+  struct dt_masks_raster_cache_t *masks_cache;
 
   //full preview stuff
   int full_preview;
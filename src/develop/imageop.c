@@ -182,6 +182,12 @@ static void default_process(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 {
   if(darktable.codepath.OPENMP_SIMD && self->process_plain)
     self->process_plain(self, piece, i, o, roi_in, roi_out);
+#ifdef DT_HAVE_TARGET_AVX2
+  else if(darktable.codepath.AVX512 && self->process_avx512)
+    self->process_avx512(self, piece, i, o, roi_in, roi_out);
+  else if(darktable.codepath.AVX2 && self->process_avx2)
+    self->process_avx2(self, piece, i, o, roi_in, roi_out);
+#endif
 #if defined(__SSE__)
   else if(darktable.codepath.SSE2 && self->process_sse2)
     self->process_sse2(self, piece, i, o, roi_in, roi_out);
@@ -311,6 +317,10 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
 
   if(!g_module_symbol(module->module, "process_sse2", (gpointer) & (module->process_sse2)))
     module->process_sse2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx2", (gpointer) & (module->process_avx2)))
+    module->process_avx2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx512", (gpointer) & (module->process_avx512)))
+    module->process_avx512 = NULL;
 
   if(!g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))) goto error;
 
@@ -449,6 +459,8 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->process_tiling = so->process_tiling;
   module->process_plain = so->process_plain;
   module->process_sse2 = so->process_sse2;
+  module->process_avx2 = so->process_avx2;
+  module->process_avx512 = so->process_avx512;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
   module->distort_transform = so->distort_transform;
@@ -1399,11 +1411,73 @@ static void init_key_accels(dt_iop_module_so_t *module)
   sqlite3_finalize(stmt);
 }
 
+// darktablerc settings read by the init_presets() of a module, a change has to write its presets again
+static const struct
+{
+  const char *op;
+  const char *key;
+} _presets_conf[] = {
+  { "sharpen", "plugins/darkroom/sharpen/auto_apply" },
+};
+
+// the built-in presets only change with darktable, the module, the language of their names and the few
+// settings above, so they are written to the database once for each combination of those. the manifest
+// entry in darktablerc records the one they were written for.
+static gboolean _presets_current(dt_iop_module_so_t *module, gchar **manifest)
+{
+  GString *str = g_string_new(NULL);
+  g_string_printf(str, "%s/%d/%s", darktable_package_version, module->version(), g_get_language_names()[0]);
+  for(size_t k = 0; k < G_N_ELEMENTS(_presets_conf); k++)
+    if(!strcmp(_presets_conf[k].op, module->op))
+    {
+      gchar *value = dt_conf_get_string(_presets_conf[k].key);
+      g_string_append_printf(str, "/%s", value);
+      g_free(value);
+    }
+  *manifest = g_string_free(str, FALSE);
+
+  gchar *key = g_strdup_printf("plugins/darkroom/%s/presets_version", module->op);
+  gchar *written = dt_conf_key_exists(key) ? dt_conf_get_string(key) : NULL;
+  gboolean current = !g_strcmp0(written, *manifest);
+  g_free(written);
+  g_free(key);
+  if(!current) return FALSE;
+
+  // a fresh data.db (the config stayed) has none of them
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT 1 FROM data.presets WHERE operation = ?1 AND writeprotect = 1 LIMIT 1", -1,
+                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, module->op, -1, SQLITE_TRANSIENT);
+  current = sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  return current;
+}
+
 static void dt_iop_init_module_so(void *m)
 {
   dt_iop_module_so_t *module = (dt_iop_module_so_t *)m;
 
-  init_presets(module);
+  gchar *manifest = NULL;
+  if(module->init_presets && _presets_current(module, &manifest))
+  {
+    // only look for legacy presets
+    void (*init)(struct dt_iop_module_so_t *self) = module->init_presets;
+    module->init_presets = NULL;
+    init_presets(module);
+    module->init_presets = init;
+  }
+  else
+  {
+    init_presets(module);
+    if(module->init_presets)
+    {
+      gchar *key = g_strdup_printf("plugins/darkroom/%s/presets_version", module->op);
+      dt_conf_set_string(key, manifest);
+      g_free(key);
+    }
+  }
+  g_free(manifest);
 
   // do not init accelerators if there is no gui
   if(darktable.gui)
@@ -1429,8 +1503,11 @@ static void dt_iop_init_module_so(void *m)
 
 void dt_iop_load_modules_so()
 {
+  const double start = dt_get_wtime();
   darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
                                          dt_iop_init_module_so, NULL);
+  dt_print(DT_DEBUG_PERF, "[iop_load_module] %u modules loaded in %.3f s\n", g_list_length(darktable.iop),
+           dt_get_wtime() - start);
 }
 
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, dt_develop_t *dev)
@@ -255,6 +255,9 @@ int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
                       float **buffer, int *width, int *height, int *posx, int *posy);
 int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           const dt_iop_roi_t *roi, float *buffer);
+/** lru cache of rasterized masks, shared by the pipes of a develop. NULL if disabled in the config. */
+struct dt_masks_raster_cache_t *dt_masks_raster_cache_new(void);
+void dt_masks_raster_cache_free(struct dt_masks_raster_cache_t *cache);
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
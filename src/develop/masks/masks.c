@@ -625,8 +625,8 @@ int dt_masks_get_source_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   return 0;
 }
 
-int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
-                      float **buffer, int *width, int *height, int *posx, int *posy)
+static int _masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                           float **buffer, int *width, int *height, int *posx, int *posy)
 {
   if(form->type & DT_MASKS_CIRCLE)
   {
@@ -655,8 +655,8 @@ int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
   return 0;
 }
 
-int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
-                          const dt_iop_roi_t *roi, float *buffer)
+static int _masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                               const dt_iop_roi_t *roi, float *buffer)
 {
   if(form->type & DT_MASKS_CIRCLE)
   {
@@ -685,6 +685,247 @@ int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
   return 0;
 }
 
+/*
+ * raster cache
+ *
+ * rasterizing drawn masks, especially paths and brushes with feathering, is expensive and has to be
+ * done on every pipe run, although most of the time only some module parameter changed and the shapes
+ * did not move at all. the rasters are therefore kept in a small lru cache per develop, shared by the
+ * preview and the full pipe. an entry is found by hashing everything the raster depends on: the form
+ * points (recursing into groups), the distorting modules up to and including the module, the input
+ * geometry of the pipe and, for region of interest masks, the roi itself.
+ */
+
+typedef struct dt_masks_raster_cache_entry_t
+{
+  uint64_t key;
+  uint64_t used; // lru stamp
+  float *buffer;
+  size_t size;   // in bytes
+  int width, height, posx, posy;
+} dt_masks_raster_cache_entry_t;
+
+typedef struct dt_masks_raster_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries; // key -> dt_masks_raster_cache_entry_t
+  size_t memory, memory_limit;
+  uint64_t stamp;
+  uint64_t hits, misses;
+} dt_masks_raster_cache_t;
+
+static void _raster_cache_entry_free(gpointer data)
+{
+  dt_masks_raster_cache_entry_t *entry = (dt_masks_raster_cache_entry_t *)data;
+  dt_free_align(entry->buffer);
+  free(entry);
+}
+
+dt_masks_raster_cache_t *dt_masks_raster_cache_new(void)
+{
+  const int64_t limit = dt_conf_get_int64("masks_cache_memory");
+  if(limit <= 0) return NULL;
+
+  dt_masks_raster_cache_t *cache = calloc(1, sizeof(dt_masks_raster_cache_t));
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _raster_cache_entry_free);
+  cache->memory_limit = limit;
+  return cache;
+}
+
+void dt_masks_raster_cache_free(dt_masks_raster_cache_t *cache)
+{
+  if(!cache) return;
+  dt_print(DT_DEBUG_MASKS, "[masks] raster cache: %" PRIu64 " hits, %" PRIu64 " misses, %zu bytes in %u entries\n",
+           cache->hits, cache->misses, cache->memory, g_hash_table_size(cache->entries));
+  g_hash_table_destroy(cache->entries);
+  dt_pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  // bernstein hash (djb2), as for the pixelpipe cache
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static uint64_t _form_hash(dt_develop_t *dev, dt_masks_form_t *form, uint64_t hash)
+{
+  hash = _hash_bytes(hash, &form->type, sizeof(dt_masks_type_t));
+  hash = _hash_bytes(hash, &form->formid, sizeof(int));
+  hash = _hash_bytes(hash, &form->version, sizeof(int));
+  hash = _hash_bytes(hash, form->source, 2 * sizeof(float));
+
+  for(GList *l = g_list_first(form->points); l; l = g_list_next(l))
+  {
+    if(form->type & DT_MASKS_GROUP)
+    {
+      const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)l->data;
+      dt_masks_form_t *f = dt_masks_get_from_id(dev, grpt->formid);
+      if(!f) continue;
+      hash = _hash_bytes(hash, &grpt->state, sizeof(int));
+      hash = _hash_bytes(hash, &grpt->opacity, sizeof(float));
+      hash = _form_hash(dev, f, hash);
+    }
+    else if(form->type & DT_MASKS_CIRCLE)
+      hash = _hash_bytes(hash, l->data, sizeof(dt_masks_point_circle_t));
+    else if(form->type & DT_MASKS_PATH)
+      hash = _hash_bytes(hash, l->data, sizeof(dt_masks_point_path_t));
+    else if(form->type & DT_MASKS_GRADIENT)
+      hash = _hash_bytes(hash, l->data, sizeof(dt_masks_point_gradient_t));
+    else if(form->type & DT_MASKS_ELLIPSE)
+      hash = _hash_bytes(hash, l->data, sizeof(dt_masks_point_ellipse_t));
+    else if(form->type & DT_MASKS_BRUSH)
+      hash = _hash_bytes(hash, l->data, sizeof(dt_masks_point_brush_t));
+  }
+  return hash;
+}
+
+// returns 0 if the raster can't be cached
+static uint64_t _raster_cache_key(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                                  const dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const uint64_t distort
+      = dt_dev_hash_distort_plus(module->dev, pipe, module->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  if(distort == 0) return 0; // pipe nodes and modules out of sync
+
+  uint64_t hash = 5381 + pipe->image.id;
+  hash = ((hash << 5) + hash) ^ distort;
+  hash = _hash_bytes(hash, &pipe->iwidth, sizeof(int));
+  hash = _hash_bytes(hash, &pipe->iheight, sizeof(int));
+  hash = _hash_bytes(hash, &pipe->iscale, sizeof(float));
+  hash = _form_hash(module->dev, form, hash);
+  const int has_roi = roi != NULL;
+  hash = _hash_bytes(hash, &has_roi, sizeof(int));
+  if(roi)
+  {
+    hash = _hash_bytes(hash, &roi->x, sizeof(int));
+    hash = _hash_bytes(hash, &roi->y, sizeof(int));
+    hash = _hash_bytes(hash, &roi->width, sizeof(int));
+    hash = _hash_bytes(hash, &roi->height, sizeof(int));
+    hash = _hash_bytes(hash, &roi->scale, sizeof(float));
+  }
+  return hash ? hash : 1;
+}
+
+// copies the cached raster into *buffer (allocated here if NULL) and fills in its geometry
+static int _raster_cache_get(dt_masks_raster_cache_t *cache, const uint64_t key, float **buffer, int *width,
+                             int *height, int *posx, int *posy)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_masks_raster_cache_entry_t *entry = g_hash_table_lookup(cache->entries, &key);
+  if(!entry)
+  {
+    cache->misses++;
+    dt_pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+  if(*buffer == NULL) *buffer = malloc(entry->size);
+  if(*buffer) memcpy(*buffer, entry->buffer, entry->size);
+  if(width) *width = entry->width;
+  if(height) *height = entry->height;
+  if(posx) *posx = entry->posx;
+  if(posy) *posy = entry->posy;
+  entry->used = ++cache->stamp;
+  cache->hits++;
+  dt_pthread_mutex_unlock(&cache->lock);
+  return *buffer != NULL;
+}
+
+static void _raster_cache_put(dt_masks_raster_cache_t *cache, const uint64_t key, const float *buffer,
+                              const int width, const int height, const int posx, const int posy)
+{
+  const size_t size = sizeof(float) * width * height;
+  if(size == 0 || size > cache->memory_limit) return;
+
+  float *copy = dt_alloc_align(64, size);
+  if(!copy) return;
+  memcpy(copy, buffer, size);
+
+  dt_pthread_mutex_lock(&cache->lock);
+  if(g_hash_table_contains(cache->entries, &key))
+  {
+    // the other pipe was faster
+    dt_pthread_mutex_unlock(&cache->lock);
+    dt_free_align(copy);
+    return;
+  }
+
+  // evict the least recently used rasters until the new one fits
+  while(cache->memory + size > cache->memory_limit && g_hash_table_size(cache->entries))
+  {
+    GHashTableIter iter;
+    gpointer value;
+    dt_masks_raster_cache_entry_t *oldest = NULL;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+    {
+      dt_masks_raster_cache_entry_t *entry = (dt_masks_raster_cache_entry_t *)value;
+      if(!oldest || entry->used < oldest->used) oldest = entry;
+    }
+    cache->memory -= oldest->size;
+    g_hash_table_remove(cache->entries, &oldest->key);
+  }
+
+  dt_masks_raster_cache_entry_t *entry = malloc(sizeof(dt_masks_raster_cache_entry_t));
+  entry->key = key;
+  entry->used = ++cache->stamp;
+  entry->buffer = copy;
+  entry->size = size;
+  entry->width = width;
+  entry->height = height;
+  entry->posx = posx;
+  entry->posy = posy;
+  g_hash_table_insert(cache->entries, &entry->key, entry);
+  cache->memory += size;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                      float **buffer, int *width, int *height, int *posx, int *posy)
+{
+  dt_masks_raster_cache_t *cache = module->dev->masks_cache;
+  const uint64_t key = cache ? _raster_cache_key(module, piece, form, NULL) : 0;
+
+  if(key)
+  {
+    *buffer = NULL;
+    if(_raster_cache_get(cache, key, buffer, width, height, posx, posy))
+    {
+      if(darktable.unmuted & DT_DEBUG_PERF)
+        dt_print(DT_DEBUG_MASKS, "[masks %s] raster cache hit\n", form->name);
+      return 1;
+    }
+  }
+
+  const int ok = _masks_get_mask(module, piece, form, buffer, width, height, posx, posy);
+  if(key && ok && *buffer) _raster_cache_put(cache, key, *buffer, *width, *height, *posx, *posy);
+  return ok;
+}
+
+int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                          const dt_iop_roi_t *roi, float *buffer)
+{
+  // only whole groups are kept, caching every shape of a group at the size of the roi would take too much
+  // memory. the shapes alone are cached by dt_masks_get_mask() instead.
+  dt_masks_raster_cache_t *cache = module->dev->masks_cache;
+  const uint64_t key = (cache && (form->type & DT_MASKS_GROUP)) ? _raster_cache_key(module, piece, form, roi) : 0;
+
+  if(key && _raster_cache_get(cache, key, &buffer, NULL, NULL, NULL, NULL))
+  {
+    if(darktable.unmuted & DT_DEBUG_PERF)
+      dt_print(DT_DEBUG_MASKS, "[masks %s] raster cache hit\n", form->name);
+    return 1;
+  }
+
+  const int ok = _masks_get_mask_roi(module, piece, form, roi, buffer);
+  if(key && ok) _raster_cache_put(cache, key, buffer, roi->width, roi->height, roi->x, roi->y);
+  return ok;
+}
+
 int dt_masks_version(void)
 {
   return DEVELOP_MASKS_VERSION;
@@ -17,10 +17,13 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/file_location.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
+#include <glib/gstdio.h>
 #include <stdlib.h>
+#include <zlib.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -43,6 +46,16 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
 #endif
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  // set before allocating, the failure path cleans them up
+  cache->queries = cache->misses = 0;
+  cache->memory_limit = cache->memory_used = 0;
+  cache->cost = NULL;
+  cache->priority = NULL;
+  cache->inflation = 0.0;
+  cache->last = -1;
+  cache->index = NULL;
+  cache->pinned = -1;
+  cache->backbuf = -1;
   for(int k = 0; k < entries; k++)
   {
     cache->size[k] = size;
@@ -59,7 +72,6 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     cache->hash[k] = -1;
     cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
   return 1;
 
 alloc_memory_fail:
@@ -67,6 +79,18 @@ alloc_memory_fail:
   return 0;
 }
 
+int dt_dev_pixelpipe_cache_init_budget(dt_dev_pixelpipe_cache_t *cache, int entries, size_t memory_limit)
+{
+  // all lines start out empty, they will be allocated on demand:
+  if(!dt_dev_pixelpipe_cache_init(cache, entries, 0)) return 0;
+  cache->memory_limit = memory_limit;
+  cache->cost = (float *)calloc(entries, sizeof(float));
+  cache->priority = (double *)calloc(entries, sizeof(double));
+  // the keys point to our own hash array, so they need to be removed before a line changes its hash.
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  return 1;
+}
+
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
@@ -75,6 +99,137 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->cost);
+  free(cache->priority);
+  if(cache->index) g_hash_table_destroy(cache->index);
+  cache->data = NULL;
+  cache->cost = NULL;
+  cache->priority = NULL;
+  cache->index = NULL;
+}
+
+static inline int _cache_budget_lookup(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->index, &hash)) - 1;
+}
+
+static inline void _cache_budget_set_hash(dt_dev_pixelpipe_cache_t *cache, const int k, const uint64_t hash)
+{
+  if(cache->hash[k] != (uint64_t)-1) g_hash_table_remove(cache->index, &cache->hash[k]);
+  cache->hash[k] = hash;
+  if(hash != (uint64_t)-1) g_hash_table_insert(cache->index, &cache->hash[k], GINT_TO_POINTER(k + 1));
+}
+
+// greedydual-size: the priority of a line is the inflation value at its last access plus the cost to
+// recompute it per megabyte. important lines (negative weight) get their value multiplied, same as
+// they are pushed into the future in the unbudgeted cache. with all costs equal this is plain lru.
+static inline void _cache_budget_touch(dt_dev_pixelpipe_cache_t *cache, const int k, const int weight)
+{
+  const double megabytes = MAX(cache->size[k], (size_t)1) / (1024.0 * 1024.0);
+  const double value = (cache->cost[k] + 1e-3) / megabytes;
+  cache->priority[k] = cache->inflation + value * (weight < 0 ? 1 - weight : 1);
+}
+
+// find the line to drop next. invalid lines go first, then the one with the lowest priority.
+static int _cache_budget_victim(dt_dev_pixelpipe_cache_t *cache, const int keep, const gboolean allocated)
+{
+  int victim = -1;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(k == keep || k == cache->last || k == cache->pinned || k == cache->backbuf) continue;
+    if(allocated && !cache->data[k]) continue;
+    if(cache->hash[k] == (uint64_t)-1)
+    {
+      // prefer unused memory, then free slots:
+      if(victim < 0 || cache->hash[victim] != (uint64_t)-1 || (cache->data[k] && !cache->data[victim]))
+        victim = k;
+    }
+    else if(victim < 0 || (cache->hash[victim] != (uint64_t)-1 && cache->priority[k] < cache->priority[victim]))
+      victim = k;
+  }
+  return victim;
+}
+
+static void _cache_budget_free_line(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(cache->hash[k] != (uint64_t)-1) cache->inflation = MAX(cache->inflation, cache->priority[k]);
+  _cache_budget_set_hash(cache, k, -1);
+  dt_free_align(cache->data[k]);
+  cache->data[k] = NULL;
+  cache->memory_used -= cache->size[k];
+  cache->size[k] = 0;
+  cache->cost[k] = 0.0f;
+}
+
+static int _cache_budget_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
+                             void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  int k = _cache_budget_lookup(cache, hash);
+  if(k >= 0 && cache->size[k] >= size)
+  {
+    *data = cache->data[k];
+    *dsc = &cache->dsc[k];
+    _cache_budget_touch(cache, k, weight);
+    cache->last = k;
+
+    ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
+    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
+  }
+
+  // the gui might be drawing from the backbuf line, it can't be reallocated
+  if(k >= 0 && k == cache->backbuf)
+  {
+    _cache_budget_set_hash(cache, k, -1);
+    k = -1;
+  }
+
+  // cache miss (or the line is too small): pick a line to overwrite
+  if(k < 0) k = _cache_budget_victim(cache, -1, FALSE);
+  if(k < 0 && cache->last != cache->backbuf) k = cache->last; // only one line, nothing else we could do.
+  if(k < 0) return -1;
+  if(cache->hash[k] != (uint64_t)-1) cache->inflation = MAX(cache->inflation, cache->priority[k]);
+
+  // make room within our budget. this never touches the line we're about to hand out
+  // or the input of the module which is about to be processed.
+  const size_t grow = cache->size[k] < size ? size : 0;
+  while(cache->memory_used - (grow ? cache->size[k] : 0) + grow > cache->memory_limit)
+  {
+    const int victim = _cache_budget_victim(cache, k, TRUE);
+    if(victim < 0) break;
+    _cache_budget_free_line(cache, victim);
+  }
+
+  if(grow)
+  {
+    dt_free_align(cache->data[k]);
+    cache->memory_used -= cache->size[k];
+    cache->data[k] = (void *)dt_alloc_align(64, size);
+    cache->size[k] = cache->data[k] ? size : 0;
+    cache->memory_used += cache->size[k];
+    if(!cache->data[k])
+    {
+      _cache_budget_set_hash(cache, k, -1);
+      cache->cost[k] = 0.0f;
+      cache->misses++;
+      return -1;
+    }
+  }
+  *data = cache->data[k];
+
+  ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  cache->dsc[k] = **dsc;
+  *dsc = &cache->dsc[k];
+
+  _cache_budget_set_hash(cache, k, hash);
+  cache->cost[k] = 0.0f;
+  _cache_budget_touch(cache, k, weight);
+  cache->last = k;
+  cache->misses++;
+  return 1;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -114,6 +269,7 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
 
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
+  if(cache->memory_limit) return _cache_budget_lookup(cache, hash) >= 0;
   // search for hash in cache
   for(int32_t k = 0; k < cache->entries; k++)
     if(cache->hash[k] == hash) return 1;
@@ -137,12 +293,13 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 {
   cache->queries++;
   *data = NULL;
-  int max_used = -1, max = 0;
+  if(cache->memory_limit) return _cache_budget_get(cache, hash, size, data, dsc, weight);
+  int max_used = -1, max = cache->pinned == 0 ? 1 : 0;
   size_t sz = 0;
   for(int k = 0; k < cache->entries; k++)
   {
     // search for hash in cache
-    if(cache->used[k] > max_used)
+    if(cache->used[k] > max_used && k != cache->pinned)
     {
       max_used = cache->used[k];
       max = k;
@@ -171,7 +328,13 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     {
       dt_free_align(cache->data[max]);
       cache->data[max] = (void *)dt_alloc_align(64, size);
-      cache->size[max] = size;
+      cache->size[max] = cache->data[max] ? size : 0;
+      if(!cache->data[max])
+      {
+        cache->hash[max] = -1;
+        cache->misses++;
+        return -1;
+      }
     }
     *data = cache->data[max];
     sz = cache->size[max];
@@ -194,6 +357,9 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
+  if(cache->index) g_hash_table_remove_all(cache->index);
+  cache->inflation = 0.0;
+  cache->pinned = -1;
   for(int k = 0; k < cache->entries; k++)
   {
     cache->hash[k] = -1;
@@ -202,6 +368,26 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
   }
 }
 
+void dt_dev_pixelpipe_cache_pin(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  cache->pinned = -1;
+  if(cache->entries < 3) return;
+  for(int k = 0; k < cache->entries; k++)
+    if(data && cache->data[k] == data && cache->hash[k] != (uint64_t)-1) cache->pinned = k;
+}
+
+void dt_dev_pixelpipe_cache_set_backbuf(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  cache->backbuf = -1;
+  for(int k = 0; k < cache->entries; k++)
+    if(data && cache->data[k] == data) cache->backbuf = k;
+}
+
+int dt_dev_pixelpipe_cache_is_pinned(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  return cache->pinned >= 0 && cache->hash[cache->pinned] == hash;
+}
+
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
   for(int k = 0; k < cache->entries; k++)
@@ -209,6 +395,20 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
     if(cache->data[k] == data)
     {
       cache->used[k] = -cache->entries;
+      if(cache->memory_limit) _cache_budget_touch(cache, k, -cache->entries);
+    }
+  }
+}
+
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, float cost)
+{
+  if(!cache->memory_limit) return;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(data && cache->data[k] == data)
+    {
+      cache->cost[k] = cost;
+      _cache_budget_touch(cache, k, 0);
     }
   }
 }
@@ -219,20 +419,282 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
   {
     if(cache->data[k] == data)
     {
+      if(cache->index) _cache_budget_set_hash(cache, k, -1);
       cache->hash[k] = -1;
+      if(k == cache->pinned) cache->pinned = -1;
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
 }
 
+
+// the disk tier. buffers are stored as zlib compressed strips of rows, so they can be
+// (de)compressed in parallel:
+// header | uint64_t compressed size per strip | strips
+
+#define DT_PIXELPIPE_CACHE_DISK_MAGIC 0x43505444u // "DTPC"
+#define DT_PIXELPIPE_CACHE_DISK_VERSION 1
+#define DT_PIXELPIPE_CACHE_DISK_STRIP 64
+
+typedef struct dt_dev_pixelpipe_cache_disk_header_t
+{
+  uint32_t magic;
+  int32_t version;
+  uint64_t key;
+  int32_t width, height;
+  uint64_t size;
+  uint32_t strips;
+  dt_iop_buffer_dsc_t dsc;
+} dt_dev_pixelpipe_cache_disk_header_t;
+
+static void _cache_disk_dirname(char *dirname, size_t bufsize)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dirname, bufsize, "%s/pixelpipe", cachedir);
+}
+
+static void _cache_disk_filename(const uint64_t key, char *filename, size_t bufsize)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _cache_disk_dirname(dirname, sizeof(dirname));
+  snprintf(filename, bufsize, "%s/%016" PRIx64 ".dtpc", dirname, key);
+}
+
+uint64_t dt_dev_pixelpipe_cache_disk_key(const uint64_t hash, const dt_dev_pixelpipe_t *pipe)
+{
+  // the in-memory hash only knows the image id, which is not unique across libraries and
+  // knows nothing about the input buffer, nor the version of darktable which produced the pixels.
+  uint64_t key = hash;
+  const char *str[] = { pipe->image.filename, darktable_package_version };
+  for(int i = 0; i < 2; i++)
+    for(const char *c = str[i]; *c; c++) key = ((key << 5) + key) ^ *c;
+  key = ((key << 5) + key) ^ pipe->image.film_id;
+  key = ((key << 5) + key) ^ pipe->iwidth;
+  key = ((key << 5) + key) ^ pipe->iheight;
+  key = ((key << 5) + key) ^ (uint64_t)(pipe->iscale * 1e6f);
+  return key;
+}
+
+int dt_dev_pixelpipe_cache_disk_available(const uint64_t key)
+{
+  char filename[PATH_MAX] = { 0 };
+  _cache_disk_filename(key, filename, sizeof(filename));
+  return g_file_test(filename, G_FILE_TEST_IS_REGULAR);
+}
+
+int dt_dev_pixelpipe_cache_disk_read(const uint64_t key, void *data, const size_t size, const int width,
+                                     const int height, dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _cache_disk_filename(key, filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 1;
+
+  int err = 1;
+  uint64_t *csize = NULL;
+  uint8_t *blob = NULL;
+  dt_dev_pixelpipe_cache_disk_header_t header;
+  if(fread(&header, sizeof(header), 1, f) != 1) goto read_error;
+  if(header.magic != DT_PIXELPIPE_CACHE_DISK_MAGIC || header.version != DT_PIXELPIPE_CACHE_DISK_VERSION
+     || header.key != key || header.size != size || header.width != width || header.height != height
+     || header.strips != (height + DT_PIXELPIPE_CACHE_DISK_STRIP - 1) / DT_PIXELPIPE_CACHE_DISK_STRIP)
+    goto read_error;
+
+  csize = (uint64_t *)malloc(sizeof(uint64_t) * (header.strips + 1));
+  if(!csize || fread(csize + 1, sizeof(uint64_t), header.strips, f) != header.strips) goto read_error;
+  // prefix sum, csize[s] is now the offset of strip s in the blob:
+  csize[0] = 0;
+  for(uint32_t s = 0; s < header.strips; s++) csize[s + 1] += csize[s];
+  blob = (uint8_t *)malloc(csize[header.strips]);
+  if(!blob || fread(blob, 1, csize[header.strips], f) != csize[header.strips]) goto read_error;
+
+  const size_t row = size / height;
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) default(none) shared(header, csize, blob, data, failed)
+#endif
+  for(uint32_t s = 0; s < header.strips; s++)
+  {
+    const int rows = MIN(DT_PIXELPIPE_CACHE_DISK_STRIP, height - (int)s * DT_PIXELPIPE_CACHE_DISK_STRIP);
+    uLongf len = row * rows;
+    if(uncompress((Bytef *)data + row * DT_PIXELPIPE_CACHE_DISK_STRIP * s, &len, blob + csize[s],
+                  csize[s + 1] - csize[s]) != Z_OK
+       || len != row * rows)
+      failed = 1;
+  }
+  if(failed) goto read_error;
+
+  // the work profile is a pointer into this session, keep ours:
+  struct dt_iop_order_iccprofile_info_t *const work_profile_info = dsc->work_profile_info;
+  *dsc = header.dsc;
+  dsc->work_profile_info = work_profile_info;
+  err = 0;
+
+read_error:
+  free(blob);
+  free(csize);
+  fclose(f);
+  if(err)
+  {
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] failed to read `%s', removing it\n", filename);
+    g_unlink(filename);
+  }
+  return err;
+}
+
+static gint _cache_disk_sort_mtime(gconstpointer a, gconstpointer b)
+{
+  const GFileInfo *ia = (const GFileInfo *)a, *ib = (const GFileInfo *)b;
+  const guint64 ta = g_file_info_get_attribute_uint64((GFileInfo *)ia, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  const guint64 tb = g_file_info_get_attribute_uint64((GFileInfo *)ib, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  return ta < tb ? -1 : ta > tb;
+}
+
+// bytes in the disk tier, so the directory only has to be listed when it is over budget. -1 until the
+// first write looked at the directory. other instances writing to the same directory are only noticed then.
+static GMutex _cache_disk_lock;
+static int64_t _cache_disk_bytes = -1;
+
+// delete the oldest files until the disk tier fits into its budget again (limit 0 just counts), returns
+// the bytes left.
+static size_t _cache_disk_prune(const char *dirname, const size_t limit)
+{
+  GFile *dir = g_file_new_for_path(dirname);
+  GFileEnumerator *e = g_file_enumerate_children(dir, G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                                 G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                                 G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  if(!e)
+  {
+    g_object_unref(dir);
+    return 0;
+  }
+  GList *files = NULL;
+  size_t total = 0;
+  GFileInfo *info;
+  while((info = g_file_enumerator_next_file(e, NULL, NULL)))
+  {
+    if(g_str_has_suffix(g_file_info_get_name(info), ".dtpc"))
+    {
+      total += g_file_info_get_size(info);
+      files = g_list_prepend(files, info);
+    }
+    else
+      g_object_unref(info);
+  }
+  files = g_list_sort(files, _cache_disk_sort_mtime);
+  for(GList *l = files; l && limit && total > limit; l = g_list_next(l))
+  {
+    GFileInfo *i = (GFileInfo *)l->data;
+    gchar *filename = g_build_filename(dirname, g_file_info_get_name(i), NULL);
+    if(!g_unlink(filename)) total -= g_file_info_get_size(i);
+    g_free(filename);
+  }
+  g_list_free_full(files, g_object_unref);
+  g_object_unref(e);
+  g_object_unref(dir);
+  return total;
+}
+
+void dt_dev_pixelpipe_cache_disk_write(const uint64_t key, const void *data, const size_t size, const int width,
+                                       const int height, const dt_iop_buffer_dsc_t *dsc)
+{
+  if(!data || !size || width <= 0 || height <= 0) return;
+  char dirname[PATH_MAX] = { 0 }, filename[PATH_MAX] = { 0 };
+  _cache_disk_dirname(dirname, sizeof(dirname));
+  if(g_mkdir_with_parents(dirname, 0750)) return;
+  _cache_disk_filename(key, filename, sizeof(filename));
+
+  dt_dev_pixelpipe_cache_disk_header_t header = { 0 };
+  header.magic = DT_PIXELPIPE_CACHE_DISK_MAGIC;
+  header.version = DT_PIXELPIPE_CACHE_DISK_VERSION;
+  header.key = key;
+  header.width = width;
+  header.height = height;
+  header.size = size;
+  header.strips = (height + DT_PIXELPIPE_CACHE_DISK_STRIP - 1) / DT_PIXELPIPE_CACHE_DISK_STRIP;
+  header.dsc = *dsc;
+  header.dsc.work_profile_info = NULL;
+
+  const size_t row = size / height;
+  const size_t bound = compressBound(row * DT_PIXELPIPE_CACHE_DISK_STRIP);
+  uint64_t *csize = (uint64_t *)calloc(header.strips, sizeof(uint64_t));
+  uint8_t *blob = (uint8_t *)malloc(bound * header.strips);
+  if(!csize || !blob) goto write_error;
+
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) default(none) shared(header, csize, blob, data, failed)
+#endif
+  for(uint32_t s = 0; s < header.strips; s++)
+  {
+    const int rows = MIN(DT_PIXELPIPE_CACHE_DISK_STRIP, height - (int)s * DT_PIXELPIPE_CACHE_DISK_STRIP);
+    uLongf len = bound;
+    // speed matters more than ratio here, we're trying to be faster than recomputing.
+    if(compress2(blob + bound * s, &len, (const Bytef *)data + row * DT_PIXELPIPE_CACHE_DISK_STRIP * s,
+                 row * rows, Z_BEST_SPEED) != Z_OK)
+      failed = 1;
+    csize[s] = len;
+  }
+  if(failed) goto write_error;
+
+  // write to a temporary file first, other pipes might be reading or writing the same key.
+  gchar *tmpname = g_strdup_printf("%s.XXXXXX", filename);
+  const gint fd = g_mkstemp(tmpname);
+  FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if(!f)
+  {
+    if(fd >= 0) close(fd);
+    g_free(tmpname);
+    goto write_error;
+  }
+  int written = fwrite(&header, sizeof(header), 1, f) == 1
+                && fwrite(csize, sizeof(uint64_t), header.strips, f) == header.strips;
+  for(uint32_t s = 0; written && s < header.strips; s++)
+    written = fwrite(blob + bound * s, 1, csize[s], f) == csize[s];
+  written = !fclose(f) && written;
+  if(!written || g_rename(tmpname, filename))
+  {
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] failed to write `%s'\n", filename);
+    g_unlink(tmpname);
+  }
+  g_free(tmpname);
+
+  const size_t limit = (size_t)dt_conf_get_int64("pixelpipe_cache_disk_size");
+  if(written)
+  {
+    g_mutex_lock(&_cache_disk_lock);
+    if(_cache_disk_bytes < 0)
+      _cache_disk_bytes = _cache_disk_prune(dirname, limit);
+    else
+    {
+      // an overwritten key is counted twice, that only makes the next prune come a bit early
+      _cache_disk_bytes += sizeof(header) + sizeof(uint64_t) * header.strips;
+      for(uint32_t s = 0; s < header.strips; s++) _cache_disk_bytes += csize[s];
+      if(limit && (size_t)_cache_disk_bytes > limit) _cache_disk_bytes = _cache_disk_prune(dirname, limit);
+    }
+    g_mutex_unlock(&_cache_disk_lock);
+  }
+
+write_error:
+  free(blob);
+  free(csize);
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
   {
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
+    if(cache->memory_limit)
+      printf("priority %.3f cost %.3fs size %zu by %" PRIu64 "", cache->priority[k], cache->cost[k], cache->size[k],
+             cache->hash[k]);
+    else
+      printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
     printf("\n");
   }
+  if(cache->memory_limit)
+    printf("pixelpipe cache memory used %zu of %zu MB\n", cache->memory_used >> 20, cache->memory_limit >> 20);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
 }
 
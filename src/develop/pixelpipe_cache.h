@@ -18,7 +18,9 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
@@ -27,7 +29,13 @@ struct dt_iop_roi_t;
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * by default it is optimized for very few entries (~5), so most operations are O(N).
+ *
+ * if a memory limit is given on init, the cache is instead sized by that byte budget:
+ * cache lines are allocated on demand, found through a hash index and evicted
+ * by cost-aware lru (greedydual-size), so that lines which were expensive to compute
+ * per byte stay around longer. this is meant to keep all intermediate module outputs
+ * of the darkroom full pipe around.
  */
 
 typedef struct dt_dev_pixelpipe_cache_t
@@ -38,6 +46,16 @@ typedef struct dt_dev_pixelpipe_cache_t
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *hash;
   int32_t *used;
+  // byte budgeted mode, only used if memory_limit > 0:
+  size_t memory_limit;
+  size_t memory_used;
+  float *cost;        // time in seconds it took to compute each line
+  double *priority;   // greedydual priority, the lowest one is evicted first
+  double inflation;   // priority of the last evicted line
+  int32_t last;       // line most recently handed out. it's the input of the next module, never evict it.
+  GHashTable *index;  // hash -> cache line + 1
+  int32_t pinned;     // line holding the input of the focused module, never evicted. -1 if none.
+  int32_t backbuf;    // line the gui reads as the pipe's backbuf, never freed or reused. -1 if none.
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
@@ -50,6 +68,9 @@ typedef struct dt_dev_pixelpipe_cache_t
   \param[out] returns 0 if fail to allocate mem cache.
 */
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+/** constructs a new cache with at most the given cache line count, with buffers allocated on demand
+  * until memory_limit bytes are in use. the limit is soft, lines still in use are never evicted. */
+int dt_dev_pixelpipe_cache_init_budget(dt_dev_pixelpipe_cache_t *cache, int entries, size_t memory_limit);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -58,7 +79,7 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
 
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
   * cache line, the least recently used cache line will be cleared and an empty buffer is returned
-  * together with a non-zero return value. */
+  * together with a positive return value. if no buffer could be allocated, data is NULL and -1 is returned. */
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                void **data, struct dt_iop_buffer_dsc_t **dsc);
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -72,12 +93,38 @@ int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** keeps the line of this buffer until another one is pinned or it gets invalidated, no matter how much
+  * else goes through the cache. only one line is pinned at a time and caches with less than three lines
+  * never pin, they need every line for passing buffers along. */
+void dt_dev_pixelpipe_cache_pin(dt_dev_pixelpipe_cache_t *cache, void *data);
+/** the pipe's backbuf now points to this buffer. its line is neither freed nor handed out again until the next
+  * backbuf is set, the gui reads it while the pipe keeps running. call with the backbuf_mutex held. */
+void dt_dev_pixelpipe_cache_set_backbuf(dt_dev_pixelpipe_cache_t *cache, void *data);
+/** whether the line with this hash is the pinned one. */
+int dt_dev_pixelpipe_cache_is_pinned(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** remember how long it took to compute the given cache line, so eviction can prefer cheap lines. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, float cost);
+
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** combines the pipe cache hash with what makes it unique on disk: the image file, input dimensions and
+  * the darktable version. */
+uint64_t dt_dev_pixelpipe_cache_disk_key(const uint64_t hash, const struct dt_dev_pixelpipe_t *pipe);
+/** test whether the disk tier holds a buffer for the given key. */
+int dt_dev_pixelpipe_cache_disk_available(const uint64_t key);
+/** read a buffer of given size and dimensions from the disk tier into data. returns non-zero if there
+  * was no valid file for it. */
+int dt_dev_pixelpipe_cache_disk_read(const uint64_t key, void *data, const size_t size, const int width,
+                                     const int height, struct dt_iop_buffer_dsc_t *dsc);
+/** compress the buffer and store it in the disk tier under <cachedir>/pixelpipe/. */
+void dt_dev_pixelpipe_cache_disk_write(const uint64_t key, const void *data, const size_t size, const int width,
+                                       const int height, const struct dt_iop_buffer_dsc_t *dsc);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
@@ -23,6 +23,7 @@
 #include "common/imageio.h"
 #include "common/opencl.h"
 #include "common/iop_order.h"
+#include "common/profiling.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -37,6 +38,7 @@
 #include "gui/color_picker_proxy.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -92,6 +94,63 @@ static char *_pipe_type_to_str(int pipe_type)
   return r;
 }
 
+const char *dt_dev_pixelpipe_type_to_str(const int pipe_type)
+{
+  return _pipe_type_to_str(pipe_type);
+}
+
+// records one step of the pipe for --trace
+static void _trace_piece(const dt_dev_pixelpipe_t *pipe, const char *name, const double start,
+                         const uint32_t flags, const dt_iop_roi_t *roi_out, const size_t bufsize,
+                         const size_t peak_bytes)
+{
+  if(!dt_trace_enabled()) return;
+  const dt_trace_event_t ev = { .name = name,
+                                .category = "module",
+                                .pipe = _pipe_type_to_str(pipe->type),
+                                .imgid = pipe->image.id,
+                                .start = start,
+                                .end = dt_get_wtime(),
+                                .flags = flags,
+                                .width = roi_out->width,
+                                .height = roi_out->height,
+                                .bytes = bufsize,
+                                .peak_bytes = peak_bytes };
+  dt_trace_event(&ev);
+}
+
+// records that a module or the whole pipe gave up on opencl for --trace, with the time lost on the gpu
+static void _trace_fallback(const dt_dev_pixelpipe_t *pipe, const char *name, const double start)
+{
+  if(!dt_trace_enabled()) return;
+  const dt_trace_event_t ev = { .name = name,
+                                .category = "fallback",
+                                .pipe = _pipe_type_to_str(pipe->type),
+                                .imgid = pipe->image.id,
+                                .start = start,
+                                .end = dt_get_wtime(),
+                                .flags = DT_TRACE_ON_GPU | DT_TRACE_FAILED };
+  dt_trace_event(&ev);
+}
+
+// records a full run of the pipe for --trace
+static void _trace_pipe(const dt_dev_pixelpipe_t *pipe, const double start, const dt_iop_roi_t *roi,
+                        const gboolean failed)
+{
+  if(!dt_trace_enabled()) return;
+  const dt_trace_event_t ev = { .name = "pixelpipe",
+                                .category = "pipe",
+                                .pipe = _pipe_type_to_str(pipe->type),
+                                .imgid = pipe->image.id,
+                                .start = start,
+                                .end = dt_get_wtime(),
+                                .flags = failed ? DT_TRACE_FAILED : DT_TRACE_NONE,
+                                .width = roi->width,
+                                .height = roi->height,
+                                .bytes = (size_t)roi->width * roi->height * 4 * sizeof(float) };
+  dt_trace_event(&ev);
+}
+
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
@@ -127,22 +186,30 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
+  // with a memory budget, keep as many module outputs of the full pipe as fit into it.
+  const int64_t cache_memory = dt_conf_get_int64("pixelpipe_cache_memory");
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  int res = cache_memory > 0 ? dt_dev_pixelpipe_init_budget(pipe, cache_memory)
+                             : dt_dev_pixelpipe_init_cached(pipe, 0, 5);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+static int _dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memory_limit)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
+  pipe->first_dirty = 0;
   pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  if(memory_limit)
+  {
+    if(!dt_dev_pixelpipe_cache_init_budget(&(pipe->cache), entries, memory_limit)) return 0;
+  }
+  else if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size))
+    return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->processing = 0;
@@ -165,6 +232,16 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   return 1;
 }
 
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+{
+  return _dev_pixelpipe_init(pipe, size, entries, 0);
+}
+
+int dt_dev_pixelpipe_init_budget(dt_dev_pixelpipe_t *pipe, size_t memory_limit)
+{
+  return _dev_pixelpipe_init(pipe, 0, DT_DEV_PIXELPIPE_CACHE_BUDGET_LINES, memory_limit);
+}
+
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, float *input, int width, int height,
                                 float iscale)
 {
@@ -292,21 +369,34 @@ void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *
   // find piece in nodes list
   GList *nodes = pipe->nodes;
   dt_dev_pixelpipe_iop_t *piece = NULL;
+  int pos = 0;
   while(nodes)
   {
     piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
     if(piece->module == hist->module)
     {
+      const uint64_t hash = piece->hash;
       piece->enabled = hist->enabled;
       dt_iop_commit_params(hist->module, hist->params, hist->blend_params, pipe, piece);
+      if(piece->hash != hash) pipe->first_dirty = MIN(pipe->first_dirty, pos);
     }
     nodes = g_list_next(nodes);
+    pos++;
   }
 }
 
 void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&pipe->busy_mutex);
+  // remember the old hashes, to find the first node which really changed
+  const int nodes_count = g_list_length(pipe->nodes);
+  uint64_t *hashes = malloc(sizeof(uint64_t) * MAX(nodes_count, 1));
+  int pos = 0;
+  for(GList *l = pipe->nodes; l; l = g_list_next(l))
+    hashes[pos++] = ((dt_dev_pixelpipe_iop_t *)l->data)->hash;
+  // replaying the history compares against the defaults committed below, which says nothing about what
+  // changed since the last run. only the comparison with the old hashes counts.
+  const int first_dirty = pipe->first_dirty;
   // call reset_params on all pieces first.
   GList *nodes = pipe->nodes;
   while(nodes)
@@ -325,6 +415,11 @@ void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     dt_dev_pixelpipe_synch(pipe, dev, history);
     history = g_list_next(history);
   }
+  pipe->first_dirty = first_dirty;
+  pos = 0;
+  for(GList *l = pipe->nodes; l && pos < pipe->first_dirty; l = g_list_next(l), pos++)
+    if(((dt_dev_pixelpipe_iop_t *)l->data)->hash != hashes[pos]) pipe->first_dirty = pos;
+  free(hashes);
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
@@ -356,6 +451,7 @@ void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
     dt_dev_pixelpipe_cleanup_nodes(pipe);
     dt_dev_pixelpipe_create_nodes(pipe, dev);
     dt_dev_pixelpipe_synch_all(pipe, dev);
+    pipe->first_dirty = 0;
   }
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
   dt_pthread_mutex_unlock(&dev->history_mutex);
@@ -1002,6 +1098,39 @@ static void _pixelpipe_final_histogram_waveform(dt_develop_t *dev, const float *
   free(buf);
 }
 
+// should the output of this module be spilled to the disk tier of the pixelpipe cache? only for exports and
+// the whole image in darkroom, the regions of a panned or zoomed center view are hardly ever asked for again.
+static gboolean _pixelpipe_cache_disk_module(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                                             const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_out)
+{
+  if(!module || !piece) return FALSE;
+  if(!(pipe->type & DT_DEV_PIXELPIPE_EXPORT))
+  {
+    if(!(pipe->type & DT_DEV_PIXELPIPE_FULL)) return FALSE;
+    if(roi_out->x != 0 || roi_out->y != 0
+       || roi_out->width < (int)(piece->buf_out.width * roi_out->scale)
+       || roi_out->height < (int)(piece->buf_out.height * roi_out->scale))
+      return FALSE;
+  }
+  if(!dt_conf_get_bool("pixelpipe_cache_disk")) return FALSE;
+
+  gboolean found = FALSE;
+  gchar *ops = dt_conf_get_string("pixelpipe_cache_disk_modules");
+  gchar **list = g_strsplit(ops, ",", -1);
+  for(gchar **op = list; *op && !found; op++) found = !strcmp(g_strstrip(*op), module->op);
+  g_strfreev(list);
+  g_free(ops);
+  return found;
+}
+
+// no memory for a cache line, the pipe can't go on
+static int _cache_line_failed(const dt_dev_pixelpipe_t *pipe, const char *module_name)
+{
+  fprintf(stderr, "[dev_pixelpipe] [%s] couldn't allocate the output of %s, out of memory\n",
+          _pipe_type_to_str(pipe->type), module_name);
+  return 1;
+}
+
 // returns 1 if blend process need the module default colorspace
 static int _transform_for_blend(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const int cst_in, const int cst_out)
 {
@@ -1061,16 +1190,55 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // if(module) printf("found valid buf pos %d in cache for module %s %s %lu\n", pos, module->op, pipe ==
     // dev->preview_pipe ? "[preview]" : "", hash);
 
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+    if(dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format) < 0)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return _cache_line_failed(pipe, module ? module_name : "input");
+    }
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    if(pos == pipe->first_dirty)
+      dt_print(DT_DEBUG_DEV, "[dev_pixelpipe] [%s] restarting behind %s from %s cache line\n",
+               _pipe_type_to_str(pipe->type), module ? module_name : "input",
+               dt_dev_pixelpipe_cache_is_pinned(&pipe->cache, hash) ? "the pinned" : "a");
     if(!modules) return 0;
+    _trace_piece(pipe, module_name, dt_get_wtime(), DT_TRACE_CACHE_HIT, roi_out, bufsize, bufsize);
     // go to post-collect directly:
     goto post_process_collect_info;
   }
   else
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
+  // 1b) expensive early modules might have spilled their output to disk in an earlier session
+  const gboolean cache_disk = _pixelpipe_cache_disk_module(pipe, module, piece, roi_out);
+  if(cache_disk && dt_dev_pixelpipe_cache_disk_available(dt_dev_pixelpipe_cache_disk_key(hash, pipe)))
+  {
+    dt_pthread_mutex_lock(&pipe->busy_mutex);
+    if(pipe->shutdown)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return 1;
+    }
+    dt_times_t start;
+    dt_get_times(&start);
+    if(dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format) < 0)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return _cache_line_failed(pipe, module_name);
+    }
+    const int err = dt_dev_pixelpipe_cache_disk_read(dt_dev_pixelpipe_cache_disk_key(hash, pipe), *output, bufsize,
+                                                     roi_out->width, roi_out->height, *out_format);
+    if(err) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    if(!err)
+    {
+      dt_show_times(&start, "[dev_pixelpipe]", "read %s from disk cache [%s]", module_name,
+                    _pipe_type_to_str(pipe->type));
+      _trace_piece(pipe, module_name, start.clock, DT_TRACE_DISK_CACHE_HIT, roi_out, bufsize, bufsize);
+      goto post_process_collect_info;
+    }
+  }
+
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
   if(dt_iop_breakpoint(dev, pipe)) return 1;
@@ -1101,6 +1269,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       }
       else if(dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format))
       {
+        if(!*output)
+        {
+          dt_pthread_mutex_unlock(&pipe->busy_mutex);
+          return _cache_line_failed(pipe, "input");
+        }
         memset(*output, 0, bufsize);
         if(roi_in.scale == 1.0f)
         {
@@ -1135,6 +1308,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     dt_show_times(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    _trace_piece(pipe, "input", start.clock, DT_TRACE_ON_CPU, roi_out, bufsize, bufsize);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
   }
   else
@@ -1183,10 +1357,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       return 1;
     }
 
-    if(!strcmp(module->op, "gamma"))
-      (void)dt_dev_pixelpipe_cache_get_important(&(pipe->cache), hash, bufsize, output, out_format);
-    else
-      (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+    const int got = !strcmp(module->op, "gamma")
+                        ? dt_dev_pixelpipe_cache_get_important(&(pipe->cache), hash, bufsize, output, out_format)
+                        : dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+    if(got < 0)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return _cache_line_failed(pipe, module_name);
+    }
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
@@ -1725,6 +1903,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           /* Bad luck, opencl failed. Let's clean up and fall back to cpu module */
           dt_print(DT_DEBUG_OPENCL, "[opencl_pixelpipe] could not run module '%s' on gpu. falling back to cpu path\n",
                    module->op);
+          _trace_fallback(pipe, module->op, start.clock);
 
           // fprintf(stderr, "[opencl_pixelpipe 4] module '%s' running on cpu\n", module->op);
 
@@ -2281,15 +2460,44 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     g_free(module_label);
     module_label = NULL;
 
+    if(dt_trace_enabled())
+    {
+      uint32_t trace_flags = DT_TRACE_NONE;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) trace_flags |= DT_TRACE_ON_GPU;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_CPU) trace_flags |= DT_TRACE_ON_CPU;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING) trace_flags |= DT_TRACE_TILING;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_GPU) trace_flags |= DT_TRACE_BLEND_GPU;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_CPU) trace_flags |= DT_TRACE_BLEND_CPU;
+      // what the module asked for in its tiling callback, i.e. what it would take untiled
+      const size_t peak_bytes = (size_t)(tiling.factor * MAX(roi_in.width, roi_out->width)
+                                         * MAX(roi_in.height, roi_out->height) * MAX(in_bpp, bpp))
+                                + tiling.overhead;
+      _trace_piece(pipe, module_name, start.clock, trace_flags, roi_out, bufsize, peak_bytes);
+    }
+
+    // remember what it took to compute this buffer, so a budgeted cache keeps expensive ones longer:
+    dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, dt_get_wtime() - start.clock);
+
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
+    if(cache_disk)
+    {
+#ifdef HAVE_OPENCL
+      if(*cl_mem_output != NULL)
+        dt_opencl_copy_device_to_host(pipe->devid, *output, *cl_mem_output, roi_out->width, roi_out->height, bpp);
+#endif
+      dt_dev_pixelpipe_cache_disk_write(dt_dev_pixelpipe_cache_disk_key(hash, pipe), *output, bufsize,
+                                        roi_out->width, roi_out->height, *out_format);
+    }
+
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(module == darktable.develop->gui_module)
     {
-      // give the input buffer to the currently focussed plugin more weight.
-      // the user is likely to change that one soon, so keep it in cache.
+      // keep the input buffer of the currently focussed plugin. the user is likely to change that one
+      // soon, and then only it and the modules after it have to run again.
       dt_dev_pixelpipe_cache_reweight(&(pipe->cache), input);
+      dt_dev_pixelpipe_cache_pin(&(pipe->cache), input);
     }
 #ifndef _DEBUG
     if(darktable.unmuted & DT_DEBUG_NAN)
@@ -2549,6 +2757,7 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
 {
+  const double trace_start = dt_get_wtime();
   pipe->processing = 1;
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
@@ -2563,7 +2772,11 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
     dt_print_mem_usage();
   }
 
-  if(pipe->devid >= 0) dt_opencl_events_reset(pipe->devid);
+  if(pipe->devid >= 0)
+  {
+    dt_opencl_events_reset(pipe->devid);
+    dt_opencl_events_set_owner(pipe->devid, _pipe_type_to_str(pipe->type), pipe->image.id);
+  }
 
   dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
   // printf("pixelpipe homebrew process start\n");
@@ -2633,6 +2846,7 @@ restart:
     dt_dev_pixelpipe_change(pipe, dev);
     dt_print(DT_DEBUG_OPENCL, "[pixelpipe_process] [%s] falling back to cpu path\n",
              _pipe_type_to_str(pipe->type));
+    _trace_fallback(pipe, "pixelpipe", trace_start);
     goto restart; // try again (this time without opencl)
   }
 
@@ -2651,6 +2865,7 @@ restart:
   if(err)
   {
     pipe->processing = 0;
+    _trace_pipe(pipe, trace_start, &roi, TRUE);
     return 1;
   }
 
@@ -2658,12 +2873,15 @@ restart:
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
   pipe->backbuf = buf;
+  dt_dev_pixelpipe_cache_set_backbuf(&pipe->cache, buf);
   pipe->backbuf_width = width;
   pipe->backbuf_height = height;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
   // printf("pixelpipe homebrew process end\n");
+  pipe->first_dirty = INT_MAX;
   pipe->processing = 0;
+  _trace_pipe(pipe, trace_start, &roi, FALSE);
   return 0;
 }
 
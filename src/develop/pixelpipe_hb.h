@@ -111,6 +111,10 @@ typedef struct dt_dev_pixelpipe_t
   GList *nodes;
   // event flag
   dt_dev_pixelpipe_change_t changed;
+  // position of the first node whose parameters changed since the last complete run, INT_MAX if none.
+  // everything before it is still valid, so a run has to restart there at the latest. only reported with
+  // -d dev, the cache lookups go by hash and so also find buffers behind it when parameters were reverted.
+  int first_dirty;
   // backbuffer (output)
   uint8_t *backbuf;
   size_t backbuf_size;
@@ -154,6 +158,9 @@ typedef struct dt_dev_pixelpipe_t
 
 struct dt_develop_t;
 
+// max number of cache lines of a pixelpipe cache sized by a memory budget.
+#define DT_DEV_PIXELPIPE_CACHE_BUDGET_LINES 128
+
 // inits the pixelpipe with plain passthrough input/output and empty input and default caching settings.
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe);
 // inits the preview pixelpipe with plain passthrough input/output and empty input and default caching
@@ -169,6 +176,8 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
 // inits the pixelpipe with given cacheline size and number of entries.
 int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// inits the pixelpipe with a cache sized by the given amount of bytes instead of a fixed number of lines.
+int dt_dev_pixelpipe_init_budget(dt_dev_pixelpipe_t *pipe, size_t memory_limit);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -198,6 +207,8 @@ void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 // adjust output node according to history stack (history pop event)
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
+// name of the pipe type, for debug output and traces
+const char *dt_dev_pixelpipe_type_to_str(const int pipe_type);
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
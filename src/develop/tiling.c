@@ -19,6 +19,7 @@
 
 #include "develop/tiling.h"
 #include "common/opencl.h"
+#include "common/profiling.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
@@ -91,6 +92,24 @@ void _print_roi(const dt_iop_roi_t *roi, const char *label)
   printf("{ %5d  %5d  %5d  %5d  %.6f } %s\n", roi->x, roi->y, roi->width, roi->height, roi->scale, label);
 }
 
+// records one tile for --trace, from copying its input to having its output back in place
+static void _trace_tile(const struct dt_iop_module_t *self, const struct dt_dev_pixelpipe_iop_t *piece,
+                        const double start, const dt_iop_roi_t *roi, const int devid)
+{
+  if(!dt_trace_enabled()) return;
+  const dt_trace_event_t ev = { .name = self->op,
+                                .category = "tile",
+                                .pipe = dt_dev_pixelpipe_type_to_str(piece->pipe->type),
+                                .imgid = piece->pipe->image.id,
+                                .start = start,
+                                .end = dt_get_wtime(),
+                                .flags = DT_TRACE_TILING | (devid >= 0 ? DT_TRACE_ON_GPU : DT_TRACE_ON_CPU),
+                                .width = roi->width,
+                                .height = roi->height,
+                                .devid = devid };
+  dt_trace_event(&ev);
+}
+
 
 #if 0
 static void
@@ -729,6 +748,7 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
       piece->pipe->tiling = 1;
+      const double tile_start = dt_get_wtime();
 
       const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
 
@@ -799,6 +819,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
       for(size_t j = 0; j < region[1]; j++)
         memcpy((char *)ovoid + ooffs + j * opitch,
                (char *)output + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
+
+      _trace_tile(self, piece, tile_start, &oroi, -1);
     }
   }
 
@@ -987,6 +1009,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
       piece->pipe->tiling = 1;
+      const double tile_start = dt_get_wtime();
 
       /* the output dimensions of the good part of this specific tile */
       size_t wd = (tx + 1) * tile_wd > roi_out->width ? roi_out->width - tx * tile_wd : tile_wd;
@@ -1135,6 +1158,8 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
       dt_free_align(input);
       dt_free_align(output);
       input = output = NULL;
+
+      _trace_tile(self, piece, tile_start, &oroi_good, -1);
     }
 
   /* copy back final processed_maximum */
@@ -1373,6 +1398,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
       piece->pipe->tiling = 1;
+      const double tile_start = dt_get_wtime();
 
       size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
       size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
@@ -1498,6 +1524,8 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       /* block until opencl queue has finished to free all used event handlers */
       if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
         dt_opencl_finish(devid);
+
+      _trace_tile(self, piece, tile_start, &oroi, devid);
     }
 
   /* copy back final processed_maximum */
@@ -1750,6 +1778,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
       piece->pipe->tiling = 1;
+      const double tile_start = dt_get_wtime();
 
       /* the output dimensions of the good part of this specific tile */
       size_t wd = (tx + 1) * tile_wd > roi_out->width ? roi_out->width - tx * tile_wd : tile_wd;
@@ -1935,6 +1964,8 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       /* block until opencl queue has finished to free all used event handlers */
       if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
         dt_opencl_finish(devid);
+
+      _trace_tile(self, piece, tile_start, &oroi_good, devid);
     }
 
   /* copy back final processed_maximum */
@@ -18,7 +18,9 @@
 */
 
 #include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib/gstdio.h> // for g_fopen, g_rename, g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
+#include <inttypes.h> // for PRIx64, SCNx64
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
 #include <sqlite3.h> // for sqlite3_column_int, etc
@@ -27,12 +29,13 @@
 #include <stdio.h>   // for fprintf, stderr, snprintf, NULL, etc
 #include <stdlib.h>  // for exit, EXIT_FAILURE
 #include <string.h>  // for strcmp
-#include <unistd.h>  // for access, R_OK
 
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
+#include "common/image.h"        // for dt_image_altered
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
+#include "common/worker_pool.h"  // for dt_worker_pool_t, dt_worker_pool_run, etc
 #include "config.h"              // for GETTEXT_PACKAGE, etc
 #include "control/conf.h"        // for dt_conf_get_bool
 
@@ -40,7 +43,241 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// write the resume point at most that often
+#define DT_GENERATE_CACHE_CHECKPOINT_INTERVAL 10.0
+
+typedef struct dt_generate_cache_job_t
+{
+  int32_t imgid;
+  int64_t write_timestamp;
+  uint64_t history_hash;
+  size_t width, height;
+  gboolean done;
+} dt_generate_cache_job_t;
+
+typedef struct dt_generate_cache_t
+{
+  GMutex lock;
+  dt_generate_cache_job_t *jobs;
+  size_t num_jobs;
+  size_t completed; // all jobs before this one are done, that's what gets checkpointed
+
+  dt_mipmap_size_t min_mip, max_mip;
+  int32_t min_imgid, max_imgid;
+  char checkpoint[PATH_MAX];
+  double last_checkpoint;
+  // history hash each image's thumbnails were generated from, imgid -> uint64_t
+  GHashTable *history;
+  char history_file[PATH_MAX];
+
+  // stats, all in seconds
+  size_t generated, skipped;
+  double time_decode, time_pipe, time_encode;
+} dt_generate_cache_t;
+
+static void _checkpoint_filename(char *filename, size_t size)
+{
+  snprintf(filename, size, "%s.d/generate-cache.progress", darktable.mipmap_cache->cachedir);
+}
+
+static void _history_filename(char *filename, size_t size)
+{
+  snprintf(filename, size, "%s.d/generate-cache.history", darktable.mipmap_cache->cachedir);
+}
+
+static void _history_read(dt_generate_cache_t *g)
+{
+  g->history = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  FILE *f = g->history_file[0] ? g_fopen(g->history_file, "rb") : NULL;
+  if(!f) return;
+  int32_t imgid;
+  uint64_t hash;
+  while(fscanf(f, "%d %" SCNx64, &imgid, &hash) == 2)
+  {
+    uint64_t *value = g_new(uint64_t, 1);
+    *value = hash;
+    g_hash_table_insert(g->history, GINT_TO_POINTER(imgid), value);
+  }
+  fclose(f);
+}
+
+// needs the lock.
+static void _history_write(const dt_generate_cache_t *g)
+{
+  if(!g->history_file[0]) return;
+  char tmpname[PATH_MAX] = { 0 };
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", g->history_file);
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f) return;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, g->history);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    fprintf(f, "%d %" PRIx64 "\n", GPOINTER_TO_INT(key), *(uint64_t *)value);
+  fclose(f);
+  g_rename(tmpname, g->history_file);
+}
+
+// needs the lock.
+static void _history_set(dt_generate_cache_t *g, const dt_generate_cache_job_t *job)
+{
+  uint64_t *value = g_new(uint64_t, 1);
+  *value = job->history_hash;
+  g_hash_table_insert(g->history, GINT_TO_POINTER(job->imgid), value);
+}
+
+// hashes all columns of the rows of a statement into hash
+static uint64_t _hash_rows(sqlite3_stmt *stmt, uint64_t hash)
+{
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    for(int c = 0; c < sqlite3_column_count(stmt); c++)
+    {
+      // bernstein hash (djb2), as for the pixelpipe cache
+      const char *data = (const char *)sqlite3_column_blob(stmt, c);
+      const int size = sqlite3_column_bytes(stmt, c);
+      for(int i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ data[i];
+      hash = ((hash << 5) + hash) ^ sqlite3_column_type(stmt, c);
+    }
+  return hash;
+}
+
+// what the thumbnail depends on, the history up to its end and the shapes
+static uint64_t _history_hash(sqlite3_stmt *history, sqlite3_stmt *masks, const int32_t imgid)
+{
+  uint64_t hash = 5381;
+  DT_DEBUG_SQLITE3_RESET(history);
+  DT_DEBUG_SQLITE3_BIND_INT(history, 1, imgid);
+  hash = _hash_rows(history, hash);
+  DT_DEBUG_SQLITE3_RESET(masks);
+  DT_DEBUG_SQLITE3_BIND_INT(masks, 1, imgid);
+  return _hash_rows(masks, hash);
+}
+
+// returns the last image id of a previous, interrupted run with the same parameters, or 0
+static int32_t _checkpoint_read(const dt_generate_cache_t *g)
+{
+  FILE *f = g_fopen(g->checkpoint, "rb");
+  if(!f) return 0;
+  int min_mip = -1, max_mip = -1, done = 0;
+  int32_t min_imgid = -1, max_imgid = -1;
+  const int rd = fscanf(f, "%d %d %d %d %d", &min_mip, &max_mip, &min_imgid, &max_imgid, &done);
+  fclose(f);
+  if(rd != 5 || min_mip != g->min_mip || max_mip != g->max_mip || min_imgid != g->min_imgid
+     || max_imgid != g->max_imgid)
+    return 0;
+  return done;
+}
+
+// writes the resume point, needs the lock.
+static void _checkpoint_write(dt_generate_cache_t *g)
+{
+  if(!g->checkpoint[0] || g->completed == 0) return;
+  char tmpname[PATH_MAX] = { 0 };
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", g->checkpoint);
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f) return;
+  fprintf(f, "%d %d %d %d %d\n", g->min_mip, g->max_mip, g->min_imgid, g->max_imgid,
+          g->jobs[g->completed - 1].imgid);
+  fclose(f);
+  g_rename(tmpname, g->checkpoint);
+  g->last_checkpoint = dt_get_wtime();
+}
+
+// whether all requested thumbnails are on disk and were generated from the current history. thumbnails from
+// before the history was recorded here count if they are newer than the last sidecar write.
+static gboolean _thumbnails_current(dt_generate_cache_t *g, const dt_generate_cache_job_t *job)
+{
+  g_mutex_lock(&g->lock);
+  const uint64_t *recorded = (uint64_t *)g_hash_table_lookup(g->history, GINT_TO_POINTER(job->imgid));
+  const gboolean known = recorded != NULL;
+  const gboolean same = known && *recorded == job->history_hash;
+  g_mutex_unlock(&g->lock);
+  if(known && !same) return FALSE;
+
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+  {
+    const int64_t timestamp = dt_mipmap_cache_get_ondisk_thumbnail_timestamp(darktable.mipmap_cache, job->imgid, k);
+    if(timestamp == 0 || (!known && timestamp < job->write_timestamp)) return FALSE;
+  }
+  return TRUE;
+}
+
+static void _process_image(dt_generate_cache_t *g, dt_generate_cache_job_t *job)
+{
+  const int32_t imgid = job->imgid;
+
+  if(_thumbnails_current(g, job))
+  {
+    g_mutex_lock(&g->lock);
+    g->skipped++;
+    _history_set(g, job);
+    g_mutex_unlock(&g->lock);
+    return;
+  }
+
+  // outdated thumbnails on disk would never be replaced, drop them first:
+  dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+
+  // edited images (or all of them, if embedded thumbnails are not wanted) go through the full pipe.
+  // decode the raw up front then, so we know how long that took. the pipe picks it up from the cache.
+  double start = dt_get_wtime();
+  double decode = 0.0;
+  if(dt_image_altered(imgid) || dt_conf_get_bool("never_use_embedded_thumb"))
+  {
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    decode = dt_get_wtime() - start;
+    start = dt_get_wtime();
+  }
+
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+  {
+    // generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  const double pipe = dt_get_wtime() - start;
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  start = dt_get_wtime();
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  const double encode = dt_get_wtime() - start;
+
+  g_mutex_lock(&g->lock);
+  g->generated++;
+  _history_set(g, job);
+  g->time_decode += decode;
+  g->time_pipe += pipe;
+  g->time_encode += encode;
+  g_mutex_unlock(&g->lock);
+}
+
+static void _worker_run(void *data, void *worker, const int n)
+{
+  dt_generate_cache_t *g = (dt_generate_cache_t *)data;
+  dt_generate_cache_job_t *job = g->jobs + n;
+
+  _process_image(g, job);
+
+  g_mutex_lock(&g->lock);
+  job->done = TRUE;
+  while(g->completed < g->num_jobs && g->jobs[g->completed].done) g->completed++;
+  const size_t counter = g->generated + g->skipped;
+  fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, g->num_jobs, 100.0 * counter / (float)g->num_jobs,
+          job->imgid);
+  if(dt_get_wtime() - g->last_checkpoint > DT_GENERATE_CACHE_CHECKPOINT_INTERVAL)
+  {
+    _history_write(g);
+    _checkpoint_write(g);
+  }
+  g_mutex_unlock(&g->lock);
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    const int32_t min_imgid, const int32_t max_imgid, const int num_workers,
+                                    int memory_limit, const gboolean restart)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -56,13 +293,30 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
+  dt_generate_cache_t g = { 0 };
+  g.min_mip = min_mip;
+  g.max_mip = max_mip;
+  g.min_imgid = min_imgid;
+  g.max_imgid = max_imgid;
+  if(darktable.mipmap_cache->cachedir[0])
+  {
+    _checkpoint_filename(g.checkpoint, sizeof(g.checkpoint));
+    _history_filename(g.history_file, sizeof(g.history_file));
+  }
+  _history_read(&g);
+
+  // pick up where an interrupted run stopped
+  const int32_t resume = restart ? 0 : _checkpoint_read(&g);
+  if(resume) fprintf(stderr, _("resuming after image id %d\n"), resume);
+
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t image_count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2 AND id > ?3", -1,
+                              &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, resume);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     image_count = sqlite3_column_int(stmt, 0);
@@ -82,39 +336,67 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
+  g.jobs = (dt_generate_cache_job_t *)calloc(MAX(image_count, 1), sizeof(dt_generate_cache_job_t));
+
+  // collect all images, in id order so the checkpoint can be a single id:
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, write_timestamp, width, height FROM main.images"
+                              " WHERE id >= ?1 AND id <= ?2 AND id > ?3 ORDER BY id",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, resume);
+  sqlite3_stmt *history_stmt, *masks_stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT h.num, h.module, h.operation, h.op_params, h.enabled, h.blendop_params,"
+                              " h.blendop_version, h.multi_priority, h.multi_name, h.iop_order"
+                              " FROM main.history AS h, main.images AS i"
+                              " WHERE h.imgid = ?1 AND i.id = ?1 AND h.num < i.history_end ORDER BY h.num",
+                              -1, &history_stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, formid, form, name, version, points, points_count, source"
+                              " FROM main.masks_history WHERE imgid = ?1 ORDER BY num, formid",
+                              -1, &masks_stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW && g.num_jobs < image_count)
   {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    dt_generate_cache_job_t *job = g.jobs + g.num_jobs++;
+    job->imgid = sqlite3_column_int(stmt, 0);
+    job->write_timestamp = sqlite3_column_int64(stmt, 1);
+    job->history_hash = _history_hash(history_stmt, masks_stmt, job->imgid);
+    job->width = sqlite3_column_int(stmt, 2);
+    job->height = sqlite3_column_int(stmt, 3);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_finalize(history_stmt);
+  sqlite3_finalize(masks_stmt);
 
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid);
+  dt_worker_pool_t pool;
+  dt_worker_pool_init(&pool, g.num_jobs, num_workers, memory_limit);
+  for(size_t k = 0; k < g.num_jobs; k++) dt_worker_pool_set_image_size(&pool, k, g.jobs[k].width, g.jobs[k].height);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  g_mutex_init(&g.lock);
+  g.last_checkpoint = dt_get_wtime();
 
-      // if the thumbnail is already on disc - do nothing
-      if(!access(filename, R_OK)) continue;
+  const double start = dt_get_wtime();
+  dt_worker_pool_run(&pool, "generate_cache", NULL, _worker_run, NULL, &g);
+  const double seconds = dt_get_wtime() - start;
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-  }
+  // everything went through, next run starts from scratch again
+  _history_write(&g);
+  if(g.checkpoint[0]) g_unlink(g.checkpoint);
 
-  sqlite3_finalize(stmt);
   fprintf(stderr, "done\n");
-
+  fprintf(stderr, _("%zu thumbnails generated, %zu images already up to date, %.1f s, %.2f images/s\n"),
+          g.generated, g.skipped, seconds, g.num_jobs / MAX(seconds, 1e-6));
+  const double busy = MAX(g.time_decode + g.time_pipe + g.time_encode, 1e-6);
+  fprintf(stderr, _("time spent in decode %.1f s (%.0f%%), pipe %.1f s (%.0f%%), encode %.1f s (%.0f%%)\n"),
+          g.time_decode, 100.0 * g.time_decode / busy, g.time_pipe, 100.0 * g.time_pipe / busy, g.time_encode,
+          100.0 * g.time_encode / busy);
+
+  dt_worker_pool_cleanup(&pool);
+  free(g.jobs);
+  g_hash_table_destroy(g.history);
+  g_mutex_clear(&g.lock);
   return 0;
 }
 
@@ -125,13 +407,18 @@ static void usage(const char *progname)
       "usage: %s [-h, --help; --version]\n"
       "  [--min-mip <0-7> (default = 0)] [-m, --max-mip <0-7> (default = 2)]\n"
       "  [--min-imgid <N>] [--max-imgid <N>]\n"
+      "  [-j, --jobs <N> (default = number of cpus)] [--memory <MB>] [--restart]\n"
       "  [--core <darktable options>]\n"
       "\n"
       "When multiple mipmap sizes are requested, the biggest one is computed\n"
       "while the rest are quickly downsampled.\n"
       "\n"
       "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-      "numbers to work on.\n",
+      "numbers to work on.\n"
+      "\n"
+      "--jobs sets the number of images processed at the same time, --memory\n"
+      "the memory all of them may use together (default = host_memory_limit).\n"
+      "An interrupted run resumes where it stopped, unless --restart is given.\n",
       progname);
 }
 
@@ -148,6 +435,9 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int num_workers = 0;
+  int memory_limit = -1;
+  gboolean restart = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -182,6 +472,20 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      num_workers = MAX(atoi(arg[k]), 1);
+    }
+    else if(!strcmp(arg[k], "--memory") && argc > k + 1)
+    {
+      k++;
+      memory_limit = MAX(atoi(arg[k]), 0);
+    }
+    else if(!strcmp(arg[k], "--restart"))
+    {
+      restart = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -225,7 +529,9 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(num_workers == 0) num_workers = dt_get_num_threads();
+
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, num_workers, memory_limit, restart))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
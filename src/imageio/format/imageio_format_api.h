@@ -80,6 +80,17 @@ int bpp(struct dt_imageio_module_data_t *data);
 int write_image(struct dt_imageio_module_data_t *data, const char *filename, const void *in,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe);
+/* optional: write the file strip by strip. exports then hand over the output a few rows at a time, converted
+ * in place to the bit depth of bpp(), and huge ones don't need the full frame in memory at all.
+ * begin returns an opaque handle (NULL on failure), filename and exif have to stay valid until end. */
+void *write_image_begin(struct dt_imageio_module_data_t *data, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe);
+/* rows y .. y+rows-1 in the same layout write_image gets, in order from top to bottom. */
+int write_image_rows(struct dt_imageio_module_data_t *data, void *handle, const void *in, const int y,
+                     const int rows);
+/* finishes the file and frees the handle. a failed or incomplete file is removed. */
+int write_image_end(struct dt_imageio_module_data_t *data, void *handle, const int failed);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 int levels(struct dt_imageio_module_data_t *data);
 
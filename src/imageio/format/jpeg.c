@@ -28,6 +28,7 @@
 #include "common/imageio_module.h"
 #include "control/conf.h"
 #include "imageio/format/imageio_format_api.h"
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <setjmp.h>
 #include <stdio.h>
@@ -310,40 +311,68 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
-int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+// state of a file being written strip by strip
+typedef struct dt_imageio_jpeg_stream_t
 {
-  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
-  const uint8_t *in = (const uint8_t *)in_tmp;
+  struct jpeg_compress_struct cinfo;
   struct dt_imageio_jpeg_error_mgr jerr;
+  FILE *f;
+  uint8_t *row;
+  const char *filename;
+  void *exif;
+  int exif_len;
+} dt_imageio_jpeg_stream_t;
 
-  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
-  if(setjmp(jerr.setjmp_buffer))
+static void _stream_free(dt_imageio_jpeg_stream_t *s)
+{
+  jpeg_destroy_compress(&(s->cinfo));
+  if(s->f) fclose(s->f);
+  free(s->row);
+  free(s);
+}
+
+void *write_image_begin(dt_imageio_module_data_t *jpg_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *s = (dt_imageio_jpeg_stream_t *)calloc(1, sizeof(dt_imageio_jpeg_stream_t));
+  if(!s) return NULL;
+  s->filename = filename;
+  s->exif = exif;
+  s->exif_len = exif_len;
+
+  s->cinfo.err = jpeg_std_error(&s->jerr.pub);
+  s->jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(s->jerr.setjmp_buffer))
   {
-    jpeg_destroy_compress(&(jpg->cinfo));
-    return 1;
+    _stream_free(s);
+    return NULL;
   }
-  jpeg_create_compress(&(jpg->cinfo));
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
-
-  jpg->cinfo.image_width = jpg->global.width;
-  jpg->cinfo.image_height = jpg->global.height;
-  jpg->cinfo.input_components = 3;
-  jpg->cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
+  jpeg_create_compress(&(s->cinfo));
+  s->f = g_fopen(filename, "wb");
+  s->row = malloc((size_t)3 * jpg->global.width * sizeof(uint8_t));
+  if(!s->f || !s->row)
+  {
+    _stream_free(s);
+    return NULL;
+  }
+  jpeg_stdio_dest(&(s->cinfo), s->f);
+
+  s->cinfo.image_width = jpg->global.width;
+  s->cinfo.image_height = jpg->global.height;
+  s->cinfo.input_components = 3;
+  s->cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&(s->cinfo));
+  jpeg_set_quality(&(s->cinfo), jpg->quality, TRUE);
+  if(jpg->quality > 90) s->cinfo.comp_info[0].v_samp_factor = 1;
+  if(jpg->quality > 92) s->cinfo.comp_info[0].h_samp_factor = 1;
+  if(jpg->quality > 95) s->cinfo.dct_method = JDCT_FLOAT;
+  if(jpg->quality < 50) s->cinfo.dct_method = JDCT_IFAST;
+  if(jpg->quality < 80) s->cinfo.smoothing_factor = 20;
+  if(jpg->quality < 60) s->cinfo.smoothing_factor = 40;
+  if(jpg->quality < 40) s->cinfo.smoothing_factor = 60;
+  s->cinfo.optimize_coding = 1;
 
   // according to specs density_unit = 0, X_density = 1, Y_density = 1 should be fine and valid since it
   // describes an image with unknown unit and square pixels.
@@ -352,18 +381,18 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   const int resolution = dt_conf_get_int("metadata/resolution");
   if(resolution > 0)
   {
-    jpg->cinfo.density_unit = 1;
-    jpg->cinfo.X_density = resolution;
-    jpg->cinfo.Y_density = resolution;
+    s->cinfo.density_unit = 1;
+    s->cinfo.X_density = resolution;
+    s->cinfo.Y_density = resolution;
   }
   else
   {
-    jpg->cinfo.density_unit = 0;
-    jpg->cinfo.X_density = 1;
-    jpg->cinfo.Y_density = 1;
+    s->cinfo.density_unit = 0;
+    s->cinfo.X_density = 1;
+    s->cinfo.Y_density = 1;
   }
 
-  jpeg_start_compress(&(jpg->cinfo), TRUE);
+  jpeg_start_compress(&(s->cinfo), TRUE);
 
   if(imgid > 0)
   {
@@ -374,32 +403,75 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
     {
       unsigned char *buf = malloc(len * sizeof(unsigned char));
       cmsSaveProfileToMem(out_profile, buf, &len);
-      write_icc_profile(&(jpg->cinfo), buf, len);
+      write_icc_profile(&(s->cinfo), buf, len);
       free(buf);
     }
   }
 
-  uint8_t *row = malloc((size_t)3 * jpg->global.width * sizeof(uint8_t));
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  return s;
+}
+
+int write_image_rows(dt_imageio_module_data_t *jpg_tmp, void *handle, const void *in_tmp, const int y,
+                     const int rows)
+{
+  dt_imageio_jpeg_stream_t *s = (dt_imageio_jpeg_stream_t *)handle;
+  const uint8_t *in = (const uint8_t *)in_tmp;
+  // libjpeg only knows about the next scanline, rows have to come in order
+  if(y != (int)s->cinfo.next_scanline) return 1;
+  if(setjmp(s->jerr.setjmp_buffer)) return 1;
+
+  const int width = s->cinfo.image_width;
+  const uint32_t end = MIN((uint32_t)(y + rows), s->cinfo.image_height);
+  while(s->cinfo.next_scanline < end)
   {
     JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
-    for(int i = 0; i < jpg->global.width; i++)
-      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
-    tmp[0] = row;
-    jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
+    const uint8_t *buf = in + (size_t)(s->cinfo.next_scanline - y) * width * 4;
+    for(int i = 0; i < width; i++)
+      for(int k = 0; k < 3; k++) s->row[3 * i + k] = buf[4 * i + k];
+    tmp[0] = s->row;
+    jpeg_write_scanlines(&(s->cinfo), tmp, 1);
+  }
+  return 0;
+}
+
+static int _stream_finish(dt_imageio_jpeg_stream_t *s)
+{
+  if(setjmp(s->jerr.setjmp_buffer)) return 1;
+  jpeg_finish_compress(&(s->cinfo));
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *jpg_tmp, void *handle, const int failed)
+{
+  dt_imageio_jpeg_stream_t *s = (dt_imageio_jpeg_stream_t *)handle;
+  const int res = failed || s->cinfo.next_scanline < s->cinfo.image_height || _stream_finish(s);
+  const char *filename = s->filename;
+  void *exif = s->exif;
+  const int exif_len = s->exif_len;
+  _stream_free(s);
+
+  if(res)
+  {
+    g_unlink(filename);
+    return 1;
   }
-  jpeg_finish_compress(&(jpg->cinfo));
-  free(row);
-  jpeg_destroy_compress(&(jpg->cinfo));
-  fclose(f);
 
   dt_exif_write_blob(exif, exif_len, filename, 1);
 
   return 0;
 }
 
+int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+{
+  void *handle = write_image_begin(jpg_tmp, filename, over_type, over_filename, exif, exif_len, imgid, num,
+                                   total, pipe);
+  if(!handle) return 1;
+  const int failed = write_image_rows(jpg_tmp, handle, in_tmp, 0, jpg_tmp->height);
+  return write_image_end(jpg_tmp, handle, failed);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 {
   jpg->f = g_fopen(filename, "rb");
@@ -22,6 +22,7 @@
 #include "config.h"
 #endif
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <png.h>
 #include <stdio.h>
@@ -119,41 +120,49 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+// state of a file being written strip by strip
+typedef struct dt_imageio_png_stream_t
+{
+  png_structp png_ptr;
+  png_infop info_ptr;
+  FILE *f;
+  int next_row;
+  const char *filename;
+} dt_imageio_png_stream_t;
+
+static void _stream_free(dt_imageio_png_stream_t *s)
+{
+  if(s->png_ptr) png_destroy_write_struct(&s->png_ptr, s->info_ptr ? &s->info_ptr : NULL);
+  if(s->f) fclose(s->f);
+  free(s);
+}
+
+void *write_image_begin(dt_imageio_module_data_t *p_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
 {
   dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
   const int width = p->global.width, height = p->global.height;
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
 
-  png_structp png_ptr;
-  png_infop info_ptr;
+  dt_imageio_png_stream_t *s = (dt_imageio_png_stream_t *)calloc(1, sizeof(dt_imageio_png_stream_t));
+  if(!s) return NULL;
+  s->filename = filename;
 
-  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if(!png_ptr)
-  {
-    fclose(f);
-    return 1;
-  }
+  s->f = g_fopen(filename, "wb");
+  if(!s->f) goto error;
 
-  info_ptr = png_create_info_struct(png_ptr);
-  if(!info_ptr)
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
-  }
+  s->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(!s->png_ptr) goto error;
 
-  if(setjmp(png_jmpbuf(png_ptr)))
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
-  }
+  s->info_ptr = png_create_info_struct(s->png_ptr);
+  if(!s->info_ptr) goto error;
+
+  png_structp png_ptr = s->png_ptr;
+  png_infop info_ptr = s->info_ptr;
+
+  if(setjmp(png_jmpbuf(png_ptr))) goto error;
 
-  png_init_io(png_ptr, f);
+  png_init_io(png_ptr, s->f);
 
   png_set_compression_level(png_ptr, p->compression);
   png_set_compression_mem_level(png_ptr, 8);
@@ -202,30 +211,67 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
-  png_bytep *row_pointers = malloc((size_t)height * sizeof(png_bytep));
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
 
-  if(p->bpp > 8)
-  {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
+  return s;
 
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
-  }
-  else
-  {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
-  }
+error:
+  _stream_free(s);
+  g_unlink(filename);
+  return NULL;
+}
+
+int write_image_rows(dt_imageio_module_data_t *p_tmp, void *handle, const void *ivoid, const int y,
+                     const int rows)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *s = (dt_imageio_png_stream_t *)handle;
+  const int width = p->global.width;
+  // png rows can only be written in order
+  if(y != s->next_row) return 1;
+  const int end = MIN(y + rows, p->global.height);
 
-  png_write_image(png_ptr, row_pointers);
+  if(setjmp(png_jmpbuf(s->png_ptr))) return 1;
 
-  free(row_pointers);
+  // libpng writes a row at a time anyway, so hand it the rows straight from the strip
+  const size_t stride = (size_t)4 * width * (p->bpp > 8 ? sizeof(uint16_t) : sizeof(uint8_t));
+  for(int i = y; i < end; i++) png_write_row(s->png_ptr, (png_bytep)((const uint8_t *)ivoid + stride * (i - y)));
 
-  png_write_end(png_ptr, info_ptr);
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(f);
+  s->next_row = end;
   return 0;
 }
 
+int write_image_end(dt_imageio_module_data_t *p_tmp, void *handle, const int failed)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *s = (dt_imageio_png_stream_t *)handle;
+  const char *filename = s->filename;
+  int rc = (failed || s->next_row < p->global.height) ? 1 : 0;
+
+  if(!rc)
+  {
+    if(setjmp(png_jmpbuf(s->png_ptr)))
+      rc = 1;
+    else
+      png_write_end(s->png_ptr, s->info_ptr);
+  }
+  _stream_free(s);
+  if(rc) g_unlink(filename);
+  return rc;
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+{
+  void *handle = write_image_begin(p_tmp, filename, over_type, over_filename, exif, exif_len, imgid, num, total,
+                                   pipe);
+  if(!handle) return 1;
+  const int failed = write_image_rows(p_tmp, handle, ivoid, 0, p_tmp->height);
+  return write_image_end(p_tmp, handle, failed);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -24,6 +24,7 @@
 #include "common/imageio_module.h"
 #include "control/conf.h"
 #include "imageio/format/imageio_format_api.h"
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <memory.h>
 #include <stddef.h>
@@ -50,20 +51,40 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
-int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe)
+// state of a file being written strip by strip
+typedef struct dt_imageio_tiff_stream_t
 {
-  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
-
-  uint8_t *profile = NULL;
-  uint32_t profile_len = 0;
+  TIFF *tif;
+  uint8_t *profile;
+  void *rowdata;
+  int next_row;
+  const char *filename;
+  void *exif;
+  int exif_len;
+} dt_imageio_tiff_stream_t;
+
+static void _stream_free(dt_imageio_tiff_stream_t *s)
+{
+  // close the file before adding exif data
+  if(s->tif) TIFFClose(s->tif);
+  free(s->profile);
+  free(s->rowdata);
+  free(s);
+}
 
-  TIFF *tif = NULL;
+void *write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
 
-  void *rowdata = NULL;
+  dt_imageio_tiff_stream_t *s = (dt_imageio_tiff_stream_t *)calloc(1, sizeof(dt_imageio_tiff_stream_t));
+  if(!s) return NULL;
+  s->filename = filename;
+  s->exif = exif;
+  s->exif_len = exif_len;
 
-  int rc = 1; // default to error
+  uint32_t profile_len = 0;
 
   if(imgid > 0)
   {
@@ -71,29 +92,22 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     cmsSaveProfileToMem(out_profile, 0, &profile_len);
     if(profile_len > 0)
     {
-      profile = malloc(profile_len);
-      if(!profile)
-      {
-        rc = 1;
-        goto exit;
-      }
-      cmsSaveProfileToMem(out_profile, profile, &profile_len);
+      s->profile = malloc(profile_len);
+      if(!s->profile) goto error;
+      cmsSaveProfileToMem(out_profile, s->profile, &profile_len);
     }
   }
 
   // Create little endian tiff image
 #ifdef _WIN32
   wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
-  tif = TIFFOpenW(wfilename, "wl");
+  s->tif = TIFFOpenW(wfilename, "wl");
   g_free(wfilename);
 #else
-  tif = TIFFOpen(filename, "wl");
+  s->tif = TIFFOpen(filename, "wl");
 #endif
-  if(!tif)
-  {
-    rc = 1;
-    goto exit;
-  }
+  if(!s->tif) goto error;
+  TIFF *tif = s->tif;
 
   // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
   // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
@@ -129,9 +143,9 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   }
 
   TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
-  if(profile != NULL)
+  if(s->profile != NULL)
   {
-    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, s->profile);
   }
   TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)3);
   TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
@@ -152,94 +166,114 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   }
 
   const size_t rowsize = (d->global.width * 3) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  if((s->rowdata = malloc(rowsize)) == NULL) goto error;
+
+  return s;
+
+error:
+  if(s->tif)
   {
-    rc = 1;
-    goto exit;
+    _stream_free(s);
+    g_unlink(filename);
   }
+  else
+    _stream_free(s);
+  return NULL;
+}
+
+int write_image_rows(dt_imageio_module_data_t *d_tmp, void *handle, const void *in_void, const int y0,
+                     const int rows)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *s = (dt_imageio_tiff_stream_t *)handle;
+  // compressed strips can only be written in order
+  if(y0 != s->next_row) return 1;
+  const int end = MIN(y0 + rows, d->global.height);
 
   if(d->bpp == 32)
   {
-    for(int y = 0; y < d->global.height; y++)
+    for(int y = y0; y < end; y++)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
+      const float *in = (const float *)in_void + (size_t)4 * (y - y0) * d->global.width;
+      float *out = (float *)s->rowdata;
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(float));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(s->tif, s->rowdata, y, 0) == -1) return 1;
     }
   }
   else if(d->bpp == 16)
   {
-    for(int y = 0; y < d->global.height; y++)
+    for(int y = y0; y < end; y++)
     {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
+      const uint16_t *in = (const uint16_t *)in_void + (size_t)4 * (y - y0) * d->global.width;
+      uint16_t *out = (uint16_t *)s->rowdata;
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(uint16_t));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(s->tif, s->rowdata, y, 0) == -1) return 1;
     }
   }
   else
   {
-    for(int y = 0; y < d->global.height; y++)
+    for(int y = y0; y < end; y++)
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
+      const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * (y - y0) * d->global.width;
+      uint8_t *out = (uint8_t *)s->rowdata;
 
       for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(uint8_t));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(s->tif, s->rowdata, y, 0) == -1) return 1;
     }
   }
+  s->next_row = end;
+  return 0;
+}
 
-  // success
-  rc = 0;
-
-exit:
-  // close the file before adding exif data
-  if(tif)
+int write_image_end(dt_imageio_module_data_t *d_tmp, void *handle, const int failed)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *s = (dt_imageio_tiff_stream_t *)handle;
+  int rc = (failed || s->next_row < d->global.height) ? 1 : 0;
+  const char *filename = s->filename;
+  void *exif = s->exif;
+  const int exif_len = s->exif_len;
+  _stream_free(s);
+
+  if(rc)
   {
-    TIFFClose(tif);
-    tif = NULL;
+    g_unlink(filename);
+    return rc;
   }
-  if(!rc && exif)
+  if(exif)
   {
     rc = dt_exif_write_blob(exif, exif_len, filename, d->compress > 0);
     // Until we get symbolic error status codes, if rc is 1, return 0
     rc = (rc == 1) ? 0 : 1;
   }
-  free(profile);
-  profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
-
   return rc;
 }
 
+int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe)
+{
+  void *handle = write_image_begin(d_tmp, filename, over_type, over_filename, exif, exif_len, imgid, num, total,
+                                   pipe);
+  if(!handle) return 1;
+  const int failed = write_image_rows(d_tmp, handle, in_void, 0, d_tmp->height);
+  return write_image_end(d_tmp, handle, failed);
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
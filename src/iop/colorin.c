@@ -22,6 +22,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/colormatrices.c"
 #include "common/colorspaces.h"
+#include "common/colorspaces_lut3d.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/image_cache.h"
 #include "common/opencl.h"
@@ -99,6 +100,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHTRANSFORM *xform_cam_Lab;
   cmsHTRANSFORM *xform_cam_nrgb;
   cmsHTRANSFORM *xform_nrgb_Lab;
+  dt_colorspaces_lut3d_t *lut3d_cam_Lab; // xform_cam_Lab sampled, NULL if it has to go through lcms2
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float nmatrix[9];
@@ -883,7 +885,7 @@ static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d_cam_Lab, d->xform_cam_Lab, out, out, roi_out->width);
     }
     else
     {
@@ -922,7 +924,7 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d_cam_Lab, d->xform_cam_Lab, in, out, roi_out->width);
     }
     else
     {
@@ -1261,7 +1263,7 @@ static void process_sse2_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d_cam_Lab, d->xform_cam_Lab, out, out, roi_out->width);
     }
     else
     {
@@ -1303,7 +1305,7 @@ static void process_sse2_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixel
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d_cam_Lab, d->xform_cam_Lab, in, out, roi_out->width);
     }
     else
     {
@@ -1367,6 +1369,88 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(__SSE2__) && defined(DT_HAVE_TARGET_AVX2)
+// rows of a 3x3 matrix as columns, twice: one copy per 128 bit lane, i.e. per pixel
+#define MAT3_COLUMNS_AVX2(m, m0, m1, m2)                                                                     \
+  const __m256 m0 = _mm256_setr_ps(m[0], m[3], m[6], 0.0f, m[0], m[3], m[6], 0.0f);                          \
+  const __m256 m1 = _mm256_setr_ps(m[1], m[4], m[7], 0.0f, m[1], m[4], m[7], 0.0f);                          \
+  const __m256 m2 = _mm256_setr_ps(m[2], m[5], m[8], 0.0f, m[2], m[5], m[8], 0.0f);
+
+DT_TARGET_AVX2 static inline __m256 mat3_mul_avx2(const __m256 m0, const __m256 m1, const __m256 m2, const __m256 v)
+{
+  return _mm256_fmadd_ps(m2, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)),
+                         _mm256_fmadd_ps(m1, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)),
+                                         m0 * _mm256_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))));
+}
+
+// two pixels per iteration. the pixel pairs are 32 byte aligned as long as the buffers are.
+DT_TARGET_AVX2 static void cmatrix_fastpath_avx2(const float *const in, float *const out, const size_t npixels,
+                                                 const dt_iop_colorin_data_t *const d)
+{
+  const int clipping = (d->nrgb != NULL);
+  MAT3_COLUMNS_AVX2(d->cmatrix, cm0, cm1, cm2)
+  MAT3_COLUMNS_AVX2(d->nmatrix, nm0, nm1, nm2)
+  MAT3_COLUMNS_AVX2(d->lmatrix, lm0, lm1, lm2)
+
+  for(size_t k = 0; k < npixels; k += 2)
+  {
+    // a single pixel at the end goes alone in the lower lane
+    const __m256 input = (k + 1 < npixels) ? _mm256_load_ps(in + 4 * k)
+                                           : _mm256_insertf128_ps(_mm256_setzero_ps(), _mm_load_ps(in + 4 * k), 0);
+    __m256 xyz;
+    if(!clipping)
+      xyz = mat3_mul_avx2(cm0, cm1, cm2, input);
+    else
+    {
+      const __m256 nrgb = mat3_mul_avx2(nm0, nm1, nm2, input);
+      const __m256 crgb = _mm256_min_ps(_mm256_max_ps(nrgb, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+      xyz = mat3_mul_avx2(lm0, lm1, lm2, crgb);
+    }
+    const __m256 Lab = dt_XYZ_to_Lab_avx2(xyz);
+
+    if(k + 1 < npixels)
+      _mm256_stream_ps(out + 4 * k, Lab);
+    else
+      _mm_stream_ps(out + 4 * k, _mm256_castps256_ps128(Lab));
+  }
+}
+#undef MAT3_COLUMNS_AVX2
+
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
+
+  // only the plain color matrix is worth it, everything else is bound by the luts or lcms2
+  if(d->type == DT_COLORSPACE_LAB || isnan(d->cmatrix[0]) || blue_mapping || d->nonlinearlut != 0)
+  {
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  // chunks of an even number of pixels, so only the last one can end in a single pixel
+  const size_t chunk = 2 * 4096;
+  const size_t nchunks = (npixels + chunk - 1) / chunk;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(size_t c = 0; c < nchunks; c++)
+  {
+    const size_t start = c * chunk;
+    cmatrix_fastpath_avx2((const float *)ivoid + 4 * start, (float *)ovoid + 4 * start,
+                          MIN(chunk, npixels - start), d);
+  }
+  _mm_sfence();
+
+  dt_ioppr_set_pipe_work_profile_info(self->dev, piece->pipe, d->type_work, d->filename_work, DT_INTENT_PERCEPTUAL);
+
+  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
 static void mat3mul(float *dst, const float *const m1, const float *const m2)
 {
   for(int k = 0; k < 3; k++)
@@ -1433,6 +1517,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_colorspaces_lut3d_unref(d->lut3d_cam_Lab);
+  d->lut3d_cam_Lab = NULL;
 
   d->cmatrix[0] = d->nmatrix[0] = d->lmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1636,6 +1722,14 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // a profile which isn't matrix/shaper goes through a table of its transform. the clipping mode keeps the
+  // two lcms2 steps, the clipping in between can't be sampled.
+  if(d->xform_cam_Lab && !d->nrgb)
+  {
+    const uint64_t key = dt_colorspaces_lut3d_key(d->input, Lab, NULL, p->intent, 0, input_format, TYPE_LabA_FLT);
+    d->lut3d_cam_Lab = dt_colorspaces_lut3d_get(key, d->xform_cam_Lab, DT_COLORSPACES_LUT3D_INPUT_RGB, NULL);
+  }
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1668,6 +1762,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->lut3d_cam_Lab = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1690,6 +1785,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_colorspaces_lut3d_unref(d->lut3d_cam_Lab);
+  d->lut3d_cam_Lab = NULL;
 
   free(piece->data);
   piece->data = NULL;
@@ -21,6 +21,7 @@
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
+#include "common/colorspaces_lut3d.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/opencl.h"
 #include "control/conf.h"
@@ -53,6 +54,7 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   cmsHTRANSFORM *xform;
+  dt_colorspaces_lut3d_t *lut3d; // xform sampled, NULL if it has to go through lcms2
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -402,7 +404,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d, d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -477,7 +479,7 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      dt_colorspaces_lut3d_transform(d->lut3d, d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -548,6 +550,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_colorspaces_lut3d_unref(d->lut3d);
+  d->lut3d = NULL;
   d->cmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -682,6 +686,15 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // a profile which isn't matrix/shaper, or softproofing, goes through a table of the transform. not for the
+  // gamut check, its alarm color can't be interpolated, nor when lcms2 is asked for explicitly.
+  if(d->xform && d->mode != DT_PROFILE_GAMUTCHECK && !force_lcms2 && output_format == TYPE_RGBA_FLT)
+  {
+    const uint64_t key = dt_colorspaces_lut3d_key(Lab, output, softproof, out_intent, transformFlags,
+                                                  TYPE_LabA_FLT, output_format);
+    d->lut3d = dt_colorspaces_lut3d_get(key, d->xform, DT_COLORSPACES_LUT3D_INPUT_LAB, output);
+  }
+
   if(out_type == DT_COLORSPACE_DISPLAY) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
   // now try to initialize unbounded mode:
@@ -723,6 +736,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_colorspaces_lut3d_unref(d->lut3d);
+  d->lut3d = NULL;
 
   free(piece->data);
   piece->data = NULL;
@@ -40,6 +40,9 @@
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
+#ifdef DT_HAVE_TARGET_AVX2
+#include <immintrin.h>
+#endif
 
 #define REDUCESIZE 64
 #define NUM_BUCKETS 4
@@ -914,6 +917,170 @@ static void eaw_decompose_sse(float *const out, const float *const in, float *co
   _mm_sfence();
 }
 
+#ifdef DT_HAVE_TARGET_AVX2
+// same as weight_sse(), for the two pixels in the two 128 bit lanes. var_sigma2 is inv_sigma2 * var.
+DT_TARGET_AVX2 static inline __m256 weight_avx2(const __m256 p1, const __m256 p2, const __m256 var_sigma2)
+{
+  const __m256 diff = p1 - p2;
+  // 3d distance based on color, the 4th channel doesn't count
+  const __m256 sqr = _mm256_blend_ps(diff * diff, _mm256_setzero_ps(), 0x88);
+  __m256 dot = _mm256_hadd_ps(sqr, sqr);
+  dot = _mm256_hadd_ps(dot, dot);
+  const __m256 x = _mm256_max_ps(_mm256_setzero_ps(), _mm256_fmsub_ps(dot, var_sigma2, _mm256_set1_ps(9.0f)));
+
+  // fast_mexp2f()
+  const __m256 i1 = _mm256_set1_ps((float)0x3f800000u);
+  const __m256 i2 = _mm256_set1_ps((float)0x3f000000u);
+  const __m256 k0 = _mm256_fmadd_ps(x, i2 - i1, i1);
+  const __m256 valid = _mm256_cmp_ps(k0, _mm256_set1_ps((float)0x800000u), _CMP_GE_OQ);
+  return _mm256_and_ps(valid, _mm256_castsi256_ps(_mm256_cvttps_epi32(k0)));
+}
+
+// the part of row j which doesn't need clamping, two pixels at a time. i_end - i_start has to be even.
+DT_TARGET_AVX2 static void eaw_decompose_row_avx2(float *const out, const float *const in, float *const detail,
+                                                  const int mult, const float inv_sigma2, const int32_t width,
+                                                  const int j, const int i_start, const int i_end)
+{
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+  const __m256 var_sigma2 = _mm256_set1_ps(inv_sigma2 * 0.02f);
+
+  for(int i = i_start; i < i_end; i += 2)
+  {
+    const size_t k = (size_t)4 * (i + (size_t)j * width);
+    const __m256 px = _mm256_loadu_ps(in + k);
+    __m256 sum = _mm256_setzero_ps();
+    __m256 wgt = _mm256_setzero_ps();
+
+    const float *px2 = in + (size_t)4 * (i - 2 * mult + (size_t)(j - 2 * mult) * width);
+    for(int jj = 0; jj < 5; jj++)
+    {
+      for(int ii = 0; ii < 5; ii++)
+      {
+        const __m256 p2 = _mm256_loadu_ps(px2);
+        const __m256 w = _mm256_set1_ps(filter[ii] * filter[jj]) * weight_avx2(px, p2, var_sigma2);
+        sum = _mm256_fmadd_ps(w, p2, sum);
+        wgt += w;
+        px2 += (size_t)4 * mult;
+      }
+      px2 += (size_t)4 * (width - 5) * mult;
+    }
+    sum /= wgt;
+
+    _mm256_storeu_ps(detail + k, px - sum);
+    _mm256_storeu_ps(out + k, sum);
+  }
+}
+
+// eaw_decompose_sse() with the inner part of the rows done by eaw_decompose_row_avx2()
+static void eaw_decompose_avx2(float *const out, const float *const in, float *const detail, const int scale,
+                               const float inv_sigma2, const int32_t width, const int32_t height)
+{
+  const int mult = 1u << scale;
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(int j = 0; j < 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(int j = 2 * mult; j < height - 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < 2 * mult; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+
+    // pairs of pixels, a leftover one goes through the sse code below
+    const int i_pairs = 2 * mult + (MAX(0, width - 4 * mult) & ~1);
+    eaw_decompose_row_avx2(out, in, detail, mult, inv_sigma2, width, j, 2 * mult, i_pairs);
+    px += i_pairs - 2 * mult;
+    pdetail += (size_t)4 * (i_pairs - 2 * mult);
+    pcoarse += (size_t)4 * (i_pairs - 2 * mult);
+
+    for(int i = i_pairs; i < width - 2 * mult; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      px2 = ((__m128 *)in) + i - 2 * mult + (size_t)(j - 2 * mult) * width;
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_COMMON_SSE(ii, jj);
+          px2 += mult;
+        }
+        px2 += (width - 5) * mult;
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+
+    for(int i = width - 2 * mult; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(int j = height - 2 * mult; j < height; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+  _mm_sfence();
+}
+#endif
+
 #undef SUM_PIXEL_CONTRIBUTION_COMMON_SSE
 #undef SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE
 #undef ROW_PROLOGUE_SSE
@@ -2302,6 +2469,18 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(__SSE2__) && defined(DT_HAVE_TARGET_AVX2)
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_denoiseprofile_params_t *d = (dt_iop_denoiseprofile_params_t *)piece->data;
+  if(d->mode == MODE_NLMEANS)
+    process_nlmeans_sse(self, piece, ivoid, ovoid, roi_in, roi_out);
+  else
+    process_wavelets(self, piece, ivoid, ovoid, roi_in, roi_out, eaw_decompose_avx2, eaw_synthesize_sse2);
+}
+#endif
+
 /** this will be called to init new defaults if a new image is loaded from film strip mode. */
 void reload_defaults(dt_iop_module_t *module)
 {
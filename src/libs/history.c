@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/styles.h"
@@ -801,6 +802,7 @@ static void _lib_history_compress_clicked_callback(GtkWidget *widget, gpointer u
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, darktable.develop->history_end);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed();
 
   dt_dev_reload_history_items(darktable.develop);
   dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
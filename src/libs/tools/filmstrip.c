@@ -805,6 +805,14 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *wcr, gp
 
   dt_control_set_mouse_over_id(-1);
 
+  // fetch the ids up front, so that the flags of all thumbnails come from a single snapshot
+  int *query_ids = (int *)calloc(max_cols, sizeof(int));
+  int num_ids = 0;
+  while(query_ids && num_ids < max_cols && (step_res = sqlite3_step(stmt)) == SQLITE_ROW)
+    query_ids[num_ids++] = sqlite3_column_int(stmt, 0);
+  if(query_ids) dt_view_image_snapshot_begin(query_ids, num_ids);
+
+  int next_id = 0;
   for(int col = 0; col < max_cols; col++)
   {
     if(col < col_start)
@@ -813,14 +821,9 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *wcr, gp
       continue;
     }
 
-    if(step_res != SQLITE_DONE)
+    if(next_id < num_ids)
     {
-      step_res = sqlite3_step(stmt);
-    }
-
-    if(step_res == SQLITE_ROW)
-    {
-      const int id = sqlite3_column_int(stmt, 0);
+      const int id = query_ids[next_id++];
       // set mouse over id
       if(seli == col)
       {
@@ -855,7 +858,7 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *wcr, gp
       }
       cairo_restore(cr);
     }
-    else if(step_res == SQLITE_DONE)
+    else if(step_res == SQLITE_DONE || step_res == SQLITE_ROW)
     {
       /* do nothing, just add some empty thumb frames */
     }
@@ -864,6 +867,8 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *wcr, gp
     cairo_translate(cr, wd, 0.0f);
   }
 failure:
+  dt_view_image_snapshot_end();
+  free(query_ids);
   cairo_restore(cr);
   sqlite3_finalize(stmt);
 
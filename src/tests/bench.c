@@ -0,0 +1,434 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the processing modules: runs the cpu path of every iop on reference raws (or a synthetic
+// mosaic) at several resolutions and thread counts, reports megapixels/s and compares against a baseline.
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/imageio_dng.h"
+#include "common/mipmap_cache.h"
+#include "develop/develop.h"
+#include "develop/format.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <float.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BENCH_MAX_VALUES 16
+
+// size of the synthetic mosaic, used if no reference raws are given
+#define BENCH_SYNTHETIC_WIDTH 6000
+#define BENCH_SYNTHETIC_HEIGHT 4000
+
+typedef struct bench_result_t
+{
+  char module[64];
+  int megapixels;
+  int threads;
+  double mpps;
+} bench_result_t;
+
+typedef struct bench_t
+{
+  int megapixels[BENCH_MAX_VALUES];
+  int num_megapixels;
+  int threads[BENCH_MAX_VALUES];
+  int num_threads;
+  int runs;
+  double threshold;    // allowed slowdown against the baseline, in percent
+  gchar **only;        // only run these modules, NULL for all
+  GArray *results;     // bench_result_t, accumulated over all images
+} bench_t;
+
+static int usage(const char *argv0)
+{
+  printf("usage: %s [options] [raw files]\n", argv0);
+  printf("\n");
+  printf("options:\n");
+  printf("  --megapixels <list>     output sizes to process, e.g. 2,8,24 (default)\n");
+  printf("  --threads <list>        openmp thread counts, e.g. 1,4 (default: 1 and all)\n");
+  printf("  --runs <n>              runs per measurement, the fastest counts (default 3)\n");
+  printf("  --iop <list>            only these modules, e.g. exposure,demosaic\n");
+  printf("  --baseline <file>       compare against this baseline, fail on regressions\n");
+  printf("  --threshold <percent>   allowed slowdown against the baseline (default 10)\n");
+  printf("  --save-baseline <file>  write the results as new baseline\n");
+  printf("  --core <darktable options>\n");
+  printf("\n");
+  printf("without raw files a synthetic %dx%d bayer mosaic is used.\n", BENCH_SYNTHETIC_WIDTH,
+         BENCH_SYNTHETIC_HEIGHT);
+  return 1;
+}
+
+static int _parse_list(const char *arg, int *values)
+{
+  gchar **parts = g_strsplit(arg, ",", BENCH_MAX_VALUES);
+  int n = 0;
+  for(gchar **p = parts; *p; p++)
+  {
+    const int v = atoi(*p);
+    if(v > 0) values[n++] = v;
+  }
+  g_strfreev(parts);
+  return n;
+}
+
+// a bayer mosaic with smooth gradients and some noise, so nothing is trivially compressible or flat
+static gchar *_write_synthetic_mosaic(void)
+{
+  const int wd = BENCH_SYNTHETIC_WIDTH, ht = BENCH_SYNTHETIC_HEIGHT;
+  float *pixels = dt_alloc_align(64, sizeof(float) * wd * ht);
+  if(!pixels) return NULL;
+
+  uint32_t state = 0x12345678u;
+  for(int j = 0; j < ht; j++)
+    for(int i = 0; i < wd; i++)
+    {
+      state = state * 1664525u + 1013904223u;
+      const float noise = (state >> 8) * (1.0f / 16777216.0f) - 0.5f;
+      const float base = 0.25f + 0.2f * sinf(i * 0.003f) * cosf(j * 0.005f);
+      const float channel = ((i & 1) + (j & 1)) == 1 ? 1.0f : 0.6f; // more signal on green
+      pixels[(size_t)j * wd + i] = CLAMP(base * channel + 0.02f * noise, 0.0f, 1.0f);
+    }
+
+  gchar *filename = g_build_filename(g_get_tmp_dir(), "darktable-bench-synthetic.dng", NULL);
+  // rggb, the xtrans pattern is written anyway but unused for bayer filters
+  const uint8_t xtrans[6][6] = { { 0 } };
+  dt_imageio_write_dng(filename, pixels, wd, ht, NULL, 0, 0x94949494, xtrans, 1.0f);
+  dt_free_align(pixels);
+  return filename;
+}
+
+static int _import(const char *filename)
+{
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  return dt_image_import(filmid, filename, TRUE);
+}
+
+static void _add_result(bench_t *b, const char *module, const int megapixels, const int threads, const double mpps)
+{
+  bench_result_t r = { { 0 }, megapixels, threads, mpps };
+  g_strlcpy(r.module, module, sizeof(r.module));
+  // several images: keep the slowest, that's the one a regression would hit first
+  for(guint k = 0; k < b->results->len; k++)
+  {
+    bench_result_t *o = &g_array_index(b->results, bench_result_t, k);
+    if(!strcmp(o->module, r.module) && o->megapixels == megapixels && o->threads == threads)
+    {
+      o->mpps = MIN(o->mpps, mpps);
+      return;
+    }
+  }
+  g_array_append_val(b->results, r);
+}
+
+static gboolean _wanted(const bench_t *b, const dt_iop_module_t *module)
+{
+  if(!b->only) return TRUE;
+  for(gchar **p = b->only; *p; p++)
+    if(!strcmp(*p, module->op)) return TRUE;
+  return FALSE;
+}
+
+// times the process() callback of every enabled piece on the rois and buffer formats of a real run
+static void _bench_pieces(bench_t *b, dt_dev_pixelpipe_t *pipe, const int megapixels)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(!piece->enabled || !_wanted(b, module)) continue;
+
+    const dt_iop_roi_t roi_in = piece->processed_roi_in;
+    const dt_iop_roi_t roi_out = piece->processed_roi_out;
+    if(roi_in.width <= 0 || roi_in.height <= 0 || roi_out.width <= 0 || roi_out.height <= 0) continue;
+
+    const size_t in_size = dt_iop_buffer_dsc_to_bpp(&piece->dsc_in) * roi_in.width * roi_in.height;
+    const size_t out_size = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out) * roi_out.width * roi_out.height;
+    float *in = dt_alloc_align(64, in_size);
+    float *out = dt_alloc_align(64, out_size);
+    if(!in || !out)
+    {
+      fprintf(stderr, "[bench] can't allocate buffers for `%s', skipping\n", module->op);
+      dt_free_align(in);
+      dt_free_align(out);
+      continue;
+    }
+    // plausible pixel values in the format the module reads, modules shouldn't be timed on denormals or nans
+    if(piece->dsc_in.datatype == TYPE_UINT16)
+    {
+      // raw data, between black level and white point
+      uint16_t *raw = (uint16_t *)in;
+      const float black = piece->dsc_in.rawprepare.raw_black_level;
+      const float white = piece->dsc_in.rawprepare.raw_white_point ? piece->dsc_in.rawprepare.raw_white_point
+                                                                   : UINT16_MAX;
+      for(size_t k = 0; k < in_size / sizeof(uint16_t); k++)
+        raw[k] = black + (white - black) * (0.1f + 0.8f * (k % 997) / 997.0f);
+    }
+    else
+      for(size_t k = 0; k < in_size / sizeof(float); k++) in[k] = 0.1f + 0.8f * (k % 997) / 997.0f;
+
+    for(int t = 0; t < b->num_threads; t++)
+    {
+#ifdef _OPENMP
+      omp_set_num_threads(b->threads[t]);
+#endif
+      double best = DBL_MAX;
+      for(int r = 0; r < b->runs; r++)
+      {
+        const double start = dt_get_wtime();
+        module->process(module, piece, in, out, &roi_in, &roi_out);
+        best = MIN(best, dt_get_wtime() - start);
+      }
+      const double mpps = roi_out.width * (double)roi_out.height / MAX(best, 1e-9) * 1e-6;
+      printf("%-20s %4d MP %3d thread(s) %10.2f MP/s\n", module->op, megapixels, b->threads[t], mpps);
+      _add_result(b, module->op, megapixels, b->threads[t], mpps);
+    }
+
+    dt_free_align(in);
+    dt_free_align(out);
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+}
+
+static int _bench_image(bench_t *b, const int imgid)
+{
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf.buf || !buf.width || !buf.height)
+  {
+    fprintf(stderr, "[bench] can't load image %d\n", imgid);
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    return 1;
+  }
+
+  for(int m = 0; m < b->num_megapixels; m++)
+  {
+    dt_develop_t dev;
+    dt_dev_init(&dev, 0);
+    dt_dev_load_image(&dev, imgid);
+
+    dt_dev_pixelpipe_t pipe;
+    if(!dt_dev_pixelpipe_init_export(&pipe, buf.width, buf.height, IMAGEIO_RGB | IMAGEIO_FLOAT, FALSE))
+    {
+      fprintf(stderr, "[bench] can't create a pixelpipe\n");
+      dt_dev_cleanup(&dev);
+      break;
+    }
+    dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+    dt_dev_pixelpipe_synch_all(&pipe, &dev);
+
+    // switch on everything with its defaults, modules which don't apply to this image switch themselves off
+    for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      dt_iop_module_t *module = piece->module;
+      if(module->flags() & (IOP_FLAGS_DEPRECATED | IOP_FLAGS_HIDDEN)) continue;
+      piece->enabled = 1;
+      dt_iop_commit_params(module, module->default_params, module->default_blendop_params, &pipe, piece);
+    }
+
+    dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                    &pipe.processed_height);
+    const double scale
+        = fmin(1.0, sqrt(b->megapixels[m] * 1e6 / ((double)pipe.processed_width * pipe.processed_height)));
+    const int width = scale * pipe.processed_width + .5f;
+    const int height = scale * pipe.processed_height + .5f;
+
+    // one real run, so every piece knows its rois and buffer formats
+    if(dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, width, height, scale))
+      fprintf(stderr, "[bench] processing image %d at %d MP failed\n", imgid, b->megapixels[m]);
+    else
+      _bench_pieces(b, &pipe, b->megapixels[m]);
+
+    dt_dev_pixelpipe_cleanup(&pipe);
+    dt_dev_cleanup(&dev);
+  }
+
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+static int _save_baseline(const bench_t *b, const char *filename)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    fprintf(stderr, "[bench] can't write baseline `%s'\n", filename);
+    return 1;
+  }
+  fprintf(f, "# darktable-bench baseline: module megapixels threads MP/s\n");
+  for(guint k = 0; k < b->results->len; k++)
+  {
+    const bench_result_t *r = &g_array_index(b->results, bench_result_t, k);
+    fprintf(f, "%s %d %d %.3f\n", r->module, r->megapixels, r->threads, r->mpps);
+  }
+  fclose(f);
+  return 0;
+}
+
+// returns the number of regressions
+static int _compare_baseline(const bench_t *b, const char *filename)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f)
+  {
+    fprintf(stderr, "[bench] can't read baseline `%s'\n", filename);
+    return 1;
+  }
+
+  int regressions = 0, compared = 0;
+  char line[512];
+  while(fgets(line, sizeof(line), f))
+  {
+    char module[64];
+    int megapixels, threads;
+    double mpps;
+    if(line[0] == '#' || sscanf(line, "%63s %d %d %lf", module, &megapixels, &threads, &mpps) != 4) continue;
+
+    for(guint k = 0; k < b->results->len; k++)
+    {
+      const bench_result_t *r = &g_array_index(b->results, bench_result_t, k);
+      if(strcmp(r->module, module) || r->megapixels != megapixels || r->threads != threads) continue;
+      compared++;
+      const double change = (r->mpps / mpps - 1.0) * 100.0;
+      if(change < -b->threshold)
+      {
+        printf("[regression] %-20s %4d MP %3d thread(s) %10.2f MP/s, baseline %10.2f MP/s (%+.1f%%)\n", module,
+               megapixels, threads, r->mpps, mpps, change);
+        regressions++;
+      }
+    }
+  }
+  fclose(f);
+
+  printf("[bench] compared %d measurements against `%s', %d regression(s) beyond %.0f%%\n", compared, filename,
+         regressions, b->threshold);
+  return regressions;
+}
+
+int main(int argc, char *arg[])
+{
+  bench_t b = { .megapixels = { 2, 8, 24 }, .num_megapixels = 3, .runs = 3, .threshold = 10.0 };
+  const char *baseline = NULL, *save_baseline = NULL;
+  GPtrArray *files = g_ptr_array_new();
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "--megapixels") && argc > k + 1)
+      b.num_megapixels = _parse_list(arg[++k], b.megapixels);
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      b.num_threads = _parse_list(arg[++k], b.threads);
+    else if(!strcmp(arg[k], "--runs") && argc > k + 1)
+      b.runs = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--iop") && argc > k + 1)
+      b.only = g_strsplit(arg[++k], ",", -1);
+    else if(!strcmp(arg[k], "--baseline") && argc > k + 1)
+      baseline = arg[++k];
+    else if(!strcmp(arg[k], "--threshold") && argc > k + 1)
+      b.threshold = atof(arg[++k]);
+    else if(!strcmp(arg[k], "--save-baseline") && argc > k + 1)
+      save_baseline = arg[++k];
+    else if(!strcmp(arg[k], "--core"))
+    {
+      k++;
+      break;
+    }
+    else if(arg[k][0] == '-')
+      return usage(arg[0]);
+    else
+      g_ptr_array_add(files, arg[k]);
+  }
+  if(b.num_megapixels == 0) return usage(arg[0]);
+
+  // init dt without gui, on the cpu path only, and without touching the user's library:
+  char *m_arg[] = { "darktable-bench", "--library", ":memory:", "--conf", "write_sidecar_files=FALSE",
+                    "--disable-opencl" };
+  const int m_argc = sizeof(m_arg) / sizeof(*m_arg);
+  char **dt_argv = malloc(sizeof(char *) * (m_argc + argc - k + 1));
+  for(int i = 0; i < m_argc; i++) dt_argv[i] = m_arg[i];
+  for(int i = k; i < argc; i++) dt_argv[m_argc + i - k] = arg[i];
+  const int dt_argc = m_argc + argc - k;
+  dt_argv[dt_argc] = NULL;
+
+  if(dt_init(dt_argc, dt_argv, FALSE, FALSE, NULL))
+  {
+    free(dt_argv);
+    exit(1);
+  }
+
+  if(b.num_threads == 0)
+  {
+    b.threads[b.num_threads++] = 1;
+    if(darktable.num_openmp_threads > 1) b.threads[b.num_threads++] = darktable.num_openmp_threads;
+  }
+
+  gchar *synthetic = NULL;
+  if(files->len == 0)
+  {
+    synthetic = _write_synthetic_mosaic();
+    if(synthetic) g_ptr_array_add(files, synthetic);
+  }
+
+  b.results = g_array_new(FALSE, FALSE, sizeof(bench_result_t));
+  int res = 0;
+  for(guint i = 0; i < files->len; i++)
+  {
+    const char *filename = (const char *)g_ptr_array_index(files, i);
+    const int imgid = _import(filename);
+    if(!imgid)
+    {
+      fprintf(stderr, "[bench] can't import `%s'\n", filename);
+      res = 1;
+      continue;
+    }
+    printf("[bench] %s\n", filename);
+    res |= _bench_image(&b, imgid);
+  }
+
+  if(save_baseline) res |= _save_baseline(&b, save_baseline);
+  if(baseline && _compare_baseline(&b, baseline)) res = 1;
+
+  if(synthetic) g_unlink(synthetic);
+  g_free(synthetic);
+  g_array_free(b.results, TRUE);
+  g_strfreev(b.only);
+  g_ptr_array_free(files, TRUE);
+
+  dt_cleanup();
+  free(dt_argv);
+  return res;
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
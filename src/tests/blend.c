@@ -0,0 +1,246 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compares the vectorized blend and blendif mask kernels against the plain c ones,
+// and with --bench measures both.
+#include "common/darktable.h"
+#include "develop/blend.h"
+#include "develop/imageop.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH 4096
+
+static const unsigned int modes[] = { DEVELOP_BLEND_NORMAL2, DEVELOP_BLEND_BOUNDED, DEVELOP_BLEND_LIGHTEN,
+                                      DEVELOP_BLEND_DARKEN,  DEVELOP_BLEND_MULTIPLY, DEVELOP_BLEND_AVERAGE,
+                                      DEVELOP_BLEND_ADD,     DEVELOP_BLEND_SUBSTRACT };
+
+static float frand(const float lo, const float hi)
+{
+  return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// a bit outside of the nominal range, so the clamping gets exercised as well
+static void fill_row(const dt_iop_colorspace_type_t cst, float *px)
+{
+  for(int k = 0; k < WIDTH; k++)
+  {
+    if(cst == iop_cs_Lab)
+    {
+      px[4 * k + 0] = frand(-5.0f, 105.0f);
+      px[4 * k + 1] = frand(-130.0f, 130.0f);
+      px[4 * k + 2] = frand(-130.0f, 130.0f);
+    }
+    else
+      for(int c = 0; c < 3; c++) px[4 * k + c] = frand(-0.1f, 1.2f);
+    px[4 * k + 3] = 1.0f;
+  }
+}
+
+static void random_blendif(unsigned int *blendif, float *parameters)
+{
+  for(int ch = 0; ch < DEVELOP_BLENDIF_SIZE; ch++)
+  {
+    float p[4];
+    for(int k = 0; k < 4; k++) p[k] = frand(-0.1f, 1.1f);
+    for(int k = 0; k < 4; k++)
+      for(int l = k + 1; l < 4; l++)
+        if(p[l] < p[k])
+        {
+          const float t = p[k];
+          p[k] = p[l];
+          p[l] = t;
+        }
+    memcpy(parameters + 4 * ch, p, sizeof(p));
+  }
+  // only the channels the vectorized mask handles, no hue/chroma/saturation
+  *blendif = (rand() & 0xff) | ((unsigned int)(rand() & 0xffff) << 16) | (1u << DEVELOP_BLENDIF_active);
+}
+
+// the largest deviations of the vectorized kernels from the plain c ones we accept
+#define MAX_BLEND_ERROR 1e-6f
+#define MAX_MASK_ERROR 1e-5f
+
+static const char *cst_name(const dt_iop_colorspace_type_t cst)
+{
+  return cst == iop_cs_Lab ? "Lab" : "rgb";
+}
+
+// returns the number of blend modes which came out different
+static int test_blend(const dt_iop_colorspace_type_t cst, const float *a, const float *b, const float *mask)
+{
+  float *b_plain = malloc(sizeof(float) * 4 * WIDTH);
+  float *b_sse2 = malloc(sizeof(float) * 4 * WIDTH);
+  int failed = 0;
+
+  for(int m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    for(int flag = 0; flag < 2; flag++)
+    {
+      memcpy(b_plain, b, sizeof(float) * 4 * WIDTH);
+      memcpy(b_sse2, b, sizeof(float) * 4 * WIDTH);
+      dt_develop_blend_row(cst, modes[m], flag, a, b_plain, mask, WIDTH, 0);
+      if(!dt_develop_blend_row(cst, modes[m], flag, a, b_sse2, mask, WIDTH, 1)) continue;
+
+      // relative to the value, the unbounded modes go far beyond 1. nan only equals nan.
+      float err = 0.0f;
+      for(int k = 0; k < 4 * WIDTH; k++)
+        if(isnan(b_plain[k]) != isnan(b_sse2[k]))
+          err = INFINITY;
+        else if(!isnan(b_plain[k]))
+          err = fmaxf(err, fabsf(b_plain[k] - b_sse2[k]) / fmaxf(1.0f, fabsf(b_plain[k])));
+
+      const int ok = err <= MAX_BLEND_ERROR;
+      if(!ok) failed++;
+      printf("  [%s] blend mode 0x%02x %s, flag %d: max relative error %g\n", ok ? "OK" : "FAIL", modes[m],
+             cst_name(cst), flag, err);
+    }
+
+  free(b_plain);
+  free(b_sse2);
+  return failed;
+}
+
+// returns the number of random blendif settings for which the masks came out different
+static int test_mask(const dt_iop_colorspace_type_t cst, const float *a, const float *b)
+{
+  float *form = malloc(sizeof(float) * WIDTH);
+  float *m_plain = malloc(sizeof(float) * WIDTH);
+  float *m_sse2 = malloc(sizeof(float) * WIDTH);
+  float parameters[4 * DEVELOP_BLENDIF_SIZE];
+  float max_err = 0.0f;
+  int tested = 0, failed = 0;
+
+  for(int t = 0; t < 500; t++)
+  {
+    unsigned int blendif;
+    random_blendif(&blendif, parameters);
+    const unsigned int mask_combine = rand() & (DEVELOP_COMBINE_INV | DEVELOP_COMBINE_INCL);
+    const unsigned int mask_mode = (t % 5) ? DEVELOP_MASK_MASK_CONDITIONAL : DEVELOP_MASK_MASK;
+    const float opacity = frand(0.0f, 1.0f);
+    for(int k = 0; k < WIDTH; k++) form[k] = frand(0.0f, 1.0f);
+
+    memcpy(m_plain, form, sizeof(float) * WIDTH);
+    memcpy(m_sse2, form, sizeof(float) * WIDTH);
+    dt_develop_blend_mask_row(cst, blendif, parameters, mask_mode, mask_combine, opacity, a, b, m_plain, WIDTH, 0);
+    if(!dt_develop_blend_mask_row(cst, blendif, parameters, mask_mode, mask_combine, opacity, a, b, m_sse2,
+                                  WIDTH, 1))
+      continue;
+
+    float err = 0.0f;
+    for(int k = 0; k < WIDTH; k++) err = fmaxf(err, fabsf(m_plain[k] - m_sse2[k]));
+    // a nan anywhere makes err nan, which is not below the limit either
+    if(!(err <= MAX_MASK_ERROR))
+    {
+      failed++;
+      printf("  [FAIL] %s blendif 0x%08x, mode %u, combine %u, opacity %g: max error %g\n", cst_name(cst), blendif,
+             mask_mode, mask_combine, opacity, err);
+    }
+    else
+      max_err = fmaxf(max_err, err);
+    tested++;
+  }
+  printf("  [%s] %d of %d %s blendif masks match, max error %g\n", failed ? "FAIL" : "OK", tested - failed, tested,
+         cst_name(cst), max_err);
+
+  free(form);
+  free(m_plain);
+  free(m_sse2);
+  return failed;
+}
+
+static void bench(const dt_iop_colorspace_type_t cst, const float *a, const float *b, const float *mask)
+{
+  const int runs = 2000;
+  float *out = malloc(sizeof(float) * 4 * WIDTH);
+  float *m = malloc(sizeof(float) * WIDTH);
+  float parameters[4 * DEVELOP_BLENDIF_SIZE];
+  for(int ch = 0; ch < DEVELOP_BLENDIF_SIZE; ch++)
+  {
+    parameters[4 * ch + 0] = 0.1f;
+    parameters[4 * ch + 1] = 0.3f;
+    parameters[4 * ch + 2] = 0.6f;
+    parameters[4 * ch + 3] = 0.9f;
+  }
+  const unsigned int blendif = 0x77 | (1u << DEVELOP_BLENDIF_active);
+
+  for(int m_i = 0; m_i < sizeof(modes) / sizeof(modes[0]); m_i++)
+  {
+    double rate[2];
+    for(int use_sse2 = 0; use_sse2 < 2; use_sse2++)
+    {
+      memcpy(out, b, sizeof(float) * 4 * WIDTH);
+      const double start = dt_get_wtime();
+      for(int r = 0; r < runs; r++) dt_develop_blend_row(cst, modes[m_i], 0, a, out, mask, WIDTH, use_sse2);
+      rate[use_sse2] = (double)runs * WIDTH / (dt_get_wtime() - start) * 1e-6;
+    }
+    fprintf(stderr, "[bench] %s blend mode 0x%02x: %8.1f Mpix/s plain, %8.1f Mpix/s sse2\n", cst_name(cst),
+            modes[m_i], rate[0], rate[1]);
+  }
+
+  double rate[2];
+  for(int use_sse2 = 0; use_sse2 < 2; use_sse2++)
+  {
+    const double start = dt_get_wtime();
+    for(int r = 0; r < runs; r++)
+    {
+      memcpy(m, mask, sizeof(float) * WIDTH);
+      dt_develop_blend_mask_row(cst, blendif, parameters, DEVELOP_MASK_MASK_CONDITIONAL, 0, 1.0f, a, b, m, WIDTH,
+                                use_sse2);
+    }
+    rate[use_sse2] = (double)runs * WIDTH / (dt_get_wtime() - start) * 1e-6;
+  }
+  fprintf(stderr, "[bench] %s blendif mask, 6 channels: %8.1f Mpix/s plain, %8.1f Mpix/s sse2\n", cst_name(cst),
+          rate[0], rate[1]);
+
+  free(out);
+  free(m);
+}
+
+int main(int argc, char *arg[])
+{
+  float *a = malloc(sizeof(float) * 4 * WIDTH);
+  float *b = malloc(sizeof(float) * 4 * WIDTH);
+  float *mask = malloc(sizeof(float) * WIDTH);
+  srand(42);
+  int failed = 0;
+
+  const dt_iop_colorspace_type_t spaces[] = { iop_cs_Lab, iop_cs_rgb };
+  for(int s = 0; s < 2; s++)
+  {
+    fill_row(spaces[s], a);
+    fill_row(spaces[s], b);
+    for(int k = 0; k < WIDTH; k++) mask[k] = frand(0.0f, 1.0f);
+
+    printf("running %s blend and mask kernels\n", cst_name(spaces[s]));
+    failed += test_blend(spaces[s], a, b, mask);
+    failed += test_mask(spaces[s], a, b);
+    if(argc > 1 && !strcmp(arg[1], "--bench")) bench(spaces[s], a, b, mask);
+  }
+
+  free(a);
+  free(b);
+  free(mask);
+  printf("%d failed\n", failed);
+  exit(failed ? 1 : 0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
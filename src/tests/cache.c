@@ -16,116 +16,140 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-
-#define DT_UNIT_TEST
-// define dt alloc, so we don't need to include the rest of dt:
-#define dt_alloc_align(A, B) malloc(B)
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
-// unit test for the concurrent hopscotch hashmap and the LRU cache built on top of it.
+// unit test for the concurrent LRU cache, and a benchmark for lock contention
+// with and without sharding.
 #include "common/cache.h"
-#include "common/cache.c"
+#include "common/darktable.h"
 
-#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
-int32_t alloc_dummy(void *data, const uint32_t key, int32_t *cost, void **buf)
+static void alloc_dummy(void *data, dt_cache_entry_t *entry)
 {
-  *cost = 1; // also the default
-  *buf = (void *)(long int)key;
-  // request write lock for our buffer?
-  return 0;
+  entry->cost = 1; // also the default
+  entry->data = (void *)(long int)entry->key;
+  entry->data_size = sizeof(void *);
 }
 
-int main(int argc, char *arg[])
+static void cleanup_dummy(void *data, dt_cache_entry_t *entry)
+{
+  // nothing allocated, nothing to free.
+}
+
+// every shard has to have each of its entries in the lru list exactly once. returns the number of shards which
+// don't, the number of entries goes to cnt.
+static int lru_check_consistency(dt_cache_t *cache, int *cnt)
+{
+  int broken = 0;
+  *cnt = 0;
+  for(uint32_t k = 0; k < cache->num_shards; k++)
+  {
+    const int len = g_list_length(cache->shards[k].lru);
+    const int entries = g_hash_table_size(cache->shards[k].hashtable);
+    if(len != entries)
+    {
+      printf("  [FAIL] shard %u: %d entries, but %d in the lru list\n", k, entries, len);
+      broken++;
+    }
+    *cnt += len;
+  }
+  return broken;
+}
+
+// inserts 100000 keys from many threads while the quota keeps evicting them. each key must be new when asked
+// for the first time, be found afterwards and come back with its own data. returns the number of failures.
+static int test_insert(const uint32_t num_shards, const size_t quota)
 {
+  printf("running test_insert, %u shard(s), quota %zu\n", num_shards, quota);
   dt_cache_t cache;
-  // dt_cache_init(&cache, 110000, 16, 64, 100000);
-  // really hammer it, make quota insanely low:
-  dt_cache_init(&cache, 110000, 16, 64, 100);
+  dt_cache_init_sharded(&cache, 0, quota, num_shards);
   dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
 
+  int present = 0, missing = 0, wrong = 0;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache, stderr) num_threads(16)
+#pragma omp parallel for default(none) schedule(guided) shared(cache) num_threads(16) \
+    reduction(+ : present, missing, wrong)
 #endif
   for(int k = 0; k < 100000; k++)
   {
-    void *data = (void *)(long int)k;
-    const int size = 0; // dt_cache_size(&cache);
-    const int con1 = dt_cache_contains(&cache, k);
-    const int val1 = (int)(long int)dt_cache_read_get(&cache, k);
-    const int val2 = (int)(long int)dt_cache_read_get(&cache, k);
-    // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1, val2,
-    // con1, con2);
-    const int con2 = dt_cache_contains(&cache, k);
-    assert(con1 == 0);
-    assert(con2 == 1);
-    assert(val2 == k);
-    dt_cache_read_release(&cache, k);
-    dt_cache_read_release(&cache, k);
+    if(dt_cache_contains(&cache, k)) present++;
+    dt_cache_entry_t *entry = dt_cache_get(&cache, k, 'r');
+    // we hold the read lock, nobody can evict it now
+    if(!dt_cache_contains(&cache, k)) missing++;
+    if((int)(long int)entry->data != k) wrong++;
+    dt_cache_release(&cache, entry);
   }
-  dt_cache_print_locked(&cache);
-  // fprintf(stderr, "\n");
-  fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-  const int size = dt_cache_size(&cache);
-  const int lru_cnt = lru_check_consistency(&cache);
-  const int lru_cnt_r = lru_check_consistency_reverse(&cache);
-  // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-  assert(size == lru_cnt);
-  assert(lru_cnt_r == lru_cnt);
-  fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
+  if(present) printf("  [FAIL] %d keys were there before they got inserted\n", present);
+  if(missing) printf("  [FAIL] %d keys were not there while being held\n", missing);
+  if(wrong) printf("  [FAIL] %d keys came back with the data of another key\n", wrong);
+
+  // with every entry costing 1, the cost is the number of entries left
+  int lru_cnt;
+  int failed = present + missing + wrong + lru_check_consistency(&cache, &lru_cnt);
+  const size_t cost = dt_cache_get_cost(&cache);
+  if(cost != (size_t)lru_cnt)
+  {
+    printf("  [FAIL] cost %zu, but %d entries left\n", cost, lru_cnt);
+    failed++;
+  }
+  if(!failed) printf("  [OK] %d entries left after the evictions\n", lru_cnt);
 
   dt_cache_cleanup(&cache);
+  return failed;
+}
 
+// many threads reading from a hot working set, as the lighttable does with thumbnails.
+static void bench_contention(const uint32_t num_shards, const int threads)
+{
+  const int working_set = 4096;
+  const int lookups = 2000000;
+  dt_cache_t cache;
+  dt_cache_init_sharded(&cache, 0, 2 * working_set, num_shards);
+  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
 
-
-  {
-    // now a harder case: a cache with only one entry and a lot of threads fighting over it:
-    dt_cache_t cache2;
-    // really hammer it, make quota insanely low:
-    // capacity 1 num threads 1 cache line size 64 ignored, quota 2 (80% => 1)
-    dt_cache_init(&cache2, 1, 1, 64, 2);
-    dt_cache_set_allocate_callback(&cache2, alloc_dummy, NULL);
-
+  const double start = dt_get_wtime();
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache2, stderr) num_threads(16)
+#pragma omp parallel for default(none) schedule(static) shared(cache) num_threads(threads)
 #endif
-    for(int k = 0; k < 100000; k++)
-    {
-      void *data = (void *)(long int)k;
-      const int size = 0; // dt_cache_size(&cache);
-      const int con1 = dt_cache_contains(&cache2, k);
-      const int val1 = (int)(long int)dt_cache_read_get(&cache2, k);
-      const int val2 = (int)(long int)dt_cache_read_get(&cache2, k);
-      // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1,
-      // val2, con1, con2);
-      const int con2 = dt_cache_contains(&cache2, k);
-      assert(con1 == 0);
-      assert(con2 == 1);
-      assert(val2 == k);
-      dt_cache_read_release(&cache2, k);
-      dt_cache_read_release(&cache2, k);
-    }
-    dt_cache_print_locked(&cache2);
-    // fprintf(stderr, "\n");
-    fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-    const int size = dt_cache_size(&cache2);
-    const int lru_cnt = lru_check_consistency(&cache2);
-    const int lru_cnt_r = lru_check_consistency_reverse(&cache2);
-    // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-    assert(size == lru_cnt);
-    assert(lru_cnt_r == lru_cnt);
-    fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
-    dt_cache_cleanup(&cache2);
+  for(int k = 0; k < lookups; k++)
+  {
+    // cheap scrambling so threads don't walk the keys in lock step:
+    const uint32_t key = ((uint32_t)k * 2654435761u) % working_set;
+    dt_cache_entry_t *entry = dt_cache_get(&cache, key, 'r');
+    dt_cache_release(&cache, entry);
+  }
+  const double end = dt_get_wtime();
+  fprintf(stderr, "[bench] %2u shard(s) %2d thread(s): %8.3f Mlookups/s\n", cache.num_shards, threads,
+          lookups / (end - start) * 1e-6);
+
+  dt_cache_cleanup(&cache);
+}
+
+int main(int argc, char *arg[])
+{
+  int failed = 0;
+  // really hammer it, make quota insanely low:
+  failed += test_insert(1, 100);
+  failed += test_insert(16, 100);
+  // now a harder case: a cache with only one entry and a lot of threads fighting over it:
+  failed += test_insert(1, 2);
+  // and a lot of shards which all want to hold at least one entry:
+  failed += test_insert(64, 2);
+  printf("%d failed\n", failed);
+
+  if(argc > 1 && !strcmp(arg[1], "--bench"))
+  {
+    for(uint32_t shards = 1; shards <= 64; shards *= 4)
+      for(int threads = 1; threads <= 32; threads *= 2) bench_contention(shards, threads);
   }
 
-  exit(0);
+  exit(failed ? 1 : 0);
 }
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,237 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compares the 3d tables of lcms2 transforms against lcms2 itself, on transforms through a lut based (abstract)
+// profile like colorin and colorout would see them. with --bench measures both.
+#include "common/colorspaces_lut3d.h"
+#include "common/darktable.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIXELS (1 << 20)
+// in-gamut colors to measure the delta E on
+#define SAMPLES (1 << 16)
+
+static cmsHPROFILE Lab, srgb;
+
+static float frand(const float lo, const float hi)
+{
+  return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// some pixels a bit outside of the table, they have to come out of lcms2 unchanged
+static void fill(const dt_colorspaces_lut3d_input_t input, float *px, const int n)
+{
+  for(int k = 0; k < n; k++)
+  {
+    if(input == DT_COLORSPACES_LUT3D_INPUT_LAB)
+    {
+      px[4 * k + 0] = frand(0.0f, 110.0f);
+      px[4 * k + 1] = frand(-100.0f, 100.0f);
+      px[4 * k + 2] = frand(-100.0f, 100.0f);
+    }
+    else
+      for(int c = 0; c < 3; c++) px[4 * k + c] = frand(0.0f, 1.05f);
+    px[4 * k + 3] = 1.0f;
+  }
+}
+
+// colors inside of srgb, as Lab if the transform takes Lab
+static void fill_gamut(const dt_colorspaces_lut3d_input_t input, float *px, const int n)
+{
+  for(int k = 0; k < n; k++)
+  {
+    for(int c = 0; c < 3; c++) px[4 * k + c] = frand(0.0f, 1.0f);
+    px[4 * k + 3] = 1.0f;
+  }
+  if(input == DT_COLORSPACES_LUT3D_INPUT_LAB)
+  {
+    cmsHTRANSFORM to_lab
+        = cmsCreateTransform(srgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsDoTransform(to_lab, px, px, n);
+    cmsDeleteTransform(to_lab);
+  }
+}
+
+static cmsCIELab to_cielab(const float *px)
+{
+  const cmsCIELab lab = { px[0], px[1], px[2] };
+  return lab;
+}
+
+// runs in-gamut colors through the table and through lcms2 and compares the results in Lab. returns the number
+// of colors further apart than DT_COLORSPACES_LUT3D_MAX_DE.
+static int test_delta_e(const char *name, const dt_colorspaces_lut3d_t *lut, cmsHTRANSFORM xform,
+                        const dt_colorspaces_lut3d_input_t input, cmsHPROFILE output)
+{
+  float *in = malloc(sizeof(float) * 4 * SAMPLES);
+  float *ref = malloc(sizeof(float) * 4 * SAMPLES);
+  float *res = malloc(sizeof(float) * 4 * SAMPLES);
+  fill_gamut(input, in, SAMPLES);
+  cmsDoTransform(xform, in, ref, SAMPLES);
+  dt_colorspaces_lut3d_transform(lut, xform, in, res, SAMPLES);
+
+  if(output)
+  {
+    cmsHTRANSFORM to_lab
+        = cmsCreateTransform(output, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsDoTransform(to_lab, ref, ref, SAMPLES);
+    cmsDoTransform(to_lab, res, res, SAMPLES);
+    cmsDeleteTransform(to_lab);
+  }
+
+  int failed = 0;
+  double sum = 0.0, max = 0.0;
+  for(int k = 0; k < SAMPLES; k++)
+  {
+    const cmsCIELab a = to_cielab(ref + 4 * k), b = to_cielab(res + 4 * k);
+    const double de = cmsDeltaE(&a, &b);
+    // nan fails as well
+    if(!(de <= DT_COLORSPACES_LUT3D_MAX_DE))
+    {
+      if(failed < 10)
+        printf("  [FAIL] %s: (%g %g %g) is off by delta E %g\n", name, in[4 * k], in[4 * k + 1], in[4 * k + 2],
+               de);
+      failed++;
+    }
+    else
+    {
+      sum += de;
+      max = fmax(max, de);
+    }
+  }
+  printf("  [%s] %s: %d of %d in-gamut colors within delta E %g of lcms2, mean %g, max %g\n",
+         failed ? "FAIL" : "OK", name, SAMPLES - failed, SAMPLES, DT_COLORSPACES_LUT3D_MAX_DE,
+         sum / MAX(SAMPLES - failed, 1), max);
+
+  free(in);
+  free(ref);
+  free(res);
+  return failed;
+}
+
+// pixels outside of the table have to take the lcms2 path and alpha must not be touched. returns the number
+// of pixels for which that isn't so.
+static int test_outside(const char *name, const dt_colorspaces_lut3d_t *lut, cmsHTRANSFORM xform,
+                        const dt_colorspaces_lut3d_input_t input, const int bench)
+{
+  float *in = malloc(sizeof(float) * 4 * PIXELS);
+  float *ref = malloc(sizeof(float) * 4 * PIXELS);
+  float *res = malloc(sizeof(float) * 4 * PIXELS);
+  fill(input, in, PIXELS);
+
+  double start = dt_get_wtime();
+  cmsDoTransform(xform, in, ref, PIXELS);
+  const double time_lcms2 = dt_get_wtime() - start;
+
+  // in place, as colorin does it
+  memcpy(res, in, sizeof(float) * 4 * PIXELS);
+  start = dt_get_wtime();
+  dt_colorspaces_lut3d_transform(lut, xform, res, res, PIXELS);
+  const double time_lut = dt_get_wtime() - start;
+
+  int outside = 0, failed = 0;
+  for(int k = 0; k < PIXELS; k++)
+  {
+    gboolean ok = res[4 * k + 3] == in[4 * k + 3];
+    const int inside = input == DT_COLORSPACES_LUT3D_INPUT_LAB ? in[4 * k] <= 100.0f
+                                                               : in[4 * k] <= 1.0f && in[4 * k + 1] <= 1.0f
+                                                                     && in[4 * k + 2] <= 1.0f;
+    if(!inside)
+    {
+      for(int c = 0; c < 3; c++) ok = ok && res[4 * k + c] == ref[4 * k + c];
+      outside++;
+    }
+    if(!ok) failed++;
+  }
+  printf("  [%s] %s: %d of %d pixels outside of the table went through lcms2, %d wrong\n", failed ? "FAIL" : "OK",
+         name, outside, PIXELS, failed);
+
+  if(bench)
+    fprintf(stderr, "[bench] %s, one thread: %8.1f Mpix/s lcms2, %8.1f Mpix/s table\n", name,
+            PIXELS / time_lcms2 * 1e-6, PIXELS / time_lut * 1e-6);
+
+  free(in);
+  free(ref);
+  free(res);
+  return failed;
+}
+
+static int test(const char *name, cmsHTRANSFORM xform, const dt_colorspaces_lut3d_input_t input,
+                cmsHPROFILE output, const int bench)
+{
+  printf("running %s\n", name);
+  if(!xform)
+  {
+    printf("  [FAIL] %s: lcms2 couldn't create the transform\n", name);
+    return 1;
+  }
+  dt_colorspaces_lut3d_t *lut = dt_colorspaces_lut3d_new(xform, input, output);
+  if(!lut)
+  {
+    printf("  [FAIL] %s: no table got close enough to lcms2\n", name);
+    return 1;
+  }
+
+  const int failed = test_delta_e(name, lut, xform, input, output) + test_outside(name, lut, xform, input, bench);
+  dt_colorspaces_lut3d_free(lut);
+  return failed;
+}
+
+int main(int argc, char *arg[])
+{
+  const int bench = argc > 1 && !strcmp(arg[1], "--bench");
+  srand(42);
+
+  // an abstract profile is a clut, so lcms2 can't collapse these transforms into a matrix
+  Lab = cmsCreateLab4Profile(NULL);
+  srgb = cmsCreate_sRGBProfile();
+  cmsHPROFILE abstract = cmsCreateBCHSWabstractProfile(17, 5.0, 1.1, 20.0, 1.2, 5000, 5000);
+  if(!abstract)
+  {
+    printf("lcms2 couldn't create the abstract profile\n");
+    exit(1);
+  }
+  int failed = 0;
+
+  // like colorout: Lab to an rgb output profile
+  cmsHPROFILE out_chain[] = { Lab, abstract, srgb };
+  cmsHTRANSFORM out = cmsCreateMultiprofileTransform(out_chain, 3, TYPE_LabA_FLT, TYPE_RGBA_FLT,
+                                                     INTENT_PERCEPTUAL, 0);
+  failed += test("Lab to rgb", out, DT_COLORSPACES_LUT3D_INPUT_LAB, srgb, bench);
+  if(out) cmsDeleteTransform(out);
+
+  // like colorin: an rgb input profile to Lab
+  cmsHPROFILE in_chain[] = { srgb, abstract, Lab };
+  cmsHTRANSFORM in = cmsCreateMultiprofileTransform(in_chain, 3, TYPE_RGBA_FLT, TYPE_LabA_FLT,
+                                                    INTENT_PERCEPTUAL, 0);
+  failed += test("rgb to Lab", in, DT_COLORSPACES_LUT3D_INPUT_RGB, NULL, bench);
+  if(in) cmsDeleteTransform(in);
+
+  cmsCloseProfile(abstract);
+  cmsCloseProfile(srgb);
+  cmsCloseProfile(Lab);
+  printf("%d failed\n", failed);
+  exit(failed ? 1 : 0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,169 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2019 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compiles a noiseprofile json and checks that every camera in it gets the same profiles from the compiled
+// table as from the json. with --bench also measures the first lookup of both.
+#include "common/darktable.h"
+#include "common/noiseprofiles.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// looks up all cameras through file, the time of the first lookup includes loading the file
+static GList **lookup_all(const char *file, const dt_image_t *cameras, const int n, double *first)
+{
+  GList **result = calloc(n, sizeof(GList *));
+  dt_noiseprofile_init(file);
+  const double start = dt_get_wtime();
+  for(int k = 0; k < n; k++)
+  {
+    result[k] = dt_noiseprofile_get_matching(cameras + k);
+    if(k == 0) *first = dt_get_wtime() - start;
+  }
+  return result;
+}
+
+// the profiles of one camera have to come out of the compiled table just like out of the json. returns 1 if
+// they don't.
+static int compare(const dt_image_t *camera, GList *from_json, GList *from_bin, int *profiles)
+{
+  if(g_list_length(from_json) != g_list_length(from_bin))
+  {
+    printf("  [FAIL] %s %s: %d profiles in the json, %d in the compiled table\n", camera->camera_maker,
+           camera->camera_model, g_list_length(from_json), g_list_length(from_bin));
+    return 1;
+  }
+  for(GList *a = from_json, *b = from_bin; a && b; a = g_list_next(a), b = g_list_next(b))
+  {
+    const dt_noiseprofile_t *pa = (dt_noiseprofile_t *)a->data;
+    const dt_noiseprofile_t *pb = (dt_noiseprofile_t *)b->data;
+    gboolean same = !strcmp(pa->name, pb->name) && pa->iso == pb->iso;
+    for(int c = 0; c < 3; c++) same = same && pa->a[c] == pb->a[c] && pa->b[c] == pb->b[c];
+    if(!same)
+    {
+      printf("  [FAIL] %s %s: compiled table has `%s' at iso %d, the json `%s' at iso %d\n", camera->camera_maker,
+             camera->camera_model, pb->name, pb->iso, pa->name, pa->iso);
+      return 1;
+    }
+    (*profiles)++;
+  }
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s <noiseprofiles.json> [--bench]\n", arg[0]);
+    exit(1);
+  }
+  const char *json = arg[1];
+  const int bench = argc > 2 && !strcmp(arg[2], "--bench");
+
+  gchar *bin = g_build_filename(g_get_tmp_dir(), "darktable-test-noiseprofiles.bin", NULL);
+  if(!dt_noiseprofile_compile(json, bin))
+  {
+    printf("  [FAIL] couldn't compile %s\n", json);
+    g_free(bin);
+    exit(1);
+  }
+
+  // the cameras to look up, straight from the json, and one nobody has
+  JsonParser *parser = json_parser_new();
+  if(!json_parser_load_from_file(parser, json, NULL))
+  {
+    printf("  [FAIL] couldn't parse %s\n", json);
+    g_object_unref(parser);
+    g_unlink(bin);
+    g_free(bin);
+    exit(1);
+  }
+  JsonReader *reader = json_reader_new(json_parser_get_root(parser));
+  GArray *cameras = g_array_new(FALSE, TRUE, sizeof(dt_image_t));
+  json_reader_read_member(reader, "noiseprofiles");
+  const int n_makers = json_reader_count_elements(reader);
+  for(int i = 0; i < n_makers; i++)
+  {
+    json_reader_read_element(reader, i);
+    json_reader_read_member(reader, "maker");
+    dt_image_t img;
+    memset(&img, 0, sizeof(img));
+    g_strlcpy(img.camera_maker, json_reader_get_string_value(reader), sizeof(img.camera_maker));
+    json_reader_end_member(reader);
+
+    json_reader_read_member(reader, "models");
+    const int n_models = json_reader_count_elements(reader);
+    for(int j = 0; j < n_models; j++)
+    {
+      json_reader_read_element(reader, j);
+      json_reader_read_member(reader, "model");
+      g_strlcpy(img.camera_model, json_reader_get_string_value(reader), sizeof(img.camera_model));
+      json_reader_end_member(reader);
+      json_reader_end_element(reader);
+      g_array_append_val(cameras, img);
+    }
+    json_reader_end_member(reader);
+    json_reader_end_element(reader);
+  }
+  json_reader_end_member(reader);
+  dt_image_t nobody;
+  memset(&nobody, 0, sizeof(nobody));
+  g_strlcpy(nobody.camera_maker, "Nobody", sizeof(nobody.camera_maker));
+  g_strlcpy(nobody.camera_model, "Nothing", sizeof(nobody.camera_model));
+  g_array_append_val(cameras, nobody);
+
+  const int n = cameras->len;
+  double time_json, time_bin;
+  GList **from_json = lookup_all(json, (dt_image_t *)cameras->data, n, &time_json);
+  GList **from_bin = lookup_all(bin, (dt_image_t *)cameras->data, n, &time_bin);
+
+  int failed = 0, profiles = 0;
+  if(from_json[n - 1] || from_bin[n - 1])
+  {
+    printf("  [FAIL] found profiles for a camera that isn't in the json\n");
+    failed++;
+  }
+  for(int k = 0; k < n; k++)
+  {
+    failed += compare((dt_image_t *)cameras->data + k, from_json[k], from_bin[k], &profiles);
+    g_list_free_full(from_json[k], dt_noiseprofile_free);
+    g_list_free_full(from_bin[k], dt_noiseprofile_free);
+  }
+  printf("  [%s] %d cameras, %d profiles identical in json and compiled table\n", failed ? "FAIL" : "OK", n - 1,
+         profiles);
+
+  if(bench)
+    fprintf(stderr, "[bench] first lookup: %8.3f ms json, %8.3f ms compiled table\n", time_json * 1e3,
+            time_bin * 1e3);
+
+  dt_noiseprofile_init(NULL);
+  free(from_json);
+  free(from_bin);
+  g_array_free(cameras, TRUE);
+  g_object_unref(reader);
+  g_object_unref(parser);
+  g_unlink(bin);
+  g_free(bin);
+  printf("%d failed\n", failed);
+  exit(failed ? 1 : 0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
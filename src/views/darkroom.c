@@ -768,29 +768,17 @@ static void dt_dev_jump_image(dt_develop_t *dev, int diff)
 
     offset = dt_collection_image_offset(orig_imgid);
 
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + diff);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      imgid = sqlite3_column_int(stmt, 0);
-
-      if(orig_imgid == imgid)
-      {
-        // nothing to do
-        sqlite3_finalize(stmt);
-        return;
-      }
+    imgid = dt_collection_get_nth(darktable.collection, offset + diff);
+    // nothing to do if we are at either end
+    if(imgid == -1 || orig_imgid == imgid) return;
 
-      if(!dev->image_loading)
-      {
-        dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, FALSE);
-        // record the imgid to display when going back to lighttable
-        dt_view_lighttable_set_position(darktable.view_manager, dt_collection_image_offset(imgid));
-        dt_dev_change_image(dev, imgid);
-      }
+    if(!dev->image_loading)
+    {
+      dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, FALSE);
+      // record the imgid to display when going back to lighttable
+      dt_view_lighttable_set_position(darktable.view_manager, offset + diff);
+      dt_dev_change_image(dev, imgid);
     }
-    sqlite3_finalize(stmt);
   }
 }
 
@@ -149,6 +149,17 @@ typedef struct dt_library_t
 
   int32_t collection_count;
 
+  // speculative thumbnail loading ahead of the scroll direction
+  struct
+  {
+    int32_t last_offset; // first visible image of the previous expose, -1 before the first one
+    double last_time;
+    float velocity;      // smoothed scroll speed in rows per second
+    int direction;       // 1 scrolling down, -1 up, 0 not known yet
+    GHashTable *pending; // prefetched images which have not been shown yet
+    uint64_t queued, hits, misses, cancelled;
+  } prefetch;
+
   // stuff for the audio player
   GPid audio_player_pid;   // the pid of the child process
   int32_t audio_player_id; // the imgid of the image the audio is played for
@@ -548,6 +559,8 @@ void init(dt_view_t *self)
   lib->offset_y = 0;
 
   lib->thumbs_table = g_hash_table_new(g_int_hash, g_int_equal);
+  lib->prefetch.pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+  lib->prefetch.last_offset = -1;
 
   /* setup collection listener and initialize main_query statement */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED,
@@ -577,6 +590,7 @@ void cleanup(dt_view_t *self)
   dt_conf_set_float("lighttable/ui/zoom_y", lib->zoom_y);
   if(lib->audio_player_id != -1) _stop_audio(lib);
   g_hash_table_destroy(lib->thumbs_table);
+  g_hash_table_destroy(lib->prefetch.pending);
   free(lib->full_res_thumb);
   free(self->data);
 }
@@ -592,6 +606,167 @@ void cleanup(dt_view_t *self)
  * \return The absolute, zero-based index of the specified grid location
  */
 
+// how far ahead of the scroll position thumbnails are prefetched, in seconds of scrolling
+#define DT_PREFETCH_LOOKAHEAD 0.5f
+
+// prefetched thumbnails not shown yet. beyond that they most likely scrolled past or were dropped from the
+// (bounded) job queue, and are forgotten.
+#define DT_PREFETCH_MAX_PENDING 64
+
+// prefetch jobs waiting in the foreground queue at most. the queue drops its oldest jobs when it is full, and
+// those are the thumbnails missing on screen, so prefetching takes only a part of what is left next to them.
+#define DT_PREFETCH_MAX_JOBS (DT_CONTROL_MAX_JOBS / 3)
+
+// queued prefetch jobs only run if they still belong to the current generation. it is bumped whenever
+// the scroll direction reverses, which cancels everything that is still waiting in the queue.
+static gint _prefetch_generation = 0;
+
+// prefetch jobs queued and not disposed yet, they leave the queue by running or by being dropped
+static gint _prefetch_jobs = 0;
+
+typedef struct _prefetch_job_t
+{
+  int32_t imgid;
+  dt_mipmap_size_t mip;
+  gint generation;
+} _prefetch_job_t;
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  _prefetch_job_t *params = dt_control_job_get_params(job);
+  if(params->generation != g_atomic_int_get(&_prefetch_generation)) return 0;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+static void _prefetch_job_free(void *params)
+{
+  g_atomic_int_add(&_prefetch_jobs, -1);
+  free(params);
+}
+
+static void _prefetch_print_stats(dt_library_t *lib)
+{
+  const uint64_t shown = lib->prefetch.hits + lib->prefetch.misses;
+  dt_print(DT_DEBUG_CACHE,
+           "[lighttable prefetch] queued %" PRIu64 ", shown %" PRIu64 " (hit rate %.1f%%), cancelled %" PRIu64
+           "\n",
+           lib->prefetch.queued, shown, shown ? 100.0 * lib->prefetch.hits / shown : 0.0,
+           lib->prefetch.cancelled);
+}
+
+static void _prefetch_cancel(dt_library_t *lib)
+{
+  g_atomic_int_inc(&_prefetch_generation);
+  lib->prefetch.cancelled += g_hash_table_size(lib->prefetch.pending);
+  g_hash_table_remove_all(lib->prefetch.pending);
+}
+
+// called for every drawn thumbnail, counts whether a prefetched one was ready in time
+static void _prefetch_account(dt_library_t *lib, const int32_t imgid, const int thumb_missed)
+{
+  if(!g_hash_table_remove(lib->prefetch.pending, GINT_TO_POINTER(imgid))) return;
+
+  if(thumb_missed)
+    lib->prefetch.misses++;
+  else
+    lib->prefetch.hits++;
+
+  if((lib->prefetch.hits + lib->prefetch.misses) % 100 == 0) _prefetch_print_stats(lib);
+}
+
+// follows the scroll position and queues thumbnails for the rows about to come into view. offset is the
+// collection index of the first visible image, stride the distance between rows and cols the number of
+// images per row that get drawn, missing the number of thumbnails on screen which were requested this expose.
+static void _prefetch_update(dt_library_t *lib, const int32_t offset, const int stride, const int cols,
+                             const int visible_rows, const dt_mipmap_size_t mip, const int missing)
+{
+  const double now = dt_get_wtime();
+  const int32_t last_offset = lib->prefetch.last_offset;
+  const double dt = now - lib->prefetch.last_time;
+  lib->prefetch.last_offset = offset;
+  lib->prefetch.last_time = now;
+
+  if(last_offset < 0) return;
+
+  // panning sideways in the zoomable lighttable doesn't bring new rows
+  const int rows = (offset - last_offset) / stride;
+  if(rows == 0) return;
+
+  const int direction = rows > 0 ? 1 : -1;
+  if((lib->prefetch.direction && direction != lib->prefetch.direction)
+     || g_hash_table_size(lib->prefetch.pending) > DT_PREFETCH_MAX_PENDING)
+    _prefetch_cancel(lib);
+  lib->prefetch.direction = direction;
+
+  // a pause starts over, otherwise smooth the speed a bit
+  const float speed = MAX(abs(rows), 1) / MAX(dt, 1e-3);
+  lib->prefetch.velocity = dt > 1.0 ? MAX(abs(rows), 1) : 0.5f * (lib->prefetch.velocity + speed);
+
+  const int max_rows = dt_conf_get_int("plugins/lighttable/prefetch_rows");
+  const int num_rows = MIN(max_rows, 1 + (int)(lib->prefetch.velocity * DT_PREFETCH_LOOKAHEAD));
+  if(num_rows <= 0) return;
+
+  // the visible thumbnails were queued before us and must not get pushed out of the queue
+  const int budget
+      = MIN(DT_PREFETCH_MAX_JOBS, (DT_CONTROL_MAX_JOBS - missing) / 2) - g_atomic_int_get(&_prefetch_jobs);
+  if(budget <= 0) return;
+
+  // the nearest thumbnails not in the cache yet, nearest row first
+  int32_t ids[DT_PREFETCH_MAX_JOBS];
+  int n = 0;
+  for(int r = 0; r < num_rows && n < budget; r++)
+  {
+    const int32_t start = direction > 0 ? offset + (visible_rows + r) * stride : offset - (r + 1) * stride;
+    if(start < 0 || start >= lib->collection_count) continue;
+
+    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
+    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, start);
+    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, cols);
+    while(n < budget && sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+    {
+      const int32_t imgid = sqlite3_column_int(lib->statements.main_query, 0);
+      if(g_hash_table_contains(lib->prefetch.pending, GINT_TO_POINTER(imgid))) continue;
+
+      // nothing to do if the thumbnail is there already
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+      const gboolean cached = buf.buf != NULL;
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      if(!cached) ids[n++] = imgid;
+    }
+  }
+
+  const gint generation = g_atomic_int_get(&_prefetch_generation);
+
+  // nearest last, the foreground queue is a stack. that also puts all of them in front of the thumbnails on
+  // screen, which is why there are only few.
+  for(int k = n - 1; k >= 0; k--)
+  {
+    dt_job_t *job = dt_control_job_create(&_prefetch_job_run, "prefetch image %d mip %d", ids[k], mip);
+    if(!job) return;
+    _prefetch_job_t *params = (_prefetch_job_t *)calloc(1, sizeof(_prefetch_job_t));
+    if(!params)
+    {
+      dt_control_job_dispose(job);
+      return;
+    }
+    params->imgid = ids[k];
+    params->mip = mip;
+    params->generation = generation;
+    g_atomic_int_inc(&_prefetch_jobs);
+    dt_control_job_set_params_with_size(job, params, sizeof(_prefetch_job_t), _prefetch_job_free);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+
+    g_hash_table_add(lib->prefetch.pending, GINT_TO_POINTER(ids[k]));
+    lib->prefetch.queued++;
+  }
+}
+
 static int expose_filemanager(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t pointerx,
                                int32_t pointery)
 {
@@ -756,6 +931,9 @@ static int expose_filemanager(dt_view_t *self, cairo_t *cr, int32_t width, int32
   }
 
 end_query_cache:
+  // one query for the flags of all visible thumbnails
+  dt_view_image_snapshot_begin(query_ids, max_rows * max_cols);
+
   mouse_over_id = -1;
   cairo_save(cr);
   int current_image = 0;
@@ -923,6 +1101,7 @@ end_query_cache:
             g_hash_table_add(lib->thumbs_table, (gpointer)&id);
           else
             g_hash_table_remove(lib->thumbs_table, (gpointer)&id);
+          _prefetch_account(lib, id, thumb_missed);
 
           missing += thumb_missed;
         }
@@ -1102,37 +1281,15 @@ escape_image_loop:
 escape_border_loop:
   cairo_restore(cr);
 after_drawing:
-  /* check if offset was changed and we need to prefetch thumbs */
-  if(offset_changed)
+  /* queue the thumbnails of the rows we are scrolling towards */
   {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5 * max_rows + 1;
-    int32_t *imgids = malloc(prefetchrows * iir * sizeof(int32_t));
-
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offest and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows * iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows * iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
-    float imgwd = iir == 1 ? 0.97 : 0.8;
-    dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
-                                                             imgwd * (iir == 1 ? height : ht));
-    while(imgids_num > 0)
-    {
-      imgids_num--;
-      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[imgids_num], mip, DT_MIPMAP_PREFETCH, 'r');
-    }
-
-    free(imgids);
+    const float imgwd = iir == 1 ? 0.97 : 0.8;
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
+                                                                   imgwd * (iir == 1 ? height : ht));
+    _prefetch_update(lib, offset, iir, iir, max_rows, mip, missing);
   }
 
+  dt_view_image_snapshot_end();
   free(query_ids);
   // oldpan = pan;
   if(darktable.unmuted & DT_DEBUG_CACHE) dt_mipmap_cache_print(darktable.mipmap_cache);
@@ -1366,6 +1523,7 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
   cairo_translate(cr, -offset_x * wd, -offset_y * ht);
   cairo_translate(cr, -MIN(offset_i * wd, 0.0), 0.0);
   const int before_last_exposed_id = lib->last_exposed_id;
+  const int first_offset = offset;
 
   for(int row = 0; row < max_rows; row++)
   {
@@ -1423,6 +1581,7 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
             g_hash_table_add(lib->thumbs_table, (gpointer)&id);
           else
             g_hash_table_remove(lib->thumbs_table, (gpointer)&id);
+          _prefetch_account(lib, id, thumb_missed);
 
           missing += thumb_missed;
         }
@@ -1447,6 +1606,13 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
   }
 failure:
 
+  /* queue the thumbnails of the rows we are scrolling towards */
+  if(zoom > 1)
+  {
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, 0.9 * wd, 0.9 * ht);
+    _prefetch_update(lib, MAX(first_offset, 0), DT_LIBRARY_MAX_ZOOM, max_cols, max_rows, mip, missing);
+  }
+
   lib->zoom_x = zoom_x;
   lib->zoom_y = zoom_y;
   lib->track = 0;
@@ -1688,6 +1854,14 @@ static int expose_expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
     images[i].y = images[i].y * factor + yoff;
   }
 
+  int *imgids = (int *)malloc(sizeof(int) * sel_img_count);
+  if(imgids)
+  {
+    for(i = 0; i < sel_img_count; i++) imgids[i] = images[i].imgid;
+    dt_view_image_snapshot_begin(imgids, sel_img_count);
+    free(imgids);
+  }
+
   for(i = 0; i < sel_img_count; i++)
   {
     cairo_save(cr);
@@ -1716,6 +1890,7 @@ static int expose_expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
     }
   }
 
+  dt_view_image_snapshot_end();
   free(images);
 
   sqlite3_finalize(stmt);
@@ -2241,6 +2416,9 @@ void enter(dt_view_t *self)
   // clear some state variables
   dt_library_t *lib = (dt_library_t *)self->data;
   lib->button = 0;
+
+  lib->prefetch.last_offset = -1;
+  lib->prefetch.direction = 0;
   lib->pan = 0;
   lib->force_expose_all = TRUE;
   lib->activate_on_release = DT_VIEW_ERR;
@@ -2288,6 +2466,10 @@ void leave(dt_view_t *self)
   lib->pan = 0;
   lib->activate_on_release = DT_VIEW_ERR;
 
+  // nothing we prefetched is going to be shown any more, don't let it compete with the next view
+  if(lib->prefetch.queued) _prefetch_print_stats(lib);
+  _prefetch_cancel(lib);
+
   // exit preview mode if non-sticky
   if(lib->full_preview_id != -1 && lib->full_preview_sticky == 0)
   {
@@ -146,6 +146,7 @@ static int process_next_image(dt_slideshow_t *d)
   buf.levels = levels;
   buf.bpp = bpp;
   buf.write_image = write_image;
+  buf.write_image_begin = NULL;
   dat.max_width = d->width;
   dat.max_height = d->height;
   dat.style[0] = '\0';
@@ -65,12 +65,6 @@ void dt_view_manager_init(dt_view_manager_t *vm)
                               &vm->statements.make_selected, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT num FROM main.history WHERE imgid = ?1", -1,
                               &vm->statements.have_history, NULL);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT color FROM main.color_labels WHERE imgid=?1",
-                              -1, &vm->statements.get_color, NULL);
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "SELECT id FROM main.images WHERE group_id = (SELECT group_id FROM main.images WHERE id=?1) AND id != ?2",
-      -1, &vm->statements.get_grouped, NULL);
 
   dt_view_manager_load_modules(vm);
 
@@ -100,6 +94,9 @@ void dt_view_manager_gui_init(dt_view_manager_t *vm)
 void dt_view_manager_cleanup(dt_view_manager_t *vm)
 {
   for(GList *iter = vm->views; iter; iter = g_list_next(iter)) dt_view_unload_module((dt_view_t *)iter->data);
+  free(vm->snapshot.imgid);
+  free(vm->snapshot.flags);
+  free(vm->snapshot.colorlabels);
 }
 
 const dt_view_t *dt_view_manager_get_current_view(dt_view_manager_t *vm)
@@ -1030,6 +1027,109 @@ dt_view_image_over_t dt_view_guess_image_over(int32_t width, int32_t height, int
   return DT_VIEW_DESERT;
 }
 
+// fills the snapshot with the state of the given images, with a single query
+static void _view_image_snapshot_load(dt_view_image_snapshot_t *snap, const int *imgids, const int count)
+{
+  snap->count = 0;
+
+  GString *ids = g_string_new(NULL);
+  int num = 0;
+  for(int k = 0; k < count; k++)
+  {
+    if(imgids[k] <= 0) continue;
+    g_string_append_printf(ids, num ? ",%d" : "%d", imgids[k]);
+    num++;
+  }
+
+  if(num > snap->alloc)
+  {
+    snap->imgid = realloc(snap->imgid, sizeof(int32_t) * num);
+    snap->flags = realloc(snap->flags, sizeof(uint8_t) * num);
+    snap->colorlabels = realloc(snap->colorlabels, sizeof(uint8_t) * num);
+    snap->alloc = num;
+  }
+
+  if(num)
+  {
+    // the color labels are unique per image, so their sum is a bit mask
+    gchar *query = g_strdup_printf(
+        "SELECT i.id,"
+        " EXISTS(SELECT 1 FROM main.selected_images AS s WHERE s.imgid = i.id),"
+        " EXISTS(SELECT 1 FROM main.images AS g WHERE g.group_id = i.group_id AND g.id != i.id),"
+        " (SELECT SUM(1 << c.color) FROM main.color_labels AS c WHERE c.imgid = i.id AND c.color < 8),"
+        " (SELECT GROUP_CONCAT(h.operation, ',') FROM main.history AS h"
+        "  WHERE h.imgid = i.id AND h.num < i.history_end AND h.enabled = 1)"
+        " FROM main.images AS i WHERE i.id IN (%s) ORDER BY i.id",
+        ids->str);
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    while(sqlite3_step(stmt) == SQLITE_ROW && snap->count < num)
+    {
+      const int k = snap->count++;
+      snap->imgid[k] = sqlite3_column_int(stmt, 0);
+      snap->flags[k] = 0;
+      if(sqlite3_column_int(stmt, 1)) snap->flags[k] |= DT_VIEW_SNAPSHOT_SELECTED;
+      if(sqlite3_column_int(stmt, 2)) snap->flags[k] |= DT_VIEW_SNAPSHOT_GROUPED;
+      snap->colorlabels[k] = sqlite3_column_int(stmt, 3);
+
+      const char *ops = (const char *)sqlite3_column_text(stmt, 4);
+      if(ops)
+      {
+        gchar **op = g_strsplit(ops, ",", -1);
+        for(int i = 0; op[i]; i++)
+          if(dt_image_history_op_alters(op[i]))
+          {
+            snap->flags[k] |= DT_VIEW_SNAPSHOT_ALTERED;
+            break;
+          }
+        g_strfreev(op);
+      }
+    }
+    sqlite3_finalize(stmt);
+    g_free(query);
+  }
+
+  g_string_free(ids, TRUE);
+}
+
+void dt_view_image_snapshot_begin(const int *imgids, const int count)
+{
+  _view_image_snapshot_load(&darktable.view_manager->snapshot, imgids, count);
+}
+
+void dt_view_image_snapshot_end()
+{
+  darktable.view_manager->snapshot.count = 0;
+}
+
+// looks up the image in the snapshot, images drawn outside of one get a snapshot of their own
+static void _view_image_snapshot_get(const uint32_t imgid, uint8_t *flags, uint8_t *colorlabels)
+{
+  const dt_view_image_snapshot_t *snap = &darktable.view_manager->snapshot;
+  int lo = 0, hi = snap->count - 1;
+  while(lo <= hi)
+  {
+    const int mid = (lo + hi) / 2;
+    if(snap->imgid[mid] == (int32_t)imgid)
+    {
+      *flags = snap->flags[mid];
+      *colorlabels = snap->colorlabels[mid];
+      return;
+    }
+    if(snap->imgid[mid] < (int32_t)imgid)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+
+  int32_t id = 0;
+  uint8_t f = 0, c = 0;
+  dt_view_image_snapshot_t single = { 0, 1, &id, &f, &c };
+  _view_image_snapshot_load(&single, (const int *)&imgid, 1);
+  *flags = f;
+  *colorlabels = c;
+}
+
 int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo_t *cr, int32_t width,
                          int32_t height, int32_t zoom, int32_t px, int32_t py, gboolean full_preview, gboolean image_only)
 {
@@ -1059,18 +1159,12 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
   dt_gui_color_t fontcol = DT_GUI_COLOR_THUMBNAIL_FONT;
   dt_gui_color_t outlinecol = DT_GUI_COLOR_THUMBNAIL_OUTLINE;
 
-  int selected = 0, is_grouped = 0;
+  // selection, grouping, history and color labels all come from the snapshot, no queries per thumbnail
+  uint8_t image_flags = 0, colorlabels = 0;
+  if(!image_only) _view_image_snapshot_get(imgid, &image_flags, &colorlabels);
 
-  if (draw_selected)
-  {
-    /* clear and reset statements */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-    DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-    /* bind imgid to prepared statements */
-    DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, imgid);
-    /* lets check if imgid is selected */
-    if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW) selected = 1;
-  }
+  const int selected = draw_selected && (image_flags & DT_VIEW_SNAPSHOT_SELECTED);
+  int is_grouped = 0;
 
   dt_image_t buffered_image;
   const dt_image_t *img;
@@ -1469,13 +1563,8 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
 
       if(draw_grouping)
       {
-        DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_grouped);
-        DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_grouped);
-        DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_grouped, 1, imgid);
-        DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_grouped, 2, imgid);
-
         /* lets check if imgid is in a group */
-        if(sqlite3_step(darktable.view_manager->statements.get_grouped) == SQLITE_ROW)
+        if(image_flags & DT_VIEW_SNAPSHOT_GROUPED)
           is_grouped = 1;
         else if(img && darktable.gui->expanded_group_id == img->group_id)
           darktable.gui->expanded_group_id = -1;
@@ -1490,7 +1579,7 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
       }
 
       // image altered?
-      if(draw_history && dt_image_altered(imgid))
+      if(draw_history && (image_flags & DT_VIEW_SNAPSHOT_ALTERED))
       {
         if(dt_view_process_image_over(DT_VIEW_ALTERED, img != NULL, cr, img,
                                       width, height, zoom, px, py, outlinecol, fontcol))
@@ -1523,26 +1612,17 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
       gboolean colorlabel_painted = FALSE;
       gboolean painted_col[] = {FALSE, FALSE, FALSE, FALSE, FALSE};
 
-      /* clear and reset prepared statement */
-      DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_color);
-      DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_color);
-
-      /* setup statement and iterate rows */
-      DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_color, 1, imgid);
-      while(sqlite3_step(darktable.view_manager->statements.get_color) == SQLITE_ROW)
+      for(int col = 0; col < max_col; col++)
       {
+        if(!(colorlabels & (1 << col))) continue;
         cairo_save(cr);
-        const int col = sqlite3_column_int(darktable.view_manager->statements.get_color, 0);
-        if (col < max_col)
-        {
-          // see src/dtgtk/paint.c
-          if (zoom != 1)
-            dtgtk_cairo_paint_label(cr, x[col]  * width, y[col] * height, r * 2, r * 2, col, NULL);
-          else
-            dtgtk_cairo_paint_label(cr, x_zoom[col]  * fscale, y_zoom[col] * fscale, r * 2, r * 2, col, NULL);
-          colorlabel_painted = colorlabel_painted || TRUE;
-          painted_col[col] = TRUE;
-        }
+        // see src/dtgtk/paint.c
+        if (zoom != 1)
+          dtgtk_cairo_paint_label(cr, x[col]  * width, y[col] * height, r * 2, r * 2, col, NULL);
+        else
+          dtgtk_cairo_paint_label(cr, x_zoom[col]  * fscale, y_zoom[col] * fscale, r * 2, r * 2, col, NULL);
+        colorlabel_painted = TRUE;
+        painted_col[col] = TRUE;
         cairo_restore(cr);
       }
       if (colorlabel_painted)
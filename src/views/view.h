@@ -153,6 +153,33 @@ int32_t dt_view_get_image_to_act_on();
 /** guess the image_over flag assuming that all possible controls are displayed */
 dt_view_image_over_t dt_view_guess_image_over(int32_t width, int32_t height, int32_t zoom, int32_t px, int32_t py);
 
+/** per image flags kept in a thumbnail snapshot */
+typedef enum dt_view_image_snapshot_flags_t
+{
+  DT_VIEW_SNAPSHOT_SELECTED = 1 << 0,
+  DT_VIEW_SNAPSHOT_GROUPED = 1 << 1, // there are other images in its group
+  DT_VIEW_SNAPSHOT_ALTERED = 1 << 2
+} dt_view_image_snapshot_flags_t;
+
+/**
+ * the database state dt_view_image_expose() draws for a set of images: selection, grouping,
+ * history and color labels. it is loaded with one query for all thumbnails on screen instead
+ * of several queries per thumbnail and redraw. arrays are sorted by image id.
+ */
+typedef struct dt_view_image_snapshot_t
+{
+  int count, alloc;
+  int32_t *imgid;
+  uint8_t *flags;       // dt_view_image_snapshot_flags_t
+  uint8_t *colorlabels; // bit n is set for color label n
+} dt_view_image_snapshot_t;
+
+/** loads the snapshot for the images about to be drawn, ids <= 0 are skipped.
+    dt_view_image_expose() reads from it until dt_view_image_snapshot_end(). */
+void dt_view_image_snapshot_begin(const int *imgids, const int count);
+/** drops the snapshot, it is stale once the drawing is done. */
+void dt_view_image_snapshot_end();
+
 /** expose an image, set image over flags. return != 0 if thumbnail wasn't loaded yet. */
 int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t index, cairo_t *cr, int32_t width,
                          int32_t height, int32_t zoom, int32_t px, int32_t py, gboolean full_preview, gboolean image_only);
@@ -198,12 +225,11 @@ typedef struct dt_view_manager_t
     sqlite3_stmt *delete_from_selected;
     /* insert into selected_images values (?1) */
     sqlite3_stmt *make_selected;
-    /* select color from color_labels where imgid=?1 */
-    sqlite3_stmt *get_color;
-    /* select images in group from images where imgid=?1 (also bind to ?2) */
-    sqlite3_stmt *get_grouped;
   } statements;
 
+  /* flags of the thumbnails currently being drawn */
+  dt_view_image_snapshot_t snapshot;
+
 
   /*
    * Proxy